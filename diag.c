@@ -0,0 +1,258 @@
+#include <nlink/diag.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+/******************************************************************************
+ * Dump request
+ ******************************************************************************/
+
+/*
+ * Compile filter criteria into a conjunction of conditions.
+ *
+ * Each condition jumps to the next one when satisfied and past the end of
+ * program otherwise, i.e. to offset len + 4, which kernel interprets as a
+ * reject. Falling through the end of program means accept.
+ */
+static unsigned int
+nlink_diag_compile(const struct nlink_diag_filter *filter,
+                   uint8_t                         code[NLINK_DIAG_BYTECODE_SIZE])
+{
+	unsigned int len = 0;
+	unsigned int off = 0;
+
+	if (filter->sport)
+		len += 2 * sizeof(struct inet_diag_bc_op);
+	if (filter->dport)
+		len += 2 * sizeof(struct inet_diag_bc_op);
+	if (filter->cgroup)
+		len += sizeof(struct inet_diag_bc_op) + sizeof(uint64_t);
+
+	nlink_assert(len <= NLINK_DIAG_BYTECODE_SIZE);
+
+	if (filter->sport || filter->dport) {
+		unsigned int p;
+
+		for (p = 0; p < 2; p++) {
+			struct inet_diag_bc_op op[2];
+			uint16_t               port = p ? filter->dport :
+			                                  filter->sport;
+
+			if (!port)
+				continue;
+
+			op[0].code = p ? INET_DIAG_BC_D_EQ : INET_DIAG_BC_S_EQ;
+			op[0].yes = sizeof(op);
+			op[0].no = (unsigned short)(len - off + 4);
+			op[1].code = INET_DIAG_BC_NOP;
+			op[1].yes = 0;
+			op[1].no = port;
+
+			memcpy(&code[off], op, sizeof(op));
+			off += sizeof(op);
+		}
+	}
+
+	if (filter->cgroup) {
+		struct inet_diag_bc_op op = {
+			.code = INET_DIAG_BC_CGROUP_COND,
+			.yes  = sizeof(op) + sizeof(uint64_t),
+			.no   = (unsigned short)(len - off + 4)
+		};
+
+		memcpy(&code[off], &op, sizeof(op));
+		memcpy(&code[off + sizeof(op)], &filter->cgroup, sizeof(uint64_t));
+		off += sizeof(op) + sizeof(uint64_t);
+	}
+
+	nlink_assert(off == len);
+
+	return len;
+}
+
+void
+nlink_diag_setup_dump(struct nlmsghdr                *msg,
+                      struct nlink_sock              *sock,
+                      uint8_t                         family,
+                      uint8_t                         protocol,
+                      const struct nlink_diag_filter *filter)
+{
+	nlink_assert(msg);
+	nlink_assert_sock(sock);
+	nlink_assert((family == AF_INET) || (family == AF_INET6));
+	nlink_assert(filter);
+
+	struct inet_diag_req_v2 *req;
+	uint8_t                  code[NLINK_DIAG_BYTECODE_SIZE];
+	unsigned int             len;
+
+	mnl_nlmsg_put_header(msg);
+	msg->nlmsg_type = SOCK_DIAG_BY_FAMILY;
+	msg->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	msg->nlmsg_seq = nlink_alloc_seqno(sock);
+	msg->nlmsg_pid = sock->port_id;
+
+	req = mnl_nlmsg_put_extra_header(msg, sizeof(*req));
+	req->sdiag_family = family;
+	req->sdiag_protocol = protocol;
+	/* No extension requested: records carry no attribute to skip. */
+	req->idiag_ext = 0;
+	req->idiag_states = filter->states ? filter->states :
+	                                     NLINK_DIAG_ALL_STATES;
+
+	len = nlink_diag_compile(filter, code);
+	if (len)
+		mnl_attr_put(msg, INET_DIAG_REQ_BYTECODE, len, code);
+}
+
+/******************************************************************************
+ * Socket record parsing
+ ******************************************************************************/
+
+static inline int
+nlink_diag_check_msg(const struct nlmsghdr *msg)
+{
+	if (msg->nlmsg_type != SOCK_DIAG_BY_FAMILY)
+		return -ENOMSG;
+
+	if (mnl_nlmsg_get_payload_len(msg) < sizeof(struct inet_diag_msg))
+		return -EBADMSG;
+
+	return 0;
+}
+
+struct nlink_diag_parse_ctx {
+	nlink_diag_parse_fn *parse;
+	void                *data;
+};
+
+static int
+nlink_diag_parse_one(int status, const struct nlmsghdr *msg, void *data)
+{
+	const struct nlink_diag_parse_ctx *ctx = data;
+	int                                err;
+
+	if (status)
+		return status;
+
+	err = nlink_diag_check_msg(msg);
+	if (err)
+		return err;
+
+	return ctx->parse(mnl_nlmsg_get_payload(msg), msg, ctx->data);
+}
+
+int
+nlink_diag_parse_msg(const struct nlmsghdr *msg,
+                     size_t                 size,
+                     nlink_diag_parse_fn   *parse,
+                     void                  *data)
+{
+	nlink_assert(parse);
+
+	struct nlink_diag_parse_ctx ctx = {
+		.parse = parse,
+		.data  = data
+	};
+
+	return nlink_parse_msg(msg, size, nlink_diag_parse_one, &ctx);
+}
+
+int
+nlink_diag_parse_batch(const struct nlmsghdr      **msg,
+                       int                         *bytes,
+                       const struct inet_diag_msg **socks,
+                       unsigned int                *nr)
+{
+	nlink_assert(msg);
+	nlink_assert(*msg);
+	nlink_assert(bytes);
+	nlink_assert(socks);
+	nlink_assert(nr);
+	nlink_assert(*nr);
+
+	const struct nlmsghdr *curr = *msg;
+	int                    left = *bytes;
+	unsigned int           cnt = 0;
+	bool                   multi = false;
+	int                    ret = 0;
+
+	while (mnl_nlmsg_ok(curr, left) && (cnt < *nr)) {
+		int                    rest = left;
+		const struct nlmsghdr *next = mnl_nlmsg_next(curr, &rest);
+
+		multi = !!(curr->nlmsg_flags & NLM_F_MULTI);
+
+		if ((curr->nlmsg_type == SOCK_DIAG_BY_FAMILY) &&
+		    !(curr->nlmsg_flags & NLM_F_DUMP_INTR)) {
+			/* Fast path: socket record. */
+			ret = nlink_diag_check_msg(curr);
+			if (ret)
+				break;
+
+			socks[cnt++] = mnl_nlmsg_get_payload(curr);
+		}
+		else {
+			ret = nlink_parse_msg_head(curr);
+			if (ret != -ENOENT) {
+				if (!ret)
+					ret = -ENOMSG;
+				break;
+			}
+
+			ret = 0;
+		}
+
+		curr = next;
+		left = rest;
+	}
+
+	*msg = curr;
+	*bytes = left;
+	*nr = cnt;
+
+	/* See nlink_parse_msg(). */
+	if (!ret && !mnl_nlmsg_ok(curr, left) && multi)
+		return -EINPROGRESS;
+
+	return ret;
+}
+
+/******************************************************************************
+ * Socket dumping
+ ******************************************************************************/
+
+int
+nlink_diag_dump(struct nlink_sock              *sock,
+                struct nlmsghdr                *msg,
+                uint8_t                         family,
+                uint8_t                         protocol,
+                const struct nlink_diag_filter *filter,
+                nlink_diag_parse_fn            *parse,
+                void                           *data)
+{
+	nlink_assert_sock(sock);
+	nlink_assert(msg);
+	nlink_assert(filter);
+	nlink_assert(parse);
+
+	int err;
+
+	nlink_diag_setup_dump(msg, sock, family, protocol, filter);
+
+	err = (int)nlink_send_msg(sock, msg);
+	if (err)
+		return err;
+
+	do {
+		ssize_t ret;
+
+		ret = nlink_recv_msg(sock, msg);
+		if (ret < 0)
+			return (int)ret;
+
+		err = nlink_diag_parse_msg(msg, (size_t)ret, parse, data);
+	} while (err == -EINPROGRESS);
+
+	return (err == -ENODATA) ? 0 : err;
+}
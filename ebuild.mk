@@ -5,20 +5,78 @@ solibs              := libnlink.so
 libnlink.so-objs     = nlink.o parse.o
 libnlink.so-objs    += $(call kconf_enabled,NLINK_WORK,work.o)
 libnlink.so-objs    += $(call kconf_enabled,NLINK_IFACE,iface.o)
-libnlink.so-cflags   = $(EXTRA_CFLAGS) -Wall -Wextra -D_GNU_SOURCE -DPIC -fpic
-libnlink.so-ldflags  = $(EXTRA_LDFLAGS) -shared -fpic -Wl,-soname,libnlink.so
+libnlink.so-objs    += $(call kconf_enabled,NLINK_TOPO,topo.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_IFTAB,iftab.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_TRACE,trace.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_SNAP,snap.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_STORE,store.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_SHM,shm.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_RCU,rcu.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_FILTER,filter.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_PCAP,pcap.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_DIAG,diag.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_PROC,proc.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_UEVENT,uevent.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_FDB,fdb.o)
+libnlink.so-objs    += $(call kconf_enabled,NLINK_TC,tc.o)
+libnlink.so-cflags   = $(EXTRA_CFLAGS) -Wall -Wextra -D_GNU_SOURCE -DPIC -fpic \
+                       $(call kconf_enabled,NLINK_SNAP,-pthread) \
+                       $(call kconf_enabled,NLINK_RCU,-pthread)
+libnlink.so-ldflags  = $(EXTRA_LDFLAGS) -shared -fpic -Wl,-soname,libnlink.so \
+                       $(call kconf_enabled,NLINK_SNAP,-pthread) \
+                       $(call kconf_enabled,NLINK_SHM,-lrt) \
+                       $(call kconf_enabled,NLINK_RCU,-pthread)
 libnlink.so-pkgconf  = libmnl \
                        $(call kconf_enabled,NLINK_ASSERT,libutils) \
-                       $(call kconf_enabled,NLINK_WORK,libutils)
+                       $(call kconf_enabled,NLINK_WORK,libutils) \
+                       $(call kconf_enabled,NLINK_TOPO,libutils) \
+                       $(call kconf_enabled,NLINK_SNAP,libutils)
+
+bins                 = $(call kconf_enabled,NLINK_TRACE,nlink-trace)
+bins                += $(call kconf_enabled,NLINK_STRESS,nlink-stress)
+bins                += $(call kconf_enabled,NLINK_REPLAY,nlink-replay)
+
+nlink-trace-objs     = trace-decode.o
+nlink-trace-cflags   = $(EXTRA_CFLAGS) -Wall -Wextra -D_GNU_SOURCE
+nlink-trace-ldflags  = $(EXTRA_LDFLAGS) -L$(BUILDDIR) -lnlink
+nlink-trace-pkgconf  = libmnl
+
+nlink-stress-objs    = stress.o
+nlink-stress-cflags  = $(EXTRA_CFLAGS) -Wall -Wextra -D_GNU_SOURCE -pthread
+nlink-stress-ldflags = $(EXTRA_LDFLAGS) -pthread -L$(BUILDDIR) -lnlink
+nlink-stress-pkgconf = libmnl \
+                       $(call kconf_enabled,NLINK_ASSERT,libutils)
+
+nlink-replay-objs    = replay.o
+nlink-replay-cflags  = $(EXTRA_CFLAGS) -Wall -Wextra -D_GNU_SOURCE
+nlink-replay-ldflags = $(EXTRA_LDFLAGS) -L$(BUILDDIR) -lnlink
+nlink-replay-pkgconf = libmnl libutils
 
 HEADERDIR           := $(CURDIR)/include
 headers              = nlink/nlink.h
 headers             += $(call kconf_enabled,NLINK_WORK,nlink/work.h)
 headers             += $(call kconf_enabled,NLINK_IFACE,nlink/iface.h)
+headers             += $(call kconf_enabled,NLINK_TOPO,nlink/topo.h)
+headers             += $(call kconf_enabled,NLINK_IFTAB,nlink/iftab.h)
+headers             += $(call kconf_enabled,NLINK_TRACE,nlink/trace.h)
+headers             += $(call kconf_enabled,NLINK_SNAP,nlink/snap.h)
+headers             += $(call kconf_enabled,NLINK_STORE,nlink/store.h)
+headers             += $(call kconf_enabled,NLINK_SHM,nlink/shm.h)
+headers             += $(call kconf_enabled,NLINK_RCU,nlink/rcu.h)
+headers             += $(call kconf_enabled,NLINK_FILTER,nlink/filter.h)
+headers             += $(call kconf_enabled,NLINK_PCAP,nlink/pcap.h)
+headers             += $(call kconf_enabled,NLINK_DIAG,nlink/diag.h)
+headers             += $(call kconf_enabled,NLINK_PROC,nlink/proc.h)
+headers             += $(call kconf_enabled,NLINK_UEVENT,nlink/uevent.h)
+headers             += $(call kconf_enabled,NLINK_FDB,nlink/fdb.h)
+headers             += $(call kconf_enabled,NLINK_TC,nlink/tc.h)
+headers             += $(call kconf_enabled,NLINK_CORO,nlink/coro.hpp)
 
 libnlink_pkgconf_requires = libmnl \
                             $(call kconf_enabled,NLINK_ASSERT,libutils) \
-                            $(call kconf_enabled,NLINK_WORK,libutils)
+                            $(call kconf_enabled,NLINK_WORK,libutils) \
+                            $(call kconf_enabled,NLINK_TOPO,libutils) \
+                            $(call kconf_enabled,NLINK_SNAP,libutils)
 
 define libnlink_pkgconf_tmpl
 prefix=$(PREFIX)
@@ -0,0 +1,376 @@
+#include <nlink/fdb.h>
+#include "parse.h"
+#include <string.h>
+#include <errno.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+#include <linux/if_link.h>
+#include <sys/socket.h>
+
+/******************************************************************************
+ * Forwarding database message handling
+ ******************************************************************************/
+
+int
+nlink_fdb_parse_msg(const struct nlmsghdr *msg, struct nlink_fdb_msg *fdb)
+{
+	nlink_assert(msg);
+	nlink_assert((msg->nlmsg_type == RTM_NEWNEIGH) ||
+	             (msg->nlmsg_type == RTM_DELNEIGH));
+	nlink_assert(fdb);
+
+	const struct ndmsg  *ndm;
+	const struct nlattr *attr;
+
+	if (mnl_nlmsg_get_payload_len(msg) < sizeof(*ndm))
+		return -EBADMSG;
+
+	ndm = mnl_nlmsg_get_payload(msg);
+	if (ndm->ndm_family != AF_BRIDGE)
+		/* Neighbour cache entry of some other address family. */
+		return -ENOENT;
+
+	fdb->addr = NULL;
+	fdb->vlan = 0;
+	fdb->port = ndm->ndm_ifindex;
+	fdb->master = 0;
+	fdb->state = ndm->ndm_state;
+	fdb->flags = ndm->ndm_flags;
+
+	mnl_attr_for_each(attr, msg, sizeof(*ndm)) {
+		int err;
+
+		switch (mnl_attr_get_type(attr)) {
+		case NDA_LLADDR:
+			/* Zero-copy: address points into the message. */
+			fdb->addr = nlink_parse_hwaddr_attr(attr);
+			if (!fdb->addr)
+				return -errno;
+			break;
+
+		case NDA_VLAN:
+			err = nlink_parse_uint16_attr(attr, &fdb->vlan);
+			if (err)
+				return err;
+			break;
+
+		case NDA_MASTER:
+			{
+				uint32_t master;
+
+				err = nlink_parse_uint32_attr(attr, &master);
+				if (err)
+					return err;
+				if (!master || (master > INT32_MAX))
+					return -ERANGE;
+
+				fdb->master = (int)master;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (!fdb->addr)
+		return -EBADMSG;
+
+	if (fdb->port <= 0)
+		return -ENODEV;
+
+	return 0;
+}
+
+/*
+ * Setup a bridge forwarding database dump request restricted to entries of
+ * the bridge identified by master.
+ *
+ * Unless NETLINK_GET_STRICT_CHK is enabled, kernel parses dump request
+ * headers as a struct ifinfomsg followed by an optional IFLA_MASTER attribute
+ * for filtering purposes, the same way iproute2's `bridge fdb show br` does.
+ */
+void
+nlink_fdb_setup_dump(struct nlmsghdr   *msg,
+                     struct nlink_sock *sock,
+                     int                master)
+{
+	nlink_assert(msg);
+	nlink_assert_sock(sock);
+	nlink_assert(master > 0);
+
+	struct ifinfomsg *info;
+
+	mnl_nlmsg_put_header(msg);
+	msg->nlmsg_type = RTM_GETNEIGH;
+	msg->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	msg->nlmsg_seq = nlink_alloc_seqno(sock);
+	msg->nlmsg_pid = sock->port_id;
+
+	info = mnl_nlmsg_put_extra_header(msg, sizeof(*info));
+	info->ifi_family = AF_BRIDGE;
+	info->ifi_type = 0;
+	info->ifi_index = 0;
+	info->ifi_flags = 0;
+	info->ifi_change = 0;
+
+	mnl_attr_put_u32(msg, IFLA_MASTER, (uint32_t)master);
+}
+
+/******************************************************************************
+ * MAC / VLAN indexed cache
+ ******************************************************************************/
+
+static unsigned int
+nlink_fdb_home(const struct nlink_fdb *fdb, uint64_t key)
+{
+	/* Fibonacci hashing, keeping the most mixed upper bits. */
+	return (unsigned int)((key * 11400714819323198485ULL) >> 32) &
+	       fdb->mask;
+}
+
+static unsigned int
+nlink_fdb_probe(const struct nlink_fdb *fdb, uint64_t key)
+{
+	nlink_fdb_assert(fdb);
+	nlink_assert(key & NLINK_FDB_USED_KEY);
+
+	unsigned int s;
+
+	for (s = nlink_fdb_home(fdb, key);
+	     fdb->slots[s].key && (fdb->slots[s].key != key);
+	     s = (s + 1) & fdb->mask)
+		;
+
+	return s;
+}
+
+const struct nlink_fdb_entry *
+nlink_fdb_find(const struct nlink_fdb  *fdb,
+               const struct ether_addr *addr,
+               uint16_t                 vlan)
+{
+	nlink_fdb_assert(fdb);
+	nlink_assert(addr);
+
+	unsigned int s = nlink_fdb_probe(fdb, nlink_fdb_make_key(addr, vlan));
+
+	if (!fdb->slots[s].key)
+		return NULL;
+
+	return &fdb->slots[s];
+}
+
+/*
+ * Return next occupied entry starting from *slot, or NULL when the whole
+ * table has been walked. *slot should be initialized to 0 before first call.
+ * Walk order is unspecified and is invalidated by table modifications.
+ */
+const struct nlink_fdb_entry *
+nlink_fdb_iter(const struct nlink_fdb *fdb, unsigned int *slot)
+{
+	nlink_fdb_assert(fdb);
+	nlink_assert(slot);
+
+	unsigned int s;
+
+	for (s = *slot; s <= fdb->mask; s++) {
+		if (fdb->slots[s].key) {
+			*slot = s + 1;
+			return &fdb->slots[s];
+		}
+	}
+
+	*slot = s;
+
+	return NULL;
+}
+
+int
+nlink_fdb_update(struct nlink_fdb *fdb, const struct nlink_fdb_msg *entry)
+{
+	nlink_fdb_assert(fdb);
+	nlink_assert(entry);
+	nlink_assert(entry->addr);
+	nlink_assert(entry->port > 0);
+
+	uint64_t                key = nlink_fdb_make_key(entry->addr,
+	                                                 entry->vlan);
+	struct nlink_fdb_entry *slot = &fdb->slots[nlink_fdb_probe(fdb, key)];
+
+	if (!slot->key) {
+		if (fdb->cnt == fdb->nr)
+			return -ENOSPC;
+
+		fdb->cnt++;
+		slot->key = key;
+	}
+
+	/* Learning refreshes and port moves are plain in-place updates. */
+	slot->port = entry->port;
+	slot->state = entry->state;
+	slot->flags = entry->flags;
+
+	return 0;
+}
+
+int
+nlink_fdb_remove(struct nlink_fdb        *fdb,
+                 const struct ether_addr *addr,
+                 uint16_t                 vlan)
+{
+	nlink_fdb_assert(fdb);
+	nlink_assert(addr);
+
+	unsigned int s = nlink_fdb_probe(fdb, nlink_fdb_make_key(addr, vlan));
+	unsigned int n;
+
+	if (!fdb->slots[s].key)
+		return -ENOENT;
+
+	/* Backward shift deletion, see nlink_iftab_unmap(). */
+	for (n = (s + 1) & fdb->mask;
+	     fdb->slots[n].key;
+	     n = (n + 1) & fdb->mask) {
+		unsigned int home = nlink_fdb_home(fdb, fdb->slots[n].key);
+
+		if (((n - home) & fdb->mask) >= ((n - s) & fdb->mask)) {
+			fdb->slots[s] = fdb->slots[n];
+			s = n;
+		}
+	}
+
+	fdb->slots[s].key = 0;
+	fdb->cnt--;
+
+	return 0;
+}
+
+/*
+ * Apply a forwarding database event or dump record to the cache.
+ *
+ * Returns -ENOENT when message does not relate to the cached bridge, i.e.
+ * neighbour entries of other address families, entries of other bridges and
+ * port own address lists (which carry no NDA_MASTER attribute), as well as
+ * when removing an entry missing from the cache.
+ */
+int
+nlink_fdb_process_msg(struct nlink_fdb *fdb, const struct nlmsghdr *msg)
+{
+	nlink_fdb_assert(fdb);
+	nlink_assert(msg);
+
+	struct nlink_fdb_msg entry;
+	int                  err;
+
+	if ((msg->nlmsg_type != RTM_NEWNEIGH) &&
+	    (msg->nlmsg_type != RTM_DELNEIGH))
+		return -ENOMSG;
+
+	err = nlink_fdb_parse_msg(msg, &entry);
+	if (err)
+		return err;
+
+	if (entry.master != fdb->master)
+		return -ENOENT;
+
+	if (msg->nlmsg_type == RTM_NEWNEIGH)
+		return nlink_fdb_update(fdb, &entry);
+
+	return nlink_fdb_remove(fdb, entry.addr, entry.vlan);
+}
+
+static int
+nlink_fdb_load_one(int status, const struct nlmsghdr *msg, void *data)
+{
+	int err;
+
+	if (status)
+		return status;
+
+	err = nlink_fdb_process_msg((struct nlink_fdb *)data, msg);
+
+	return (err == -ENOENT) ? 0 : err;
+}
+
+/*
+ * Fill the cache from scratch thanks to a filtered dump. msg should point to
+ * a NLINK_XFER_MSG_SIZE bytes long buffer.
+ *
+ * Kernel does not synchronize dumps with forwarding database modifications:
+ * to keep the cache consistent, caller should subscribe to RTNLGRP_NEIGH
+ * using another socket beforehand, then apply events queued in the meantime
+ * once load is complete.
+ */
+int
+nlink_fdb_load(struct nlink_fdb  *fdb,
+               struct nlink_sock *sock,
+               struct nlmsghdr   *msg)
+{
+	nlink_fdb_assert(fdb);
+	nlink_assert_sock(sock);
+	nlink_assert(msg);
+
+	int err;
+
+	nlink_fdb_clear(fdb);
+	nlink_fdb_setup_dump(msg, sock, fdb->master);
+
+	err = (int)nlink_send_msg(sock, msg);
+	if (err)
+		return err;
+
+	do {
+		ssize_t ret;
+
+		ret = nlink_recv_msg(sock, msg);
+		if (ret < 0)
+			return (int)ret;
+
+		err = nlink_parse_msg(msg, (size_t)ret, nlink_fdb_load_one, fdb);
+	} while (err == -EINPROGRESS);
+
+	return (err == -ENODATA) ? 0 : err;
+}
+
+void
+nlink_fdb_clear(struct nlink_fdb *fdb)
+{
+	nlink_fdb_assert(fdb);
+
+	memset(fdb->slots, 0, (fdb->mask + 1) * sizeof(fdb->slots[0]));
+	fdb->cnt = 0;
+}
+
+int
+nlink_fdb_init(struct nlink_fdb *fdb, int master, unsigned int nr)
+{
+	nlink_assert(fdb);
+	nlink_assert(master > 0);
+	nlink_assert(nr);
+
+	unsigned int slots_nr = 1;
+
+	/* Keep load factor below 1/2. */
+	while (slots_nr < (2 * nr))
+		slots_nr <<= 1;
+
+	fdb->slots = calloc(slots_nr, sizeof(fdb->slots[0]));
+	if (!fdb->slots)
+		return -errno;
+
+	fdb->cnt = 0;
+	fdb->nr = nr;
+	fdb->master = master;
+	fdb->mask = slots_nr - 1;
+
+	return 0;
+}
+
+void
+nlink_fdb_fini(const struct nlink_fdb *fdb)
+{
+	nlink_fdb_assert(fdb);
+
+	free(fdb->slots);
+}
@@ -0,0 +1,437 @@
+#include <nlink/filter.h>
+#include <utils/cdefs.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/rtnetlink.h>
+
+#define NLINK_FILTER_ACCEPT (0xffffffffU)
+#define NLINK_FILTER_DROP   (0U)
+
+#define NLINK_FILTER_TYPE_OFF  offsetof(struct nlmsghdr, nlmsg_type)
+#define NLINK_FILTER_FLAGS_OFF offsetof(struct nlmsghdr, nlmsg_flags)
+#define NLINK_FILTER_PID_OFF   offsetof(struct nlmsghdr, nlmsg_pid)
+#define NLINK_FILTER_IFTYPE_OFF \
+	(NLMSG_HDRLEN + offsetof(struct ifinfomsg, ifi_type))
+#define NLINK_FILTER_IFINDEX_OFF \
+	(NLMSG_HDRLEN + offsetof(struct ifinfomsg, ifi_index))
+#define NLINK_FILTER_ATTR_OFF \
+	(NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(struct ifinfomsg)))
+
+struct nlink_filter_prog {
+	struct sock_filter *insns;
+	unsigned int        cnt;
+	unsigned int        next;
+	unsigned int        nexts[BPF_MAXINSNS];
+};
+
+/*
+ * Note that classic BPF loads convert half-words and words from network to
+ * host byte order while netlink fields are in host byte order: constants
+ * compared against loaded fields are converted the same way. Only equality
+ * tests are performed since ordering is not preserved by the conversion.
+ */
+
+static void
+nlink_filter_emit(struct nlink_filter_prog *prog,
+                  uint16_t                  code,
+                  uint8_t                   jt,
+                  uint8_t                   jf,
+                  uint32_t                  k)
+{
+	if (prog->cnt < BPF_MAXINSNS)
+		prog->insns[prog->cnt] =
+			(struct sock_filter)BPF_JUMP(code, k, jt, jf);
+
+	prog->cnt++;
+}
+
+/* Emit a jump to the end of current section. */
+static void
+nlink_filter_emit_next(struct nlink_filter_prog *prog)
+{
+	if (prog->cnt < BPF_MAXINSNS)
+		prog->nexts[prog->next++] = prog->cnt;
+
+	nlink_filter_emit(prog, BPF_JMP | BPF_JA, 0, 0, 0);
+}
+
+/* Resolve jumps to the end of current section. */
+static void
+nlink_filter_end_section(struct nlink_filter_prog *prog)
+{
+	unsigned int n;
+
+	for (n = 0; n < prog->next; n++) {
+		unsigned int pc = prog->nexts[n];
+
+		prog->insns[pc].k = prog->cnt - (pc + 1);
+	}
+
+	prog->next = 0;
+}
+
+/*
+ * Emit a section passing control to the next section when value loaded with
+ * given instruction matches one of the given constants, dropping message
+ * otherwise.
+ */
+static void
+nlink_filter_emit_set(struct nlink_filter_prog *prog,
+                      uint16_t                  load,
+                      uint32_t                  off,
+                      const uint32_t           *vals,
+                      unsigned int              nr)
+{
+	unsigned int v;
+
+	nlink_filter_emit(prog, load, 0, 0, off);
+
+	for (v = 0; v < nr; v++) {
+		nlink_filter_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, vals[v]);
+		nlink_filter_emit_next(prog);
+	}
+
+	nlink_filter_emit(prog, BPF_RET | BPF_K, 0, 0, NLINK_FILTER_DROP);
+
+	nlink_filter_end_section(prog);
+}
+
+static int
+nlink_filter_emit_types(struct nlink_filter_prog *prog,
+                        const uint16_t           *types,
+                        unsigned int              nr)
+{
+	uint32_t     *vals;
+	unsigned int  t;
+
+	vals = malloc(nr * sizeof(vals[0]));
+	if (!vals)
+		return -errno;
+
+	for (t = 0; t < nr; t++)
+		vals[t] = ntohs(types[t]);
+
+	nlink_filter_emit_set(prog,
+	                      BPF_LD | BPF_H | BPF_ABS,
+	                      NLINK_FILTER_TYPE_OFF,
+	                      vals,
+	                      nr);
+
+	free(vals);
+
+	return 0;
+}
+
+static int
+nlink_filter_emit_iface_types(struct nlink_filter_prog *prog,
+                              const unsigned short     *types,
+                              unsigned int              nr)
+{
+	uint32_t     *vals;
+	unsigned int  t;
+
+	vals = malloc(nr * sizeof(vals[0]));
+	if (!vals)
+		return -errno;
+
+	for (t = 0; t < nr; t++)
+		vals[t] = ntohs(types[t]);
+
+	nlink_filter_emit_set(prog,
+	                      BPF_LD | BPF_H | BPF_ABS,
+	                      NLINK_FILTER_IFTYPE_OFF,
+	                      vals,
+	                      nr);
+
+	free(vals);
+
+	return 0;
+}
+
+static int
+nlink_filter_emit_indices(struct nlink_filter_prog *prog,
+                          const int                *indices,
+                          unsigned int              nr)
+{
+	uint32_t     *vals;
+	unsigned int  i;
+
+	vals = malloc(nr * sizeof(vals[0]));
+	if (!vals)
+		return -errno;
+
+	for (i = 0; i < nr; i++)
+		vals[i] = ntohl((uint32_t)indices[i]);
+
+	nlink_filter_emit_set(prog,
+	                      BPF_LD | BPF_W | BPF_ABS,
+	                      NLINK_FILTER_IFINDEX_OFF,
+	                      vals,
+	                      nr);
+
+	free(vals);
+
+	return 0;
+}
+
+static void
+nlink_filter_emit_master(struct nlink_filter_prog *prog, int master)
+{
+	/* Locate IFLA_MASTER attribute thanks to the nlattr ancillary load. */
+	nlink_filter_emit(prog, BPF_LD | BPF_IMM, 0, 0, NLINK_FILTER_ATTR_OFF);
+	nlink_filter_emit(prog, BPF_LDX | BPF_IMM, 0, 0, IFLA_MASTER);
+	nlink_filter_emit(prog,
+	                  BPF_LD | BPF_W | BPF_ABS,
+	                  0,
+	                  0,
+	                  (uint32_t)(SKF_AD_OFF + SKF_AD_NLATTR));
+	nlink_filter_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0);
+	nlink_filter_emit(prog, BPF_RET | BPF_K, 0, 0, NLINK_FILTER_DROP);
+
+	/* Load attribute payload. */
+	nlink_filter_emit(prog, BPF_MISC | BPF_TAX, 0, 0, 0);
+	nlink_filter_emit(prog,
+	                  BPF_LD | BPF_W | BPF_IND,
+	                  0,
+	                  0,
+	                  NLA_HDRLEN);
+	nlink_filter_emit(prog,
+	                  BPF_JMP | BPF_JEQ | BPF_K,
+	                  1,
+	                  0,
+	                  ntohl((uint32_t)master));
+	nlink_filter_emit(prog, BPF_RET | BPF_K, 0, 0, NLINK_FILTER_DROP);
+}
+
+/*
+ * Compile filter specification into a classic BPF program.
+ *
+ * prog->filter is allocated and should be released using free(3) once no more
+ * needed.
+ *
+ * Returns -E2BIG when the resulting program exceeds BPF_MAXINSNS instructions.
+ */
+int
+nlink_filter_compile(const struct nlink_filter *filter,
+                     const struct nlink_sock   *sock,
+                     struct sock_fprog         *prog)
+{
+	nlink_assert(filter);
+	nlink_assert(!filter->types_nr || filter->types);
+	nlink_assert(!filter->iface_types_nr || filter->iface_types);
+	nlink_assert(!filter->indices_nr || filter->indices);
+	nlink_assert(filter->master >= 0);
+	nlink_assert_sock(sock);
+	nlink_assert(prog);
+
+	static const uint16_t     ctrls[] = {
+		NLMSG_NOOP, NLMSG_ERROR, NLMSG_DONE, NLMSG_OVERRUN
+	};
+	static const uint16_t     links[] = {
+		RTM_NEWLINK, RTM_DELLINK, RTM_GETLINK, RTM_SETLINK
+	};
+	struct nlink_filter_prog *comp;
+	unsigned int              t;
+	int                       err;
+
+	comp = malloc(sizeof(*comp));
+	if (!comp)
+		return -errno;
+
+	comp->insns = malloc(BPF_MAXINSNS * sizeof(comp->insns[0]));
+	if (!comp->insns) {
+		err = -errno;
+		goto free;
+	}
+
+	comp->cnt = 0;
+	comp->next = 0;
+
+	/* Always accept control messages. */
+	nlink_filter_emit(comp,
+	                  BPF_LD | BPF_H | BPF_ABS,
+	                  0,
+	                  0,
+	                  NLINK_FILTER_TYPE_OFF);
+	for (t = 0; t < array_nr(ctrls); t++) {
+		nlink_filter_emit(comp,
+		                  BPF_JMP | BPF_JEQ | BPF_K,
+		                  0,
+		                  1,
+		                  ntohs(ctrls[t]));
+		nlink_filter_emit(comp, BPF_RET | BPF_K, 0, 0, NLINK_FILTER_ACCEPT);
+	}
+
+	/* Always accept multipart (dump) replies. */
+	nlink_filter_emit(comp,
+	                  BPF_LD | BPF_H | BPF_ABS,
+	                  0,
+	                  0,
+	                  NLINK_FILTER_FLAGS_OFF);
+	nlink_filter_emit(comp,
+	                  BPF_JMP | BPF_JSET | BPF_K,
+	                  0,
+	                  1,
+	                  ntohs(NLM_F_MULTI));
+	nlink_filter_emit(comp, BPF_RET | BPF_K, 0, 0, NLINK_FILTER_ACCEPT);
+
+	/* Always accept messages addressed to our own port. */
+	nlink_filter_emit(comp,
+	                  BPF_LD | BPF_W | BPF_ABS,
+	                  0,
+	                  0,
+	                  NLINK_FILTER_PID_OFF);
+	nlink_filter_emit(comp,
+	                  BPF_JMP | BPF_JEQ | BPF_K,
+	                  0,
+	                  1,
+	                  ntohl(sock->port_id));
+	nlink_filter_emit(comp, BPF_RET | BPF_K, 0, 0, NLINK_FILTER_ACCEPT);
+
+	if (filter->types_nr) {
+		err = nlink_filter_emit_types(comp,
+		                              filter->types,
+		                              filter->types_nr);
+		if (err)
+			goto free_insns;
+	}
+
+	if (filter->iface_types_nr || filter->indices_nr || filter->master) {
+		/* Accept non link messages unconditionally. */
+		nlink_filter_emit(comp,
+		                  BPF_LD | BPF_H | BPF_ABS,
+		                  0,
+		                  0,
+		                  NLINK_FILTER_TYPE_OFF);
+		for (t = 0; t < array_nr(links); t++) {
+			nlink_filter_emit(comp,
+			                  BPF_JMP | BPF_JEQ | BPF_K,
+			                  0,
+			                  1,
+			                  ntohs(links[t]));
+			nlink_filter_emit_next(comp);
+		}
+		nlink_filter_emit(comp,
+		                  BPF_RET | BPF_K,
+		                  0,
+		                  0,
+		                  NLINK_FILTER_ACCEPT);
+		nlink_filter_end_section(comp);
+	}
+
+	if (filter->iface_types_nr) {
+		err = nlink_filter_emit_iface_types(comp,
+		                                    filter->iface_types,
+		                                    filter->iface_types_nr);
+		if (err)
+			goto free_insns;
+	}
+
+	if (filter->indices_nr) {
+		err = nlink_filter_emit_indices(comp,
+		                                filter->indices,
+		                                filter->indices_nr);
+		if (err)
+			goto free_insns;
+	}
+
+	if (filter->master)
+		nlink_filter_emit_master(comp, filter->master);
+
+	nlink_filter_emit(comp, BPF_RET | BPF_K, 0, 0, NLINK_FILTER_ACCEPT);
+
+	if (comp->cnt > BPF_MAXINSNS) {
+		err = -E2BIG;
+		goto free_insns;
+	}
+
+	prog->len = (unsigned short)comp->cnt;
+	prog->filter = comp->insns;
+
+	free(comp);
+
+	return 0;
+
+free_insns:
+	free(comp->insns);
+free:
+	free(comp);
+
+	return err;
+}
+
+/* Attach a compiled classic BPF program to socket. */
+int
+nlink_attach_prog(const struct nlink_sock *sock, const struct sock_fprog *prog)
+{
+	nlink_assert_sock(sock);
+	nlink_assert(prog);
+	nlink_assert(prog->filter);
+	nlink_assert(prog->len);
+
+	if (setsockopt(nlink_sock_fd(sock),
+	               SOL_SOCKET,
+	               SO_ATTACH_FILTER,
+	               prog,
+	               sizeof(*prog))) {
+		nlink_assert(errno != EBADF);
+		nlink_assert(errno != EFAULT);
+		nlink_assert(errno != ENOTSOCK);
+
+		/*
+		 * Possible return code:
+		 * - ENOMEM: kernel failed to allocate program memory
+		 * - EINVAL: program rejected by kernel verifier
+		 */
+		return -errno;
+	}
+
+	return 0;
+}
+
+int
+nlink_attach_filter(const struct nlink_sock   *sock,
+                    const struct nlink_filter *filter)
+{
+	nlink_assert_sock(sock);
+	nlink_assert(filter);
+
+	struct sock_fprog prog;
+	int               err;
+
+	err = nlink_filter_compile(filter, sock, &prog);
+	if (err)
+		return err;
+
+	err = nlink_attach_prog(sock, &prog);
+
+	free(prog.filter);
+
+	return err;
+}
+
+int
+nlink_detach_filter(const struct nlink_sock *sock)
+{
+	nlink_assert_sock(sock);
+
+	int dummy = 0;
+
+	if (setsockopt(nlink_sock_fd(sock),
+	               SOL_SOCKET,
+	               SO_DETACH_FILTER,
+	               &dummy,
+	               sizeof(dummy))) {
+		nlink_assert(errno != EBADF);
+		nlink_assert(errno != EFAULT);
+		nlink_assert(errno != ENOTSOCK);
+
+		/* ENOENT: no filter attached. */
+		return -errno;
+	}
+
+	return 0;
+}
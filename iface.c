@@ -9,6 +9,8 @@
 #include <linux/if_arp.h>
 #include <linux/rtnetlink.h>
 
+_Static_assert(NLINK_IFNAMSIZ == IFNAMSIZ, "unexpected interface name size");
+
 static int
 nlink_iface_parse_ucast_hwaddr(const struct nlattr *attr,
                                struct nlink_iface  *iface)
@@ -73,13 +75,30 @@ nlink_iface_parse_link(const struct nlattr *attr, struct nlink_iface *iface)
 	nlink_assert(attr);
 	nlink_assert(iface);
 
-	int err;
+	/*
+	 * Kernel reports a zero IFLA_LINK for interfaces not bound to any
+	 * lower device (yet), e.g. a veth whose peer is being created or
+	 * lives in another network namespace: zero means no link.
+	 */
+	return nlink_parse_uint32_attr(attr, &iface->link);
+}
+
+static int
+nlink_iface_parse_link_netns(const struct nlattr *attr,
+                             struct nlink_iface  *iface)
+{
+	nlink_assert(attr);
+	nlink_assert(iface);
+
+	uint32_t nsid;
+	int      err;
 
-	err = nlink_parse_uint32_attr(attr, &iface->link);
+	/* Lower device lives into the peer namespace identified by nsid. */
+	err = nlink_parse_uint32_attr(attr, &nsid);
 	if (err)
 		return err;
 
-	nlink_assert(iface->link > 0);
+	iface->link_netns = true;
 
 	return 0;
 }
@@ -160,16 +179,17 @@ typedef int (nlink_iface_parse_attr_fn)(const struct nlattr *attr,
                                         struct nlink_iface  *iface);
 
 static nlink_iface_parse_attr_fn * const nlink_iface_attr_parsers[] = {
-	[IFLA_ADDRESS]     = nlink_iface_parse_ucast_hwaddr,
-	[IFLA_BROADCAST]   = nlink_iface_parse_bcast_hwaddr,
-	[IFLA_IFNAME]      = nlink_iface_parse_name,
-	[IFLA_MTU]         = nlink_iface_parse_mtu,
-	[IFLA_LINK]        = nlink_iface_parse_link,
-	[IFLA_MASTER]      = nlink_iface_parse_master,
-	[IFLA_OPERSTATE]   = nlink_iface_parse_oper_state,
-	[IFLA_GROUP]       = nlink_iface_parse_group,
-	[IFLA_PROMISCUITY] = nlink_iface_parse_promisc,
-	[IFLA_CARRIER]     = nlink_iface_parse_carrier_state
+	[IFLA_ADDRESS]      = nlink_iface_parse_ucast_hwaddr,
+	[IFLA_BROADCAST]    = nlink_iface_parse_bcast_hwaddr,
+	[IFLA_IFNAME]       = nlink_iface_parse_name,
+	[IFLA_MTU]          = nlink_iface_parse_mtu,
+	[IFLA_LINK]         = nlink_iface_parse_link,
+	[IFLA_MASTER]       = nlink_iface_parse_master,
+	[IFLA_OPERSTATE]    = nlink_iface_parse_oper_state,
+	[IFLA_GROUP]        = nlink_iface_parse_group,
+	[IFLA_PROMISCUITY]  = nlink_iface_parse_promisc,
+	[IFLA_CARRIER]      = nlink_iface_parse_carrier_state,
+	[IFLA_LINK_NETNSID] = nlink_iface_parse_link_netns
 };
 
 static const struct nlink_iface nlink_iface_null = {
@@ -182,6 +202,7 @@ static const struct nlink_iface nlink_iface_null = {
 	.name_len      = 0,
 	.mtu           = 0,
 	.link          = 0,
+	.link_netns    = false,
 	.master        = 0,
 	.oper_state    = IF_OPER_UNKNOWN,
 	.group         = 0,
@@ -189,8 +210,8 @@ static const struct nlink_iface nlink_iface_null = {
 	.carrier_state = IF_OPER_UNKNOWN
 };
 
-int
-nlink_iface_parse_msg(const struct nlmsghdr *msg, struct nlink_iface *iface)
+static inline int
+nlink_iface_do_parse_msg(const struct nlmsghdr *msg, struct nlink_iface *iface)
 {
 	nlink_assert(msg);
 	nlink_assert(!(msg->nlmsg_flags & NLM_F_DUMP_INTR));
@@ -235,6 +256,246 @@ nlink_iface_parse_msg(const struct nlmsghdr *msg, struct nlink_iface *iface)
 	return 0;
 }
 
+int
+nlink_iface_parse_msg(const struct nlmsghdr *msg, struct nlink_iface *iface)
+{
+	return nlink_iface_do_parse_msg(msg, iface);
+}
+
+int
+nlink_iface_parse_batch(const struct nlmsghdr **msg,
+                        int                    *bytes,
+                        struct nlink_iface     *ifaces,
+                        unsigned int           *nr)
+{
+	nlink_assert(msg);
+	nlink_assert(*msg);
+	nlink_assert(bytes);
+	nlink_assert(ifaces);
+	nlink_assert(nr);
+	nlink_assert(*nr);
+
+	const struct nlmsghdr *curr = *msg;
+	int                    left = *bytes;
+	unsigned int           cnt = 0;
+	bool                   multi = false;
+	int                    ret = 0;
+
+	while (mnl_nlmsg_ok(curr, left) && (cnt < *nr)) {
+		int                    rest = left;
+		const struct nlmsghdr *next = mnl_nlmsg_next(curr, &rest);
+
+		/*
+		 * Fetch next message header while decoding current one.
+		 * Prefetching past the end of datagram is harmless.
+		 */
+		__builtin_prefetch(next);
+
+		multi = !!(curr->nlmsg_flags & NLM_F_MULTI);
+
+		if ((curr->nlmsg_type == RTM_NEWLINK) &&
+		    !(curr->nlmsg_flags & NLM_F_DUMP_INTR)) {
+			/* Fast path: link message carrying data. */
+			ret = nlink_iface_do_parse_msg(curr, &ifaces[cnt]);
+			if (ret)
+				break;
+
+			cnt++;
+		}
+		else {
+			ret = nlink_parse_msg_head(curr);
+			if (ret != -ENOENT) {
+				/*
+				 * Data message of another type: let the caller
+				 * handle it.
+				 */
+				if (!ret)
+					ret = -ENOMSG;
+				break;
+			}
+
+			/* Empty message, skip to next one. */
+			ret = 0;
+		}
+
+		curr = next;
+		left = rest;
+	}
+
+	*msg = curr;
+	*bytes = left;
+	*nr = cnt;
+
+	/* See nlink_parse_msg(). */
+	if (!ret && !mnl_nlmsg_ok(curr, left) && multi)
+		return -EINPROGRESS;
+
+	return ret;
+}
+
+void
+nlink_iface_pack_rec(struct nlink_iface_rec   *rec,
+                     const struct nlink_iface *iface)
+{
+	nlink_assert(rec);
+	nlink_assert(iface);
+	nlink_assert(iface->index > 0);
+	nlink_assert(iface->name);
+	nlink_assert(iface->name_len < sizeof(rec->name));
+
+	memset(rec, 0, sizeof(*rec));
+
+	rec->index = iface->index;
+	rec->type = iface->type;
+	rec->admin_state = iface->admin_state;
+	rec->oper_state = iface->oper_state;
+	rec->carrier_state = iface->carrier_state;
+	rec->mtu = iface->mtu;
+	rec->link = iface->link;
+	rec->master = iface->master;
+	rec->group = iface->group;
+	rec->promisc = iface->promisc;
+
+	if (iface->ucast_hwaddr) {
+		memcpy(rec->ucast_hwaddr,
+		       iface->ucast_hwaddr,
+		       sizeof(rec->ucast_hwaddr));
+		rec->flags |= NLINK_IFACE_REC_UCAST_FLAG;
+	}
+
+	if (iface->bcast_hwaddr) {
+		memcpy(rec->bcast_hwaddr,
+		       iface->bcast_hwaddr,
+		       sizeof(rec->bcast_hwaddr));
+		rec->flags |= NLINK_IFACE_REC_BCAST_FLAG;
+	}
+
+	memcpy(rec->name, iface->name, iface->name_len);
+	rec->name_len = (uint8_t)iface->name_len;
+}
+
+static unsigned int
+nlink_iface_merge_hwaddr(uint8_t                 *rec_hwaddr,
+                         uint8_t                 *rec_flags,
+                         unsigned int             flag,
+                         const struct ether_addr *hwaddr)
+{
+	if (hwaddr) {
+		if ((*rec_flags & flag) &&
+		    !memcmp(rec_hwaddr, hwaddr, ETH_ALEN))
+			return 0;
+
+		memcpy(rec_hwaddr, hwaddr, ETH_ALEN);
+		*rec_flags |= flag;
+
+		return 1;
+	}
+
+	if (!(*rec_flags & flag))
+		return 0;
+
+	memset(rec_hwaddr, 0, ETH_ALEN);
+	*rec_flags &= ~flag;
+
+	return 1;
+}
+
+#define nlink_iface_merge_field(_rec, _iface, _field, _change, _mask) \
+	do { \
+		if ((_rec)->_field != (_iface)->_field) { \
+			(_rec)->_field = (_iface)->_field; \
+			(_mask) |= (_change); \
+		} \
+	} while (0)
+
+unsigned int
+nlink_iface_merge_rec(struct nlink_iface_rec   *rec,
+                      const struct nlink_iface *iface)
+{
+	nlink_assert(rec);
+	nlink_assert(iface);
+	nlink_assert(iface->index > 0);
+	nlink_assert(!rec->index || (rec->index == iface->index));
+	nlink_assert(iface->name);
+	nlink_assert(iface->name_len < sizeof(rec->name));
+
+	unsigned int mask = 0;
+
+	rec->index = iface->index;
+
+	nlink_iface_merge_field(rec, iface, type, NLINK_IFACE_TYPE_CHANGE, mask);
+	nlink_iface_merge_field(rec,
+	                        iface,
+	                        admin_state,
+	                        NLINK_IFACE_ADMIN_CHANGE,
+	                        mask);
+	nlink_iface_merge_field(rec,
+	                        iface,
+	                        oper_state,
+	                        NLINK_IFACE_OPER_CHANGE,
+	                        mask);
+	nlink_iface_merge_field(rec,
+	                        iface,
+	                        carrier_state,
+	                        NLINK_IFACE_CARRIER_CHANGE,
+	                        mask);
+	nlink_iface_merge_field(rec, iface, mtu, NLINK_IFACE_MTU_CHANGE, mask);
+	nlink_iface_merge_field(rec, iface, link, NLINK_IFACE_LINK_CHANGE, mask);
+	nlink_iface_merge_field(rec,
+	                        iface,
+	                        master,
+	                        NLINK_IFACE_MASTER_CHANGE,
+	                        mask);
+	nlink_iface_merge_field(rec,
+	                        iface,
+	                        group,
+	                        NLINK_IFACE_GROUP_CHANGE,
+	                        mask);
+	nlink_iface_merge_field(rec,
+	                        iface,
+	                        promisc,
+	                        NLINK_IFACE_PROMISC_CHANGE,
+	                        mask);
+
+	if (nlink_iface_merge_hwaddr(rec->ucast_hwaddr,
+	                             &rec->flags,
+	                             NLINK_IFACE_REC_UCAST_FLAG,
+	                             iface->ucast_hwaddr))
+		mask |= NLINK_IFACE_UCAST_CHANGE;
+
+	if (nlink_iface_merge_hwaddr(rec->bcast_hwaddr,
+	                             &rec->flags,
+	                             NLINK_IFACE_REC_BCAST_FLAG,
+	                             iface->bcast_hwaddr))
+		mask |= NLINK_IFACE_BCAST_CHANGE;
+
+	if ((rec->name_len != iface->name_len) ||
+	    memcmp(rec->name, iface->name, iface->name_len)) {
+		/* Keep trailing bytes cleared so that records compare as blobs. */
+		memset(rec->name, 0, sizeof(rec->name));
+		memcpy(rec->name, iface->name, iface->name_len);
+		rec->name_len = (uint8_t)iface->name_len;
+		mask |= NLINK_IFACE_NAME_CHANGE;
+	}
+
+	return mask;
+}
+
+int
+nlink_iface_merge_msg(struct nlink_iface_rec *rec, const struct nlmsghdr *msg)
+{
+	nlink_assert(rec);
+
+	struct nlink_iface iface;
+	int                err;
+
+	err = nlink_iface_do_parse_msg(msg, &iface);
+	if (err)
+		return err;
+
+	return (int)nlink_iface_merge_rec(rec, &iface);
+}
+
 int
 nlink_iface_setup_msg_ucast_hwaddr(struct nlmsghdr         *msg,
                                    const struct ether_addr *hwaddr)
@@ -324,6 +585,20 @@ nlink_iface_setup_msg_mtu(struct nlmsghdr *msg, uint32_t mtu)
 	return 0;
 }
 
+void
+nlink_iface_patch_admin_req(struct nlink_iface_req *req,
+                            struct nlink_sock      *sock,
+                            uint8_t                 state)
+{
+	nlink_assert(req);
+	nlink_assert(req->hdr.nlmsg_len == sizeof(*req));
+	nlink_assert((state == IF_OPER_UP) || (state == IF_OPER_DOWN));
+
+	req->hdr.nlmsg_seq = nlink_alloc_seqno(sock);
+	req->info.ifi_flags = (state == IF_OPER_UP) ? IFF_UP : 0;
+	req->info.ifi_change = IFF_UP;
+}
+
 void
 nlink_iface_setup_new(struct nlmsghdr   *msg,
                       struct nlink_sock *sock,
@@ -371,3 +646,22 @@ nlink_iface_setup_dump(struct nlmsghdr   *msg,
 	info->ifi_flags = 0;
 	info->ifi_change = 0;
 }
+
+#if defined(CONFIG_NLINK_NSID)
+
+/*
+ * Setup a link dump request targeting the network namespace identified by
+ * nsid (see nlink_assign_nsid()).
+ */
+void
+nlink_iface_setup_nsid_dump(struct nlmsghdr   *msg,
+                            struct nlink_sock *sock,
+                            int                nsid)
+{
+	nlink_assert(nsid >= 0);
+
+	nlink_iface_setup_dump(msg, sock);
+	mnl_attr_put_u32(msg, IFLA_TARGET_NETNSID, (uint32_t)nsid);
+}
+
+#endif /* defined(CONFIG_NLINK_NSID) */
@@ -0,0 +1,485 @@
+#include <nlink/iftab.h>
+#include <string.h>
+#include <errno.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+
+#define NLINK_IFTAB_COLUMN_ALIGN (64U)
+
+/******************************************************************************
+ * Atom arena
+ ******************************************************************************/
+
+static uint32_t
+nlink_iftab_hash_atom(const char *data, uint8_t len)
+{
+	uint32_t     hash = 2166136261U;
+	unsigned int b;
+
+	/* FNV-1a. */
+	for (b = 0; b < len; b++) {
+		hash ^= (uint8_t)data[b];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static uint32_t
+nlink_iftab_intern(struct nlink_iftab *tab, const void *data, size_t len)
+{
+	nlink_iftab_assert(tab);
+	nlink_assert(len <= IFNAMSIZ);
+
+	uint32_t                 hash;
+	unsigned int             s;
+	uint32_t                 id;
+	struct nlink_iftab_atom *atom;
+
+	if (!data || !len)
+		return 0;
+
+	hash = nlink_iftab_hash_atom(data, len);
+
+	for (s = hash & tab->intern_mask;
+	     tab->intern[s];
+	     s = (s + 1) & tab->intern_mask) {
+		atom = &tab->atoms[tab->intern[s]];
+		if ((atom->hash == hash) &&
+		    (atom->len == len) &&
+		    !memcmp(atom->data, data, len)) {
+			atom->ref++;
+			return tab->intern[s];
+		}
+	}
+
+	/* Arena is sized so that it cannot run out of atoms. */
+	id = tab->atom_free;
+	nlink_assert(id);
+
+	atom = &tab->atoms[id];
+	tab->atom_free = atom->ref;
+
+	atom->ref = 1;
+	atom->hash = hash;
+	atom->len = (uint8_t)len;
+	memcpy(atom->data, data, len);
+	/* Ensure names are NUL terminated. */
+	memset(&atom->data[len], 0, sizeof(atom->data) - len);
+
+	tab->intern[s] = id;
+
+	return id;
+}
+
+static void
+nlink_iftab_release(struct nlink_iftab *tab, uint32_t id)
+{
+	nlink_iftab_assert(tab);
+
+	struct nlink_iftab_atom *atom;
+	unsigned int             s;
+	unsigned int             n;
+
+	if (!id)
+		return;
+
+	atom = &tab->atoms[id];
+	nlink_assert(atom->ref);
+	if (--atom->ref)
+		return;
+
+	s = atom->hash & tab->intern_mask;
+	while (tab->intern[s] != id)
+		s = (s + 1) & tab->intern_mask;
+
+	/*
+	 * Backward shift deletion: move following entries of the probe
+	 * sequence into the freed slot when this brings them closer to their
+	 * home slot.
+	 */
+	for (n = (s + 1) & tab->intern_mask;
+	     tab->intern[n];
+	     n = (n + 1) & tab->intern_mask) {
+		unsigned int home;
+
+		home = tab->atoms[tab->intern[n]].hash & tab->intern_mask;
+		if (((n - home) & tab->intern_mask) >=
+		    ((n - s) & tab->intern_mask)) {
+			tab->intern[s] = tab->intern[n];
+			s = n;
+		}
+	}
+
+	tab->intern[s] = 0;
+
+	atom->ref = tab->atom_free;
+	tab->atom_free = id;
+}
+
+static const char *
+nlink_iftab_atom_data(const struct nlink_iftab *tab, uint32_t id, size_t *len)
+{
+	nlink_iftab_assert(tab);
+
+	if (!id) {
+		if (len)
+			*len = 0;
+		return NULL;
+	}
+
+	if (len)
+		*len = tab->atoms[id].len;
+
+	return tab->atoms[id].data;
+}
+
+/******************************************************************************
+ * Interface index to row map
+ ******************************************************************************/
+
+static unsigned int
+nlink_iftab_home(const struct nlink_iftab *tab, int index)
+{
+	/* Fibonacci hashing. */
+	return ((uint32_t)index * 2654435769U) & tab->map_mask;
+}
+
+static unsigned int
+nlink_iftab_probe(const struct nlink_iftab *tab, int index)
+{
+	nlink_iftab_assert(tab);
+	nlink_assert(index > 0);
+
+	unsigned int s;
+
+	for (s = nlink_iftab_home(tab, index);
+	     tab->map[s].index && (tab->map[s].index != index);
+	     s = (s + 1) & tab->map_mask)
+		;
+
+	return s;
+}
+
+static void
+nlink_iftab_unmap(struct nlink_iftab *tab, unsigned int slot)
+{
+	nlink_iftab_assert(tab);
+	nlink_assert(tab->map[slot].index);
+
+	unsigned int n;
+
+	for (n = (slot + 1) & tab->map_mask;
+	     tab->map[n].index;
+	     n = (n + 1) & tab->map_mask) {
+		unsigned int home = nlink_iftab_home(tab, tab->map[n].index);
+
+		if (((n - home) & tab->map_mask) >=
+		    ((n - slot) & tab->map_mask)) {
+			tab->map[slot] = tab->map[n];
+			slot = n;
+		}
+	}
+
+	tab->map[slot].index = 0;
+}
+
+/******************************************************************************
+ * Table handling
+ ******************************************************************************/
+
+const char *
+nlink_iftab_name(const struct nlink_iftab *tab, unsigned int row, size_t *len)
+{
+	nlink_iftab_assert_row(tab, row);
+
+	return nlink_iftab_atom_data(tab, tab->name[row], len);
+}
+
+const struct ether_addr *
+nlink_iftab_ucast_hwaddr(const struct nlink_iftab *tab, unsigned int row)
+{
+	nlink_iftab_assert_row(tab, row);
+
+	return (const struct ether_addr *)
+	       nlink_iftab_atom_data(tab, tab->ucast_hwaddr[row], NULL);
+}
+
+const struct ether_addr *
+nlink_iftab_bcast_hwaddr(const struct nlink_iftab *tab, unsigned int row)
+{
+	nlink_iftab_assert_row(tab, row);
+
+	return (const struct ether_addr *)
+	       nlink_iftab_atom_data(tab, tab->bcast_hwaddr[row], NULL);
+}
+
+int
+nlink_iftab_find(const struct nlink_iftab *tab, int index)
+{
+	nlink_iftab_assert(tab);
+	nlink_assert(index > 0);
+
+	unsigned int s = nlink_iftab_probe(tab, index);
+
+	if (!tab->map[s].index)
+		return -ENOENT;
+
+	nlink_assert(tab->map[s].row < tab->cnt);
+
+	return (int)tab->map[s].row;
+}
+
+int
+nlink_iftab_update(struct nlink_iftab *tab, const struct nlink_iface *iface)
+{
+	nlink_iftab_assert(tab);
+	nlink_assert(iface);
+	nlink_assert(iface->index > 0);
+	nlink_assert(iface->name);
+
+	unsigned int s = nlink_iftab_probe(tab, iface->index);
+	unsigned int r;
+	uint32_t     name;
+	uint32_t     ucast;
+	uint32_t     bcast;
+
+	if (!tab->map[s].index) {
+		if (tab->cnt == tab->nr)
+			return -ENOSPC;
+
+		r = tab->cnt++;
+		tab->map[s].index = iface->index;
+		tab->map[s].row = r;
+
+		tab->index[r] = iface->index;
+		tab->name[r] = 0;
+		tab->ucast_hwaddr[r] = 0;
+		tab->bcast_hwaddr[r] = 0;
+	}
+	else
+		r = tab->map[s].row;
+
+	/* Intern new values before releasing old ones to keep shared atoms. */
+	name = nlink_iftab_intern(tab, iface->name, iface->name_len);
+	ucast = nlink_iftab_intern(tab,
+	                           iface->ucast_hwaddr,
+	                           iface->ucast_hwaddr ?
+	                           sizeof(*iface->ucast_hwaddr) : 0);
+	bcast = nlink_iftab_intern(tab,
+	                           iface->bcast_hwaddr,
+	                           iface->bcast_hwaddr ?
+	                           sizeof(*iface->bcast_hwaddr) : 0);
+	nlink_iftab_release(tab, tab->name[r]);
+	nlink_iftab_release(tab, tab->ucast_hwaddr[r]);
+	nlink_iftab_release(tab, tab->bcast_hwaddr[r]);
+
+	tab->admin_state[r] = iface->admin_state;
+	tab->oper_state[r] = iface->oper_state;
+	tab->carrier_state[r] = iface->carrier_state;
+	tab->mtu[r] = iface->mtu;
+	tab->master[r] = iface->master;
+	tab->group[r] = iface->group;
+	tab->type[r] = iface->type;
+	tab->link[r] = iface->link;
+	tab->promisc[r] = iface->promisc;
+	tab->name[r] = name;
+	tab->ucast_hwaddr[r] = ucast;
+	tab->bcast_hwaddr[r] = bcast;
+
+	return 0;
+}
+
+void
+nlink_iftab_remove(struct nlink_iftab *tab, int index)
+{
+	nlink_iftab_assert(tab);
+	nlink_assert(index > 0);
+
+	unsigned int s = nlink_iftab_probe(tab, index);
+	unsigned int r;
+	unsigned int last;
+
+	if (!tab->map[s].index)
+		return;
+
+	r = tab->map[s].row;
+	nlink_iftab_unmap(tab, s);
+
+	nlink_iftab_release(tab, tab->name[r]);
+	nlink_iftab_release(tab, tab->ucast_hwaddr[r]);
+	nlink_iftab_release(tab, tab->bcast_hwaddr[r]);
+
+	/* Move last row into the hole to keep columns packed. */
+	last = --tab->cnt;
+	if (r == last)
+		return;
+
+	tab->index[r] = tab->index[last];
+	tab->admin_state[r] = tab->admin_state[last];
+	tab->oper_state[r] = tab->oper_state[last];
+	tab->carrier_state[r] = tab->carrier_state[last];
+	tab->mtu[r] = tab->mtu[last];
+	tab->master[r] = tab->master[last];
+	tab->group[r] = tab->group[last];
+	tab->type[r] = tab->type[last];
+	tab->link[r] = tab->link[last];
+	tab->promisc[r] = tab->promisc[last];
+	tab->name[r] = tab->name[last];
+	tab->ucast_hwaddr[r] = tab->ucast_hwaddr[last];
+	tab->bcast_hwaddr[r] = tab->bcast_hwaddr[last];
+
+	tab->map[nlink_iftab_probe(tab, tab->index[r])].row = r;
+}
+
+unsigned int
+nlink_iftab_scan(const struct nlink_iftab        *tab,
+                 const struct nlink_iftab_filter *filter,
+                 unsigned int                    *start,
+                 unsigned int                    *rows,
+                 unsigned int                     nr)
+{
+	nlink_iftab_assert(tab);
+	nlink_assert(filter);
+	nlink_assert(start);
+	nlink_assert(*start <= tab->cnt);
+	nlink_assert(rows);
+	nlink_assert(nr);
+
+	unsigned int mask = filter->mask;
+	unsigned int r;
+	unsigned int n = 0;
+
+	for (r = *start; (r < tab->cnt) && (n < nr); r++) {
+		bool match = true;
+
+		if (mask & NLINK_IFTAB_OPER_STATE_FILTER)
+			match &= (tab->oper_state[r] == filter->oper_state);
+		if (mask & NLINK_IFTAB_ADMIN_STATE_FILTER)
+			match &= (tab->admin_state[r] == filter->admin_state);
+		if (mask & NLINK_IFTAB_CARRIER_STATE_FILTER)
+			match &= (tab->carrier_state[r] ==
+			          filter->carrier_state);
+		if (mask & NLINK_IFTAB_MASTER_FILTER)
+			match &= (tab->master[r] == filter->master);
+		if (mask & NLINK_IFTAB_GROUP_FILTER)
+			match &= (tab->group[r] == filter->group);
+
+		/* Store unconditionally and advance on match only. */
+		rows[n] = r;
+		n += match;
+	}
+
+	*start = r;
+
+	return n;
+}
+
+static size_t
+nlink_iftab_carve(size_t *off, size_t size)
+{
+	size_t col = *off;
+
+	*off = (col + size + NLINK_IFTAB_COLUMN_ALIGN - 1) &
+	       ~((size_t)NLINK_IFTAB_COLUMN_ALIGN - 1);
+
+	return col;
+}
+
+static unsigned int
+nlink_iftab_pow2(unsigned int nr)
+{
+	unsigned int p = 1;
+
+	while (p < nr)
+		p <<= 1;
+
+	return p;
+}
+
+int
+nlink_iftab_init(struct nlink_iftab *tab, unsigned int nr)
+{
+	nlink_assert(tab);
+	nlink_assert(nr);
+
+	/*
+	 * Each row may reference up to 3 distinct atoms (name, unicast and
+	 * broadcast addresses). Updates intern new atoms before releasing old
+	 * ones, hence the 3 additional spare atoms. Atom 0 is reserved to mean
+	 * "no value".
+	 */
+	unsigned int atom_nr = (3 * (nr + 1)) + 1;
+	unsigned int map_nr = nlink_iftab_pow2(2 * nr);
+	unsigned int intern_nr = nlink_iftab_pow2(2 * atom_nr);
+	size_t       off = 0;
+	size_t       index, admin, oper, carrier, mtu, master, group;
+	size_t       type, link, promisc, name, ucast, bcast;
+	size_t       map, atoms, intern;
+	char        *mem;
+	unsigned int a;
+
+	index = nlink_iftab_carve(&off, nr * sizeof(tab->index[0]));
+	admin = nlink_iftab_carve(&off, nr * sizeof(tab->admin_state[0]));
+	oper = nlink_iftab_carve(&off, nr * sizeof(tab->oper_state[0]));
+	carrier = nlink_iftab_carve(&off, nr * sizeof(tab->carrier_state[0]));
+	mtu = nlink_iftab_carve(&off, nr * sizeof(tab->mtu[0]));
+	master = nlink_iftab_carve(&off, nr * sizeof(tab->master[0]));
+	group = nlink_iftab_carve(&off, nr * sizeof(tab->group[0]));
+	type = nlink_iftab_carve(&off, nr * sizeof(tab->type[0]));
+	link = nlink_iftab_carve(&off, nr * sizeof(tab->link[0]));
+	promisc = nlink_iftab_carve(&off, nr * sizeof(tab->promisc[0]));
+	name = nlink_iftab_carve(&off, nr * sizeof(tab->name[0]));
+	ucast = nlink_iftab_carve(&off, nr * sizeof(tab->ucast_hwaddr[0]));
+	bcast = nlink_iftab_carve(&off, nr * sizeof(tab->bcast_hwaddr[0]));
+	map = nlink_iftab_carve(&off, map_nr * sizeof(tab->map[0]));
+	atoms = nlink_iftab_carve(&off, atom_nr * sizeof(tab->atoms[0]));
+	intern = nlink_iftab_carve(&off, intern_nr * sizeof(tab->intern[0]));
+
+	mem = aligned_alloc(NLINK_IFTAB_COLUMN_ALIGN, off);
+	if (!mem)
+		return -errno;
+
+	tab->index = (int32_t *)&mem[index];
+	tab->admin_state = (uint8_t *)&mem[admin];
+	tab->oper_state = (uint8_t *)&mem[oper];
+	tab->carrier_state = (uint8_t *)&mem[carrier];
+	tab->mtu = (uint32_t *)&mem[mtu];
+	tab->master = (uint32_t *)&mem[master];
+	tab->group = (uint32_t *)&mem[group];
+	tab->type = (uint16_t *)&mem[type];
+	tab->link = (uint32_t *)&mem[link];
+	tab->promisc = (uint32_t *)&mem[promisc];
+	tab->name = (uint32_t *)&mem[name];
+	tab->ucast_hwaddr = (uint32_t *)&mem[ucast];
+	tab->bcast_hwaddr = (uint32_t *)&mem[bcast];
+
+	tab->map_mask = map_nr - 1;
+	tab->map = (struct nlink_iftab_slot *)&mem[map];
+	memset(tab->map, 0, map_nr * sizeof(tab->map[0]));
+
+	/* Chain free atoms thanks to their reference counter field. */
+	tab->atoms = (struct nlink_iftab_atom *)&mem[atoms];
+	for (a = 1; a < (atom_nr - 1); a++)
+		tab->atoms[a].ref = a + 1;
+	tab->atoms[atom_nr - 1].ref = 0;
+	tab->atom_free = 1;
+
+	tab->intern_mask = intern_nr - 1;
+	tab->intern = (uint32_t *)&mem[intern];
+	memset(tab->intern, 0, intern_nr * sizeof(tab->intern[0]));
+
+	tab->cnt = 0;
+	tab->nr = nr;
+	tab->mem = mem;
+
+	return 0;
+}
+
+void
+nlink_iftab_fini(const struct nlink_iftab *tab)
+{
+	nlink_iftab_assert(tab);
+
+	free(tab->mem);
+}
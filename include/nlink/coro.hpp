@@ -0,0 +1,616 @@
+#ifndef _NLINK_CORO_HPP
+#define _NLINK_CORO_HPP
+
+/*
+ * C++20 coroutine front end over request windows.
+ *
+ * Link operations are exposed as awaitables suspending the calling coroutine
+ * till the kernel acknowledges the request, e.g.:
+ *
+ *     nlink::flow
+ *     reconfigure(nlink::session &sess, int index)
+ *     {
+ *             int err;
+ *
+ *             err = co_await nlink::set_admin_state(sess, index, IF_OPER_DOWN);
+ *             if (!err)
+ *                     err = co_await nlink::set_mtu(sess, index, 9000);
+ *             ...
+ *     }
+ *
+ * Awaitables embed both the request message and the nlink_work tracking it
+ * into the window. Since awaitables live into the awaiting coroutine frame for
+ * the whole suspension, requests cost no allocation. Many flows may run
+ * concurrently over a single session: requests are pipelined up to the window
+ * limit (see nlink_win_adapt()) and queued into a backlog beyond.
+ *
+ * Sessions are single threaded: coroutines are resumed from within
+ * nlink::session::poll() / nlink::session::run(). Awaitables must not be
+ * destroyed while suspended, i.e. coroutines awaiting requests should not be
+ * destroyed before resumption.
+ */
+
+extern "C" {
+#include <nlink/iface.h>
+#include <nlink/work.h>
+}
+#include <cerrno>
+#include <coroutine>
+#include <exception>
+#include <poll.h>
+
+namespace nlink {
+
+class session;
+
+/******************************************************************************
+ * Request awaitable base
+ ******************************************************************************/
+
+class request {
+public:
+	request(const request &) = delete;
+	request &operator=(const request &) = delete;
+
+	bool
+	await_ready() const noexcept
+	{
+		return false;
+	}
+
+	bool
+	await_suspend(std::coroutine_handle<> handle) noexcept;
+
+	/* Returns 0 on success or a negative errno. */
+	int
+	await_resume() const noexcept
+	{
+		return status;
+	}
+
+protected:
+	/* Data message (multipart reply part or get reply) handler. */
+	typedef void (data_fn)(request &req, const struct nlmsghdr *msg);
+
+	request(session               &sess,
+	        const struct nlmsghdr *msg,
+	        data_fn               *data = nullptr) noexcept:
+		sess(sess), msg(msg), data(data), status(0), intr(false)
+	{
+		link.work.state = NLINK_DANGLING_WORK_STATE;
+		dlist_init(&link.work.node);
+		link.req = this;
+	}
+
+	~request()
+	{
+		nlink_assert(link.work.state != NLINK_PENDING_WORK_STATE);
+	}
+
+private:
+	friend class session;
+
+	/* Window work, first member so that works convert back to links. */
+	struct work_link {
+		struct nlink_work  work;
+		request           *req;
+	};
+
+	static request &
+	from_work(struct nlink_work *work) noexcept
+	{
+		return *reinterpret_cast<work_link *>(work)->req;
+	}
+
+	work_link                link;
+	session                 &sess;
+	const struct nlmsghdr   *msg;
+	data_fn                 *data;
+	std::coroutine_handle<>  handle;
+	int                      status;
+	bool                     intr;
+};
+
+/******************************************************************************
+ * Session
+ ******************************************************************************/
+
+class session {
+public:
+	/* sock is owned by the caller and should outlive the session. */
+	session(struct nlink_sock &sock) noexcept:
+		sock(sock)
+	{
+		dlist_init(&backlog);
+	}
+
+	session(const session &) = delete;
+	session &operator=(const session &) = delete;
+
+	/*
+	 * Allow nr requests in flight at most. A non zero min enables
+	 * adaptive flow control, see nlink_win_adapt().
+	 */
+	int
+	init(unsigned int nr, unsigned int min = 0) noexcept
+	{
+		nlink_assert(nr);
+		nlink_assert(min <= nr);
+
+		int err;
+
+		err = nlink_win_init(&win, nr);
+		if (err)
+			return err;
+
+		if (min)
+			nlink_win_adapt(&win, min);
+
+		err = nlink_init_poll(&rx);
+		if (err) {
+			nlink_win_fini_embedded(&win);
+			return err;
+		}
+
+		return 0;
+	}
+
+	void
+	fini() noexcept
+	{
+		nlink_assert(idle());
+
+		nlink_fini_poll(&rx);
+		/* Works are embedded into awaitables, never registered. */
+		nlink_win_fini_embedded(&win);
+	}
+
+	const struct nlink_win &
+	window() const noexcept
+	{
+		return win;
+	}
+
+	struct nlink_sock &
+	socket() noexcept
+	{
+		return sock;
+	}
+
+	bool
+	idle() const noexcept
+	{
+		return !nlink_win_has_work(&win) && dlist_empty(&backlog);
+	}
+
+	/*
+	 * Process pending replies without blocking, resuming coroutines whose
+	 * requests completed, within budget. See nlink_poll_msg() for budget
+	 * and return code semantics.
+	 *
+	 * Any error but -EINPROGRESS and -EINTR means replies may have been
+	 * lost (e.g. -ENOBUFS on socket receive buffer overrun): caller should
+	 * then abort() the session so that awaiting coroutines do not wait
+	 * forever.
+	 */
+	int
+	poll(unsigned int nr, uint64_t nsec = 0) noexcept
+	{
+		nlink_assert(nr);
+
+		int err;
+
+		flush();
+
+		if (!nlink_win_has_work(&win))
+			return 0;
+
+		err = nlink_poll_msg(&rx, &sock, &nr, nsec, dispatch, this);
+
+		flush();
+
+		return err;
+	}
+
+	/*
+	 * Block processing replies till all requests completed. Upon fatal
+	 * receive error, all requests are aborted with it before returning.
+	 */
+	int
+	run(unsigned int nr = 64) noexcept
+	{
+		nlink_assert(nr);
+
+		while (!idle()) {
+			struct pollfd pfd = {
+				.fd      = nlink_sock_fd(&sock),
+				.events  = POLLIN,
+				.revents = 0
+			};
+			int           err;
+
+			err = poll(nr);
+			if (err == -EINPROGRESS)
+				continue;
+			if (err) {
+				if (err != -EINTR)
+					abort(err);
+				return err;
+			}
+
+			if (idle())
+				break;
+
+			/*
+			 * Kernel pushed back with nothing in flight: retry
+			 * backlogged requests a bit later.
+			 */
+			if (::poll(&pfd,
+			           1,
+			           nlink_win_has_work(&win) ? -1 : 1) < 0) {
+				nlink_assert(errno != EFAULT);
+				nlink_assert(errno != EINVAL);
+
+				if (errno != EINTR)
+					return -errno;
+			}
+		}
+
+		return 0;
+	}
+
+	/*
+	 * Resume all coroutines awaiting requests in flight or backlogged with
+	 * err. Late kernel replies to aborted requests are ignored.
+	 */
+	void
+	abort(int err) noexcept
+	{
+		nlink_assert(err < 0);
+
+		struct dlist_node  aborted;
+		struct nlink_work *work;
+		unsigned int       slot = 0;
+
+		/*
+		 * Collect requests first since resumed coroutines may submit new
+		 * ones, which are not aborted.
+		 */
+		dlist_init(&aborted);
+		while ((work = nlink_win_drain_work(&win, &slot)))
+			dlist_nqueue_back(&aborted, &work->node);
+		while (!dlist_empty(&backlog))
+			dlist_nqueue_back(&aborted, dlist_dqueue_front(&backlog));
+
+		while (!dlist_empty(&aborted)) {
+			work = dlist_entry(dlist_dqueue_front(&aborted),
+			                   struct nlink_work,
+			                   node);
+			dlist_init(&work->node);
+
+			request &req = request::from_work(work);
+
+			req.status = err;
+			req.handle.resume();
+		}
+	}
+
+private:
+	friend class request;
+
+	int
+	send(request &req) noexcept
+	{
+		int err;
+
+		err = (int)nlink_send_msg(&sock, req.msg);
+		if (err)
+			return err;
+
+		nlink_win_sched_work(&win, &req.link.work, req.msg->nlmsg_seq);
+
+		return 0;
+	}
+
+	/* Returns false when request completed synchronously. */
+	bool
+	submit(request &req) noexcept
+	{
+		int err;
+
+		if (!dlist_empty(&backlog) || !nlink_win_is_open(&win)) {
+			/* Preserve submission order. */
+			dlist_nqueue_back(&backlog, &req.link.work.node);
+			return true;
+		}
+
+		err = send(req);
+		switch (err) {
+		case 0:
+			return true;
+
+		case -EAGAIN:
+		case -ENOBUFS:
+			nlink_win_backoff(&win);
+			dlist_nqueue_back(&backlog, &req.link.work.node);
+			return true;
+
+		default:
+			req.status = err;
+			return false;
+		}
+	}
+
+	/* Send backlogged requests while window is open. */
+	void
+	flush() noexcept
+	{
+		while (!dlist_empty(&backlog) && nlink_win_is_open(&win)) {
+			struct nlink_work *work;
+			int                err;
+
+			work = dlist_entry(dlist_first(&backlog),
+			                   struct nlink_work,
+			                   node);
+			dlist_remove(&work->node);
+			dlist_init(&work->node);
+
+			request &req = request::from_work(work);
+
+			err = send(req);
+			if (err == -EAGAIN || err == -ENOBUFS) {
+				nlink_win_backoff(&win);
+				dlist_nqueue_front(&backlog, &work->node);
+				break;
+			}
+
+			if (err) {
+				req.status = err;
+				req.handle.resume();
+			}
+		}
+	}
+
+	void
+	complete(struct nlink_work *work, int status) noexcept
+	{
+		request &req = request::from_work(work);
+
+		req.status = req.intr ? -EINTR : status;
+
+		/* Refill the slot just released before handing control over. */
+		flush();
+
+		req.handle.resume();
+	}
+
+	static int
+	dispatch(int status, const struct nlmsghdr *msg, void *data) noexcept
+	{
+		session           &sess = *static_cast<session *>(data);
+		struct nlink_work *work;
+
+		if (!nlink_win_has_work(&sess.win))
+			/* Notification or stale reply. */
+			return 0;
+
+		if (!status ||
+		    ((status == -EINTR) && (msg->nlmsg_type >= NLMSG_MIN_TYPE))) {
+			work = nlink_win_find_work(&sess.win, msg->nlmsg_seq);
+			if (work) {
+				request &req = request::from_work(work);
+
+				/*
+				 * Inconsistent dump: reported at completion.
+				 * Handlers never see interrupted parts.
+				 */
+				if (status)
+					req.intr = true;
+				else if (req.data)
+					req.data(req, msg);
+			}
+
+			return 0;
+		}
+
+		if (status == -EOVERFLOW)
+			return 0;
+
+		work = nlink_win_pull_work(&sess.win, msg->nlmsg_seq);
+		if (work)
+			sess.complete(work, (status == -ENODATA) ? 0 : status);
+
+		return 0;
+	}
+
+	struct nlink_sock &sock;
+	struct nlink_win   win;
+	struct nlink_poll  rx;
+	struct dlist_node  backlog;
+};
+
+inline bool
+request::await_suspend(std::coroutine_handle<> handle) noexcept
+{
+	this->handle = handle;
+
+	return sess.submit(*this);
+}
+
+/******************************************************************************
+ * Link operations
+ ******************************************************************************/
+
+class mtu_request: public request {
+public:
+	mtu_request(session &sess, int index, uint32_t mtu) noexcept:
+		request(sess, &req.hdr)
+	{
+		nlink_iface_init_u32_req(&req, &sess.socket(), index, IFLA_MTU);
+		nlink_iface_patch_u32_req(&req, &sess.socket(), mtu);
+	}
+
+private:
+	struct nlink_iface_u32_req req;
+};
+
+inline mtu_request
+set_mtu(session &sess, int index, uint32_t mtu) noexcept
+{
+	return mtu_request(sess, index, mtu);
+}
+
+class admin_request: public request {
+public:
+	admin_request(session &sess, int index, uint8_t state) noexcept:
+		request(sess, &req.hdr)
+	{
+		nlink_iface_init_req(&req, &sess.socket(), index);
+		nlink_iface_patch_admin_req(&req, &sess.socket(), state);
+	}
+
+private:
+	struct nlink_iface_req req;
+};
+
+inline admin_request
+set_admin_state(session &sess, int index, uint8_t state) noexcept
+{
+	return admin_request(sess, index, state);
+}
+
+/*
+ * Retrieve a single interface into rec. Resumes with -ENODEV when interface
+ * could not be parsed.
+ */
+class get_request: public request {
+public:
+	get_request(session &sess, int index, struct nlink_iface_rec &rec)
+		noexcept:
+		request(sess, &req.hdr, parse), rec(rec), found(false)
+	{
+		nlink_iface_init_req(&req, &sess.socket(), index);
+		req.hdr.nlmsg_type = RTM_GETLINK;
+		req.hdr.nlmsg_seq = nlink_alloc_seqno(&sess.socket());
+	}
+
+	int
+	await_resume() const noexcept
+	{
+		int err = request::await_resume();
+
+		return (!err && !found) ? -ENODEV : err;
+	}
+
+private:
+	static void
+	parse(request &base, const struct nlmsghdr *msg)
+	{
+		get_request        &self = static_cast<get_request &>(base);
+		struct nlink_iface  iface;
+
+		if ((msg->nlmsg_type != RTM_NEWLINK) ||
+		    nlink_iface_parse_msg(msg, &iface))
+			return;
+
+		/* Message buffer is reused before resumption: copy. */
+		nlink_iface_pack_rec(&self.rec, &iface);
+		self.found = true;
+	}
+
+	struct nlink_iface_req  req;
+	struct nlink_iface_rec &rec;
+	bool                    found;
+};
+
+inline get_request
+get(session &sess, int index, struct nlink_iface_rec &rec) noexcept
+{
+	return get_request(sess, index, rec);
+}
+
+/*
+ * Dump all interfaces, calling fn(const struct nlink_iface &) for each of them
+ * as dump parts arrive. Interfaces point into the receive buffer and are only
+ * valid for the duration of the call. Resumes with -EINTR when dump was
+ * interrupted, in which case caller should dump again.
+ */
+template <typename Fn>
+class dump_request: public request {
+public:
+	dump_request(session &sess, Fn &&fn) noexcept:
+		request(sess, &req.hdr, parse), fn(static_cast<Fn &&>(fn))
+	{
+		nlink_iface_setup_dump(&req.hdr, &sess.socket());
+	}
+
+private:
+	static void
+	parse(request &base, const struct nlmsghdr *msg)
+	{
+		dump_request       &self = static_cast<dump_request &>(base);
+		struct nlink_iface  iface;
+
+		if ((msg->nlmsg_type == RTM_NEWLINK) &&
+		    !nlink_iface_parse_msg(msg, &iface))
+			self.fn(static_cast<const struct nlink_iface &>(iface));
+	}
+
+	union {
+		struct nlmsghdr hdr;
+		uint8_t         buff[NLINK_IFACE_DUMP_MSG_SIZE];
+	}  req;
+	Fn fn;
+};
+
+template <typename Fn>
+inline dump_request<Fn>
+dump(session &sess, Fn &&fn) noexcept
+{
+	return dump_request<Fn>(sess, static_cast<Fn &&>(fn));
+}
+
+/******************************************************************************
+ * Flow coroutine
+ ******************************************************************************/
+
+/*
+ * Detached coroutine type for reconfiguration flows: starts running as soon
+ * as called and frees its frame once complete.
+ */
+struct flow {
+	struct promise_type {
+		flow
+		get_return_object() const noexcept
+		{
+			return flow();
+		}
+
+		std::suspend_never
+		initial_suspend() const noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never
+		final_suspend() const noexcept
+		{
+			return {};
+		}
+
+		void
+		return_void() const noexcept
+		{
+		}
+
+		void
+		unhandled_exception() const noexcept
+		{
+			std::terminate();
+		}
+	};
+};
+
+} /* namespace nlink */
+
+#endif /* _NLINK_CORO_HPP */
@@ -0,0 +1,107 @@
+#ifndef _NLINK_DIAG_H
+#define _NLINK_DIAG_H
+
+#include <nlink/nlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+
+/*
+ * Internet socket dump filter.
+ *
+ * states is a mask of (1 << TCP_*) socket states, zero meaning all states,
+ * and is applied by kernel before any other criterion. Other criteria are
+ * ignored when zero and compiled into an INET_DIAG_REQ_BYTECODE program
+ * matching sockets which satisfy all of them:
+ * - sport:  local port (host byte order) ;
+ * - dport:  remote port (host byte order) ;
+ * - cgroup: cgroup v2 ID, i.e. the inode number of the cgroup directory,
+ *           supported by kernels 5.10+ built with CONFIG_SOCK_CGROUP_DATA.
+ */
+struct nlink_diag_filter {
+	uint32_t states;
+	uint16_t sport;
+	uint16_t dport;
+	uint64_t cgroup;
+};
+
+#define NLINK_DIAG_ALL_STATES (~0U)
+
+/* Largest bytecode program nlink_diag_setup_dump() may generate. */
+#define NLINK_DIAG_BYTECODE_SIZE \
+	((4 * sizeof(struct inet_diag_bc_op)) + \
+	 sizeof(struct inet_diag_bc_op) + sizeof(uint64_t))
+
+#define NLINK_DIAG_DUMP_MSG_SIZE \
+	(MNL_NLMSG_HDRLEN + \
+	 MNL_ALIGN(sizeof(struct inet_diag_req_v2)) + \
+	 MNL_ATTR_HDRLEN + \
+	 MNL_ALIGN(NLINK_DIAG_BYTECODE_SIZE))
+
+extern void
+nlink_diag_setup_dump(struct nlmsghdr                *msg,
+                      struct nlink_sock              *sock,
+                      uint8_t                         family,
+                      uint8_t                         protocol,
+                      const struct nlink_diag_filter *filter);
+
+/*
+ * Socket record callback.
+ *
+ * sk points into the received datagram, i.e. records are handed out without
+ * any copy and are valid till the next reception into the same buffer. msg
+ * is the enclosing message, giving access to attributes if any.
+ */
+typedef int (nlink_diag_parse_fn)(const struct inet_diag_msg *sk,
+                                  const struct nlmsghdr      *msg,
+                                  void                       *data);
+
+/*
+ * Run callback for each socket record of a received datagram. Returns like
+ * nlink_parse_msg(), i.e. -EINPROGRESS while dump is not over, -ENODATA once
+ * done.
+ */
+extern int
+nlink_diag_parse_msg(const struct nlmsghdr *msg,
+                     size_t                 size,
+                     nlink_diag_parse_fn   *parse,
+                     void                  *data);
+
+/*
+ * Maximum number of socket records a single datagram may carry, i.e. the
+ * number of array entries required to parse any datagram in one call to
+ * nlink_diag_parse_batch().
+ */
+#define NLINK_DIAG_BATCH_NR \
+	(NLINK_XFER_MSG_SIZE / \
+	 (MNL_NLMSG_HDRLEN + MNL_ALIGN(sizeof(struct inet_diag_msg))))
+
+/*
+ * Collect pointers to socket records of a received datagram into an array.
+ * Arguments and return codes follow nlink_iface_parse_batch() semantics.
+ */
+extern int
+nlink_diag_parse_batch(const struct nlmsghdr      **msg,
+                       int                         *bytes,
+                       const struct inet_diag_msg **socks,
+                       unsigned int                *nr);
+
+/*
+ * Dump sockets matching filter and run callback for each of them, using the
+ * given NLINK_XFER_MSG_SIZE sized buffer.
+ */
+extern int
+nlink_diag_dump(struct nlink_sock              *sock,
+                struct nlmsghdr                *msg,
+                uint8_t                         family,
+                uint8_t                         protocol,
+                const struct nlink_diag_filter *filter,
+                nlink_diag_parse_fn            *parse,
+                void                           *data);
+
+static inline int
+nlink_open_diag_sock(struct nlink_sock *sock, int flags)
+{
+	return nlink_open_sock(sock, NETLINK_SOCK_DIAG, flags);
+}
+
+#endif /* _NLINK_DIAG_H */
@@ -0,0 +1,143 @@
+#ifndef _NLINK_FDB_H
+#define _NLINK_FDB_H
+
+#include <nlink/nlink.h>
+#include <net/ethernet.h>
+
+/*
+ * Bridge forwarding database entry.
+ *
+ * key packs the MAC address (48 lower bits) and the VLAN identifier (bits 48
+ * to 59). Bit 63 is always set for occupied slots so that a null key stands
+ * for an empty slot.
+ */
+struct nlink_fdb_entry {
+	uint64_t key;
+	int32_t  port;
+	uint16_t state;
+	uint8_t  flags;
+};
+
+#define NLINK_FDB_USED_KEY (1ULL << 63)
+
+static inline uint64_t
+nlink_fdb_make_key(const struct ether_addr *addr, uint16_t vlan)
+{
+	uint64_t     key = 0;
+	unsigned int b;
+
+	for (b = 0; b < ETH_ALEN; b++)
+		key |= (uint64_t)addr->ether_addr_octet[b] << (8 * b);
+
+	return NLINK_FDB_USED_KEY | ((uint64_t)(vlan & 0xfff) << 48) | key;
+}
+
+static inline uint16_t
+nlink_fdb_entry_vlan(const struct nlink_fdb_entry *entry)
+{
+	nlink_assert(entry);
+	nlink_assert(entry->key & NLINK_FDB_USED_KEY);
+
+	return (uint16_t)((entry->key >> 48) & 0xfff);
+}
+
+static inline void
+nlink_fdb_entry_addr(const struct nlink_fdb_entry *entry,
+                     struct ether_addr            *addr)
+{
+	nlink_assert(entry);
+	nlink_assert(entry->key & NLINK_FDB_USED_KEY);
+	nlink_assert(addr);
+
+	unsigned int b;
+
+	for (b = 0; b < ETH_ALEN; b++)
+		addr->ether_addr_octet[b] = (uint8_t)(entry->key >> (8 * b));
+}
+
+/*
+ * Forwarding database entry as carried by AF_BRIDGE RTM_NEWNEIGH /
+ * RTM_DELNEIGH messages. addr points into the message.
+ */
+struct nlink_fdb_msg {
+	const struct ether_addr *addr;
+	uint16_t                 vlan;
+	int                      port;
+	int                      master;
+	uint16_t                 state;
+	uint8_t                  flags;
+};
+
+extern int
+nlink_fdb_parse_msg(const struct nlmsghdr *msg, struct nlink_fdb_msg *fdb);
+
+extern void
+nlink_fdb_setup_dump(struct nlmsghdr   *msg,
+                     struct nlink_sock *sock,
+                     int                master);
+
+/*
+ * MAC and VLAN indexed cache of a single bridge forwarding database.
+ *
+ * Entries live into an open addressing hash table sized to twice the maximum
+ * number of entries given at initialization time. Lookups and updates are
+ * constant time so that learning and aging event storms may be applied one
+ * message at a time without resorting to full re-dumps.
+ */
+struct nlink_fdb {
+	unsigned int            cnt;
+	unsigned int            nr;
+	int                     master;
+	unsigned int            mask;
+	struct nlink_fdb_entry *slots;
+};
+
+#define nlink_fdb_assert(_fdb) \
+	nlink_assert(_fdb); \
+	nlink_assert((_fdb)->nr); \
+	nlink_assert((_fdb)->cnt <= (_fdb)->nr); \
+	nlink_assert((_fdb)->master > 0); \
+	nlink_assert((_fdb)->slots)
+
+static inline unsigned int
+nlink_fdb_count(const struct nlink_fdb *fdb)
+{
+	nlink_fdb_assert(fdb);
+
+	return fdb->cnt;
+}
+
+extern const struct nlink_fdb_entry *
+nlink_fdb_find(const struct nlink_fdb  *fdb,
+               const struct ether_addr *addr,
+               uint16_t                 vlan);
+
+extern const struct nlink_fdb_entry *
+nlink_fdb_iter(const struct nlink_fdb *fdb, unsigned int *slot);
+
+extern int
+nlink_fdb_update(struct nlink_fdb *fdb, const struct nlink_fdb_msg *entry);
+
+extern int
+nlink_fdb_remove(struct nlink_fdb        *fdb,
+                 const struct ether_addr *addr,
+                 uint16_t                 vlan);
+
+extern int
+nlink_fdb_process_msg(struct nlink_fdb *fdb, const struct nlmsghdr *msg);
+
+extern int
+nlink_fdb_load(struct nlink_fdb  *fdb,
+               struct nlink_sock *sock,
+               struct nlmsghdr   *msg);
+
+extern void
+nlink_fdb_clear(struct nlink_fdb *fdb);
+
+extern int
+nlink_fdb_init(struct nlink_fdb *fdb, int master, unsigned int nr);
+
+extern void
+nlink_fdb_fini(const struct nlink_fdb *fdb);
+
+#endif /* _NLINK_FDB_H */
@@ -0,0 +1,53 @@
+#ifndef _NLINK_FILTER_H
+#define _NLINK_FILTER_H
+
+#include <nlink/nlink.h>
+#include <linux/filter.h>
+
+/*
+ * Socket filter specification.
+ *
+ * Each criterion is ignored when its array is empty (resp. master is zero).
+ * A message passes when it matches all enabled criteria:
+ * - types:       nlmsg_type is one of the given message types ;
+ * - iface_types: link message ifi_type is one of the given ARPHRD_* types ;
+ * - indices:     link message ifi_index is one of the given interface
+ *                indices ;
+ * - master:      link message carries an IFLA_MASTER attribute matching the
+ *                given interface index.
+ *
+ * Interface related criteria apply to link messages only, other messages
+ * passing unconditionally. Control messages (ACKs, errors, end of dumps),
+ * multipart dump replies and messages addressed to the socket's own port id
+ * are never filtered out so that request / reply processing is left
+ * untouched.
+ *
+ * Note that filters only see the first message of each datagram which is
+ * fine for multicast notifications since kernel sends them one per datagram.
+ */
+struct nlink_filter {
+	const uint16_t       *types;
+	unsigned int          types_nr;
+	const unsigned short *iface_types;
+	unsigned int          iface_types_nr;
+	const int            *indices;
+	unsigned int          indices_nr;
+	int                   master;
+};
+
+extern int
+nlink_filter_compile(const struct nlink_filter *filter,
+                     const struct nlink_sock   *sock,
+                     struct sock_fprog         *prog);
+
+extern int
+nlink_attach_prog(const struct nlink_sock *sock, const struct sock_fprog *prog);
+
+extern int
+nlink_attach_filter(const struct nlink_sock   *sock,
+                    const struct nlink_filter *filter);
+
+extern int
+nlink_detach_filter(const struct nlink_sock *sock);
+
+#endif /* _NLINK_FILTER_H */
@@ -4,9 +4,19 @@
 #include <nlink/nlink.h>
 #include <libmnl/libmnl.h>
 #include <linux/rtnetlink.h>
+#include <linux/if_ether.h>
+#include <string.h>
+#include <stddef.h>
 
 struct ether_addr;
 
+/*
+ * Interface name buffer size, i.e. IFNAMSIZ. Public headers refrain from
+ * including either <net/if.h> or <linux/if.h> since applications including
+ * both in the wrong order get redefinition errors.
+ */
+#define NLINK_IFNAMSIZ (16U)
+
 struct nlink_iface {
 	unsigned short           type;
 	int                      index;
@@ -17,6 +27,8 @@ struct nlink_iface {
 	size_t                   name_len;
 	uint32_t                 mtu;
 	uint32_t                 link;
+	/* link refers to an interface of another network namespace. */
+	bool                     link_netns;
 	uint32_t                 master;
 	uint8_t                  oper_state;
 	uint32_t                 group;
@@ -32,9 +44,132 @@ nlink_iface_msg_isempty(const struct nlmsghdr *msg)
 	return (mnl_nlmsg_get_payload_len(msg) <= sizeof(struct ifinfomsg));
 }
 
+/*
+ * Position independent interface record, i.e. holding no pointer so that it
+ * may be stored into files or shared memory as is.
+ */
+struct nlink_iface_rec {
+	int32_t  index;
+	uint16_t type;
+	uint8_t  admin_state;
+	uint8_t  oper_state;
+	uint8_t  carrier_state;
+	uint8_t  flags;
+	uint8_t  name_len;
+	uint8_t  pad;
+	uint32_t mtu;
+	uint32_t link;
+	uint32_t master;
+	uint32_t group;
+	uint32_t promisc;
+	uint8_t  ucast_hwaddr[ETH_ALEN];
+	uint8_t  bcast_hwaddr[ETH_ALEN];
+	char     name[NLINK_IFNAMSIZ];
+};
+
+#define NLINK_IFACE_REC_UCAST_FLAG (1U << 0)
+#define NLINK_IFACE_REC_BCAST_FLAG (1U << 1)
+
+extern void
+nlink_iface_pack_rec(struct nlink_iface_rec   *rec,
+                     const struct nlink_iface *iface);
+
+static inline bool
+nlink_iface_rec_equal(const struct nlink_iface_rec *first,
+                      const struct nlink_iface_rec *second)
+{
+	nlink_assert(first);
+	nlink_assert(second);
+
+	/* Records are packed with padding cleared: compare them as blobs. */
+	return !memcmp(first, second, sizeof(*first));
+}
+
 extern int
 nlink_iface_parse_msg(const struct nlmsghdr *msg, struct nlink_iface *iface);
 
+/*
+ * Field-level change masks.
+ *
+ * Kernel emits RTM_NEWLINK notifications for nearly any interface change,
+ * including statistics and attributes not tracked here. Merging them into a
+ * stored record thanks to nlink_iface_merge_rec() / nlink_iface_merge_msg()
+ * yields the set of tracked fields that actually changed, so that consumers
+ * may skip no-op updates by testing the mask against the fields they are
+ * interested in.
+ */
+#define NLINK_IFACE_TYPE_CHANGE    (1U << 0)
+#define NLINK_IFACE_ADMIN_CHANGE   (1U << 1)
+#define NLINK_IFACE_OPER_CHANGE    (1U << 2)
+#define NLINK_IFACE_CARRIER_CHANGE (1U << 3)
+#define NLINK_IFACE_MTU_CHANGE     (1U << 4)
+#define NLINK_IFACE_LINK_CHANGE    (1U << 5)
+#define NLINK_IFACE_MASTER_CHANGE  (1U << 6)
+#define NLINK_IFACE_GROUP_CHANGE   (1U << 7)
+#define NLINK_IFACE_PROMISC_CHANGE (1U << 8)
+#define NLINK_IFACE_UCAST_CHANGE   (1U << 9)
+#define NLINK_IFACE_BCAST_CHANGE   (1U << 10)
+#define NLINK_IFACE_NAME_CHANGE    (1U << 11)
+#define NLINK_IFACE_ALL_CHANGES    ((1U << 12) - 1)
+
+/*
+ * Merge parsed interface into stored record and return the mask of changed
+ * fields.
+ *
+ * Link notifications carry complete interface state: attributes missing from
+ * the message are reset to their default (e.g. no IFLA_MASTER means the
+ * interface has been released). A zeroed record may be given to initialize
+ * it, in which case all fields differing from zero are reported.
+ */
+extern unsigned int
+nlink_iface_merge_rec(struct nlink_iface_rec   *rec,
+                      const struct nlink_iface *iface);
+
+/*
+ * Parse RTM_NEWLINK message and merge it into stored record. Returns the mask
+ * of changed fields or a negative errno like nlink_iface_parse_msg().
+ */
+extern int
+nlink_iface_merge_msg(struct nlink_iface_rec *rec, const struct nlmsghdr *msg);
+
+/*
+ * Maximum number of link messages a single datagram may carry, i.e. the
+ * number of array entries required to parse any datagram in one call to
+ * nlink_iface_parse_batch().
+ */
+#define NLINK_IFACE_BATCH_NR \
+	(NLINK_XFER_MSG_SIZE / \
+	 (MNL_NLMSG_HDRLEN + \
+	  MNL_ALIGN(sizeof(struct ifinfomsg)) + \
+	  MNL_ATTR_HDRLEN + \
+	  MNL_ALIGN(2)))
+
+/*
+ * Parse link messages of a received datagram into an array of interfaces.
+ *
+ * On input, *msg and *bytes locate the datagram (part) to parse and *nr holds
+ * the number of ifaces entries available. On output, *nr holds the number of
+ * parsed interfaces while *msg and *bytes locate the first message not
+ * consumed.
+ *
+ * Returns:
+ * - 0:            datagram entirely consumed when *bytes is zero, ifaces
+ *                 array full otherwise ; call again to go on parsing ;
+ * - -EINPROGRESS: datagram consumed while multipart sequence is not over ;
+ * - -ENODATA:     end of sequence / ACK found at *msg ;
+ * - -ENOMSG:      data message other than RTM_NEWLINK found at *msg (e.g.
+ *                 RTM_DELLINK notification) ; caller should process and skip
+ *                 it before calling again ;
+ * - -EINTR:       dump interrupted ;
+ * - other:        error reported by kernel or parsing failure of the message
+ *                 found at *msg.
+ */
+extern int
+nlink_iface_parse_batch(const struct nlmsghdr **msg,
+                        int                    *bytes,
+                        struct nlink_iface     *ifaces,
+                        unsigned int           *nr);
+
 extern int
 nlink_iface_setup_msg_ucast_hwaddr(struct nlmsghdr         *msg,
                                    const struct ether_addr *hwaddr);
@@ -54,6 +189,162 @@ nlink_iface_setup_new(struct nlmsghdr   *msg,
                       unsigned short     type,
                       int                index);
 
+/******************************************************************************
+ * Prebuilt link request templates
+ ******************************************************************************/
+
+/*
+ * Fixed layout RTM_NEWLINK requests small enough to live on the stack.
+ *
+ * Templates are initialized once per interface thanks to the
+ * nlink_iface_init_*_req() functions. Issuing a request then only requires
+ * to patch sequence number and attribute value using the matching
+ * nlink_iface_patch_*_req() function before passing &req->hdr to
+ * nlink_send_msg(). Layouts are checked against netlink alignment rules at
+ * build time so that no runtime bounds checking is needed.
+ */
+
+/* Administrative state change request, i.e. carrying no attribute. */
+struct nlink_iface_req {
+	struct nlmsghdr  hdr;
+	struct ifinfomsg info;
+};
+
+/* Request carrying a single 32 bits attribute (IFLA_MTU, IFLA_MASTER...). */
+struct nlink_iface_u32_req {
+	struct nlmsghdr  hdr;
+	struct ifinfomsg info;
+	struct nlattr    attr;
+	uint32_t         value;
+};
+
+/* Interface renaming request. */
+struct nlink_iface_name_req {
+	struct nlmsghdr  hdr;
+	struct ifinfomsg info;
+	struct nlattr    attr;
+	char             name[NLINK_IFNAMSIZ];
+};
+
+#define NLINK_IFACE_REQ_ATTR_OFF \
+	(MNL_NLMSG_HDRLEN + MNL_ALIGN(sizeof(struct ifinfomsg)))
+
+/* Layout checks are performed by C builds of the library only. */
+#if !defined(__cplusplus)
+
+_Static_assert(offsetof(struct nlink_iface_req, info) == MNL_NLMSG_HDRLEN,
+               "unexpected link request header layout");
+_Static_assert(sizeof(struct nlink_iface_req) == NLINK_IFACE_REQ_ATTR_OFF,
+               "unexpected link request size");
+_Static_assert(offsetof(struct nlink_iface_u32_req, attr) ==
+               NLINK_IFACE_REQ_ATTR_OFF,
+               "unexpected link u32 request attribute layout");
+_Static_assert(offsetof(struct nlink_iface_u32_req, value) ==
+               (NLINK_IFACE_REQ_ATTR_OFF + MNL_ATTR_HDRLEN),
+               "unexpected link u32 request payload layout");
+_Static_assert(sizeof(struct nlink_iface_u32_req) ==
+               (NLINK_IFACE_REQ_ATTR_OFF +
+                MNL_ATTR_HDRLEN +
+                MNL_ALIGN(sizeof(uint32_t))),
+               "unexpected link u32 request size");
+_Static_assert(offsetof(struct nlink_iface_name_req, name) ==
+               (NLINK_IFACE_REQ_ATTR_OFF + MNL_ATTR_HDRLEN),
+               "unexpected link name request payload layout");
+
+#endif /* !defined(__cplusplus) */
+
+static inline void
+nlink_iface_init_req(struct nlink_iface_req  *req,
+                     const struct nlink_sock *sock,
+                     int                      index)
+{
+	nlink_assert(req);
+	nlink_assert_sock(sock);
+	nlink_assert(index > 0);
+
+	req->hdr.nlmsg_len = sizeof(*req);
+	req->hdr.nlmsg_type = RTM_NEWLINK;
+	req->hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	req->hdr.nlmsg_seq = 0;
+	req->hdr.nlmsg_pid = sock->port_id;
+
+	req->info.ifi_family = AF_UNSPEC;
+	req->info.__ifi_pad = 0;
+	req->info.ifi_type = 0;
+	req->info.ifi_index = index;
+	req->info.ifi_flags = 0;
+	req->info.ifi_change = 0;
+}
+
+/* Out of line since IF_OPER_* come from <linux/if.h>, see NLINK_IFNAMSIZ. */
+extern void
+nlink_iface_patch_admin_req(struct nlink_iface_req *req,
+                            struct nlink_sock      *sock,
+                            uint8_t                 state);
+
+static inline void
+nlink_iface_init_u32_req(struct nlink_iface_u32_req *req,
+                         const struct nlink_sock    *sock,
+                         int                         index,
+                         uint16_t                    type)
+{
+	nlink_assert(req);
+	nlink_assert(type > IFLA_UNSPEC);
+	nlink_assert(type <= IFLA_MAX);
+
+	nlink_iface_init_req((struct nlink_iface_req *)req, sock, index);
+	req->hdr.nlmsg_len = sizeof(*req);
+
+	req->attr.nla_len = MNL_ATTR_HDRLEN + sizeof(req->value);
+	req->attr.nla_type = type;
+	req->value = 0;
+}
+
+static inline void
+nlink_iface_patch_u32_req(struct nlink_iface_u32_req *req,
+                          struct nlink_sock          *sock,
+                          uint32_t                    value)
+{
+	nlink_assert(req);
+	nlink_assert(req->hdr.nlmsg_len == sizeof(*req));
+
+	req->hdr.nlmsg_seq = nlink_alloc_seqno(sock);
+	req->value = value;
+}
+
+static inline void
+nlink_iface_init_name_req(struct nlink_iface_name_req *req,
+                          const struct nlink_sock     *sock,
+                          int                          index)
+{
+	nlink_assert(req);
+
+	nlink_iface_init_req((struct nlink_iface_req *)req, sock, index);
+
+	req->attr.nla_type = IFLA_IFNAME;
+}
+
+static inline void
+nlink_iface_patch_name_req(struct nlink_iface_name_req *req,
+                           struct nlink_sock           *sock,
+                           const char                  *name,
+                           size_t                       len)
+{
+	nlink_assert(req);
+	nlink_assert(req->attr.nla_type == IFLA_IFNAME);
+	nlink_assert(name);
+	nlink_assert(len);
+	nlink_assert(len < sizeof(req->name));
+
+	memcpy(req->name, name, len);
+	memset(&req->name[len], 0, sizeof(req->name) - len);
+
+	req->attr.nla_len = (uint16_t)(MNL_ATTR_HDRLEN + len + 1);
+	req->hdr.nlmsg_len = (uint32_t)(NLINK_IFACE_REQ_ATTR_OFF +
+	                                MNL_ALIGN(req->attr.nla_len));
+	req->hdr.nlmsg_seq = nlink_alloc_seqno(sock);
+}
+
 #define NLINK_IFACE_DUMP_MSG_SIZE \
 	(MNL_NLMSG_HDRLEN + sizeof(struct ifinfomsg))
 
@@ -61,4 +352,16 @@ extern void
 nlink_iface_setup_dump(struct nlmsghdr   *msg,
                        struct nlink_sock *sock);
 
+#if defined(CONFIG_NLINK_NSID)
+
+#define NLINK_IFACE_NSID_DUMP_MSG_SIZE \
+	(NLINK_IFACE_DUMP_MSG_SIZE + MNL_ATTR_HDRLEN + sizeof(uint32_t))
+
+extern void
+nlink_iface_setup_nsid_dump(struct nlmsghdr   *msg,
+                            struct nlink_sock *sock,
+                            int                nsid);
+
+#endif /* defined(CONFIG_NLINK_NSID) */
+
 #endif /* _NLINK_IFACE_H */
@@ -0,0 +1,136 @@
+#ifndef _NLINK_IFTAB_H
+#define _NLINK_IFTAB_H
+
+#include <nlink/iface.h>
+
+struct ether_addr;
+
+/*
+ * Interned atom, i.e. interface name or hardware address shared by all rows
+ * holding the same value.
+ */
+struct nlink_iftab_atom {
+	uint32_t ref;
+	uint32_t hash;
+	uint8_t  len;
+	char     data[NLINK_IFNAMSIZ];
+};
+
+struct nlink_iftab_slot {
+	int32_t  index;
+	uint32_t row;
+};
+
+/*
+ * Compact interface table.
+ *
+ * Interface attributes are stored as dense columns indexed by row number so
+ * that bulk scans only touch the columns they need. Hot columns hold fields
+ * commonly used to select interfaces (index, states, mtu, master, group) ;
+ * cold columns hold fields mostly accessed once a row has been selected.
+ * Names and hardware addresses are interned into a fixed size atom arena and
+ * referred to by atom identifier (0 meaning "no value").
+ *
+ * Rows are kept packed: removing a row moves the last one into its place.
+ * Hence row numbers are not stable across removals.
+ */
+struct nlink_iftab {
+	unsigned int             cnt;
+	unsigned int             nr;
+	/* Hot columns. */
+	int32_t                 *index;
+	uint8_t                 *admin_state;
+	uint8_t                 *oper_state;
+	uint8_t                 *carrier_state;
+	uint32_t                *mtu;
+	uint32_t                *master;
+	uint32_t                *group;
+	/* Cold columns. */
+	uint16_t                *type;
+	uint32_t                *link;
+	uint32_t                *promisc;
+	uint32_t                *name;
+	uint32_t                *ucast_hwaddr;
+	uint32_t                *bcast_hwaddr;
+	/* Interface index to row map. */
+	unsigned int             map_mask;
+	struct nlink_iftab_slot *map;
+	/* Atom arena and its interning map. */
+	unsigned int             atom_free;
+	struct nlink_iftab_atom *atoms;
+	unsigned int             intern_mask;
+	uint32_t                *intern;
+	void                    *mem;
+};
+
+#define nlink_iftab_assert(_tab) \
+	nlink_assert(_tab); \
+	nlink_assert((_tab)->nr); \
+	nlink_assert((_tab)->cnt <= (_tab)->nr); \
+	nlink_assert((_tab)->mem)
+
+#define nlink_iftab_assert_row(_tab, _row) \
+	nlink_iftab_assert(_tab); \
+	nlink_assert((_row) < (_tab)->cnt)
+
+static inline unsigned int
+nlink_iftab_count(const struct nlink_iftab *tab)
+{
+	nlink_iftab_assert(tab);
+
+	return tab->cnt;
+}
+
+extern const char *
+nlink_iftab_name(const struct nlink_iftab *tab,
+                 unsigned int              row,
+                 size_t                   *len);
+
+extern const struct ether_addr *
+nlink_iftab_ucast_hwaddr(const struct nlink_iftab *tab, unsigned int row);
+
+extern const struct ether_addr *
+nlink_iftab_bcast_hwaddr(const struct nlink_iftab *tab, unsigned int row);
+
+extern int
+nlink_iftab_find(const struct nlink_iftab *tab, int index);
+
+extern int
+nlink_iftab_update(struct nlink_iftab *tab, const struct nlink_iface *iface);
+
+extern void
+nlink_iftab_remove(struct nlink_iftab *tab, int index);
+
+#define NLINK_IFTAB_ADMIN_STATE_FILTER   (1U << 0)
+#define NLINK_IFTAB_OPER_STATE_FILTER    (1U << 1)
+#define NLINK_IFTAB_CARRIER_STATE_FILTER (1U << 2)
+#define NLINK_IFTAB_MASTER_FILTER        (1U << 3)
+#define NLINK_IFTAB_GROUP_FILTER         (1U << 4)
+
+/*
+ * Bulk scan filter: a row matches when all fields selected by mask are equal
+ * to the given values.
+ */
+struct nlink_iftab_filter {
+	unsigned int mask;
+	uint8_t      admin_state;
+	uint8_t      oper_state;
+	uint8_t      carrier_state;
+	uint32_t     master;
+	uint32_t     group;
+};
+
+extern unsigned int
+nlink_iftab_scan(const struct nlink_iftab        *tab,
+                 const struct nlink_iftab_filter *filter,
+                 unsigned int                    *start,
+                 unsigned int                    *rows,
+                 unsigned int                     nr);
+
+extern int
+nlink_iftab_init(struct nlink_iftab *tab, unsigned int nr);
+
+extern void
+nlink_iftab_fini(const struct nlink_iftab *tab);
+
+#endif /* _NLINK_IFTAB_H */
@@ -62,7 +62,7 @@ nlink_parse_msg(const struct nlmsghdr *msg,
 static inline struct nlmsghdr *
 nlink_alloc_msg(void)
 {
-	return malloc(NLINK_XFER_MSG_SIZE);
+	return (struct nlmsghdr *)malloc(NLINK_XFER_MSG_SIZE);
 }
 
 static inline void
@@ -71,14 +71,130 @@ nlink_free_msg(struct nlmsghdr *msg)
 	free(msg);
 }
 
+/*
+ * Adaptive receive buffer.
+ *
+ * Sized on demand according to the length of the next pending datagram so
+ * that messages larger than NLINK_XFER_MSG_SIZE are never truncated, and
+ * shrunk back once NLINK_RBUF_SHRINK_NR consecutive datagrams used less than a
+ * quarter of it, so that event sockets mostly receiving small notifications do
+ * not pin dump sized buffers.
+ */
+#define NLINK_RBUF_MIN_SIZE  (4096U)
+#define NLINK_RBUF_SHRINK_NR (64U)
+
+struct nlink_rbuf {
+	struct nlmsghdr *msg;
+	size_t           size;
+	unsigned int     small;
+};
+
+extern int
+nlink_init_rbuf(struct nlink_rbuf *rbuf);
+
+extern void
+nlink_fini_rbuf(const struct nlink_rbuf *rbuf);
+
+/*
+ * Budgeted non-blocking receive context.
+ *
+ * Holds a NLINK_XFER_MSG_SIZE bytes long receive buffer and a cursor over
+ * messages of the current datagram not processed yet, so that processing may
+ * stop in the middle of a datagram once budget is exhausted and resume at next
+ * poll.
+ */
+struct nlink_poll {
+	struct nlmsghdr       *buff;
+	const struct nlmsghdr *msg;
+	int                    bytes;
+};
+
+/* Number of messages processed between two time budget checks. */
+#define NLINK_POLL_CLOCK_STRIDE (16U)
+
+static inline bool
+nlink_poll_pending(const struct nlink_poll *poll)
+{
+	nlink_assert(poll);
+
+	return mnl_nlmsg_ok(poll->msg, poll->bytes);
+}
+
+static inline void
+nlink_poll_commit(struct nlink_poll     *poll,
+                  const struct nlmsghdr *msg,
+                  int                    bytes)
+{
+	nlink_assert(poll);
+	nlink_assert(msg);
+
+	poll->msg = msg;
+	poll->bytes = bytes;
+}
+
+extern int
+nlink_init_poll(struct nlink_poll *poll);
+
+extern void
+nlink_fini_poll(const struct nlink_poll *poll);
+
+/******************************************************************************
+ * Netlink socket receive queue statistics
+ ******************************************************************************/
+
+#if defined(CONFIG_NLINK_QSTATS)
+
+#define NLINK_QSTATS_HIST_NR (32U)
+
+/*
+ * Receive queue statistics sampled thanks to SO_MEMINFO right after each
+ * datagram dequeued by nlink_recv_msg().
+ *
+ * Netlink does not support SO_TIMESTAMPNS, i.e. datagrams do not carry the
+ * time they were enqueued at. Mean queueing delay is instead derived from
+ * mean backlog and receive throughput (Little's law), while backlog
+ * distribution is recorded as a log2 histogram of queued bytes:
+ * hist[b] counts samples with backlog within [2^(b-1), 2^b[ bytes, hist[0]
+ * counting empty queue samples.
+ */
+struct nlink_qstats {
+	uint64_t cnt;
+	uint64_t bytes;
+	uint64_t backlog;
+	uint64_t start;
+	uint64_t last;
+	uint32_t max;
+	uint32_t rcvbuf;
+	uint32_t drops;
+	uint64_t hist[NLINK_QSTATS_HIST_NR];
+};
+
+extern uint64_t
+nlink_qstats_mean_delay(const struct nlink_qstats *stats);
+
+extern uint32_t
+nlink_qstats_backlog_pct(const struct nlink_qstats *stats,
+                         unsigned int               permil);
+
+extern void
+nlink_qstats_reset(struct nlink_qstats *stats);
+
+#endif /* defined(CONFIG_NLINK_QSTATS) */
+
 /******************************************************************************
  * Netlink socket handling
  ******************************************************************************/
 
 struct nlink_sock {
-	uint32_t           seqno;
-	unsigned int       port_id;
-	struct mnl_socket *mnl;
+	uint32_t             seqno;
+	unsigned int         port_id;
+	struct mnl_socket   *mnl;
+#if defined(CONFIG_NLINK_QSTATS)
+	struct nlink_qstats *qstats;
+#endif /* defined(CONFIG_NLINK_QSTATS) */
+#if defined(CONFIG_NLINK_PCAP)
+	int                  bus;
+#endif /* defined(CONFIG_NLINK_PCAP) */
 };
 
 #define nlink_assert_sock(_sock) \
@@ -102,6 +218,44 @@ nlink_send_msg(const struct nlink_sock *sock, const struct nlmsghdr *msg);
 extern ssize_t
 nlink_recv_msg(const struct nlink_sock *sock, struct nlmsghdr *msg);
 
+extern ssize_t
+nlink_recv_rbuf(const struct nlink_sock *sock, struct nlink_rbuf *rbuf);
+
+extern int
+nlink_poll_fetch(struct nlink_poll       *poll,
+                 const struct nlink_sock *sock,
+                 const struct nlmsghdr  **msg,
+                 int                     *bytes);
+
+extern int
+nlink_poll_msg(struct nlink_poll       *poll,
+               const struct nlink_sock *sock,
+               unsigned int            *nr,
+               uint64_t                 nsec,
+               nlink_parse_msg_fn      *parse,
+               void                    *data);
+
+#if defined(CONFIG_NLINK_NSID)
+
+/*
+ * nlink_open_sock() flag enabling reception of notifications originating from
+ * all peer network namespaces an ID has been assigned to.
+ */
+#define NLINK_SOCK_ALL_NSID (1 << 30)
+
+/* ID tagging messages originating from the socket's own network namespace. */
+#define NLINK_LOCAL_NSID    (-1)
+
+extern ssize_t
+nlink_recv_nsid_msg(const struct nlink_sock *sock,
+                    struct nlmsghdr         *msg,
+                    int                     *nsid);
+
+extern int
+nlink_assign_nsid(int netns_fd);
+
+#endif /* defined(CONFIG_NLINK_NSID) */
+
 extern int
 nlink_open_sock(struct nlink_sock *sock, int bus, int flags);
 
@@ -111,6 +265,32 @@ nlink_join_route_group(struct nlink_sock *sock, enum rtnetlink_groups group);
 extern int
 nlink_leave_route_group(struct nlink_sock *sock, enum rtnetlink_groups group);
 
+extern int
+nlink_set_sock_rcvbuf(const struct nlink_sock *sock, int size);
+
+extern int
+nlink_get_sock_rcvbuf(const struct nlink_sock *sock);
+
+extern int
+nlink_set_sock_noenobufs(const struct nlink_sock *sock, bool on);
+
+#if defined(CONFIG_NLINK_QSTATS)
+
+/*
+ * Attach receive queue statistics to socket so that subsequent receptions
+ * sample them. Passing NULL stops sampling, saving one syscall per received
+ * datagram.
+ */
+static inline void
+nlink_attach_sock_qstats(struct nlink_sock *sock, struct nlink_qstats *stats)
+{
+	nlink_assert_sock(sock);
+
+	sock->qstats = stats;
+}
+
+#endif /* defined(CONFIG_NLINK_QSTATS) */
+
 static inline int
 nlink_open_route_sock(struct nlink_sock *sock, int flags)
 {
@@ -0,0 +1,116 @@
+#ifndef _NLINK_PCAP_H
+#define _NLINK_PCAP_H
+
+#include <nlink/nlink.h>
+#include <stdio.h>
+
+/* Nanosecond resolution pcap file format. */
+#define NLINK_PCAP_NSEC_MAGIC (0xa1b23c4dU)
+/* Microsecond resolution pcap file format. */
+#define NLINK_PCAP_USEC_MAGIC (0xa1b2c3d4U)
+#define NLINK_PCAP_MAJOR      (2U)
+#define NLINK_PCAP_MINOR      (4U)
+/* LINKTYPE_NETLINK, i.e. link type of nlmon interface captures. */
+#define NLINK_PCAP_LINKTYPE   (253U)
+/* ARPHRD_NETLINK. */
+#define NLINK_PCAP_HATYPE     (824U)
+/*
+ * Snapshot length, i.e. libpcap's maximum: records of larger datagrams are
+ * truncated.
+ */
+#define NLINK_PCAP_SNAPLEN    (262144U)
+
+/* Linux cooked header packet types. */
+#define NLINK_PCAP_HOST_PKT     (0U)
+#define NLINK_PCAP_OUTGOING_PKT (4U)
+
+struct nlink_pcap_file {
+	uint32_t magic;
+	uint16_t major;
+	uint16_t minor;
+	int32_t  zone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+struct nlink_pcap_rec {
+	uint32_t sec;
+	uint32_t frac;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+/*
+ * Linux cooked capture header nlmon prepends to each captured datagram.
+ * Multi-byte fields are in network byte order ; proto holds the netlink bus.
+ */
+struct nlink_pcap_cooked {
+	uint16_t pkttype;
+	uint16_t hatype;
+	uint16_t halen;
+	uint8_t  addr[8];
+	uint16_t proto;
+};
+
+/*
+ * Process wide datagram recorder.
+ *
+ * Once attached, all datagrams sent and received thanks to nlink_send_msg() /
+ * nlink_recv_msg() by all threads are appended to the capture file, which may
+ * be analyzed using tools supporting nlmon captures or replayed using
+ * nlink-replay.
+ */
+struct nlink_pcap {
+	FILE *file;
+	int   err;
+};
+
+extern struct nlink_pcap *nlink_pcap_curr;
+
+extern void
+nlink_pcap_record(struct nlink_pcap *pcap,
+                  int                bus,
+                  unsigned int       pkttype,
+                  const void        *data,
+                  size_t             size);
+
+static inline void
+nlink_pcap_msg(const struct nlink_sock *sock, const struct nlmsghdr *msg)
+{
+	struct nlink_pcap *pcap = __atomic_load_n(&nlink_pcap_curr,
+	                                          __ATOMIC_ACQUIRE);
+
+	if (pcap)
+		nlink_pcap_record(pcap,
+		                  sock->bus,
+		                  NLINK_PCAP_OUTGOING_PKT,
+		                  msg,
+		                  msg->nlmsg_len);
+}
+
+static inline void
+nlink_pcap_dgram(const struct nlink_sock *sock,
+                 const struct nlmsghdr   *msg,
+                 size_t                   size)
+{
+	struct nlink_pcap *pcap = __atomic_load_n(&nlink_pcap_curr,
+	                                          __ATOMIC_ACQUIRE);
+
+	if (pcap)
+		nlink_pcap_record(pcap, sock->bus, NLINK_PCAP_HOST_PKT, msg, size);
+}
+
+extern struct nlink_pcap *
+nlink_pcap_attach(struct nlink_pcap *pcap);
+
+extern int
+nlink_pcap_flush(struct nlink_pcap *pcap);
+
+extern int
+nlink_pcap_open(struct nlink_pcap *pcap, const char *path);
+
+extern int
+nlink_pcap_close(struct nlink_pcap *pcap);
+
+#endif /* _NLINK_PCAP_H */
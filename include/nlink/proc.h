@@ -0,0 +1,70 @@
+#ifndef _NLINK_PROC_H
+#define _NLINK_PROC_H
+
+#include <nlink/nlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include <sys/socket.h>
+
+/*
+ * Room reserved for each proc connector datagram, i.e. netlink header,
+ * connector header and event, with some margin for event layout growth.
+ */
+#define NLINK_PROC_DGRAM_SIZE (256U)
+
+struct nlink_proc_cpu {
+	uint32_t next;
+	bool     valid;
+};
+
+/*
+ * Process event connector stream.
+ *
+ * Kernel sends one datagram per process event (fork, exec, exit...).
+ * Datagrams are received in batches thanks to recvmmsg(2) so that a single
+ * syscall dequeues up to nr events.
+ *
+ * Loss accounting:
+ * - drops: number of receive queue overruns reported as ENOBUFS, each of them
+ *          standing for an unknown number of lost events ;
+ * - lost:  number of events found missing thanks to connector sequence
+ *          numbers, which kernel maintains on a per-CPU basis.
+ */
+struct nlink_proc {
+	struct nlink_sock      sock;
+	unsigned int           nr;
+	uint8_t               *buffs;
+	struct iovec          *iovs;
+	struct sockaddr_nl    *addrs;
+	struct mmsghdr        *msgs;
+	unsigned int           cpus_nr;
+	struct nlink_proc_cpu *cpus;
+	uint64_t               events;
+	uint64_t               lost;
+	uint64_t               drops;
+};
+
+/*
+ * Receive a batch of process events.
+ *
+ * Blocks till at least one datagram is available (unless socket is non
+ * blocking), then dequeues up to nr datagrams without blocking. Pointers to
+ * decoded events are stored into the events array and remain valid till the
+ * next call. Returns the number of events stored or a negative errno ;
+ * -ENOBUFS is accounted into drops and reported so that the caller may
+ * resynchronize, e.g. by scanning /proc once. An error carried by the
+ * subscription acknowledgment, e.g. -EPERM when kernel refused it, is returned
+ * as is: the stream will stay silent and should be closed.
+ */
+extern int
+nlink_proc_recv(struct nlink_proc        *proc,
+                const struct proc_event **events,
+                unsigned int              nr);
+
+extern int
+nlink_proc_open(struct nlink_proc *proc, unsigned int nr, int flags);
+
+extern void
+nlink_proc_close(struct nlink_proc *proc);
+
+#endif /* _NLINK_PROC_H */
@@ -0,0 +1,118 @@
+#ifndef _NLINK_RCU_H
+#define _NLINK_RCU_H
+
+#include <nlink/iface.h>
+#include <pthread.h>
+
+/*
+ * Immutable interface state snapshot.
+ *
+ * Records are sorted by increasing interface index. Once published, a
+ * snapshot is never modified: readers may use it without any locking till
+ * they leave their read-side critical section.
+ */
+struct nlink_rcu_snap {
+	struct nlink_rcu_snap  *next;
+	uint64_t                epoch;
+	unsigned int            cnt;
+	unsigned int            nr;
+	struct nlink_iface_rec  recs[];
+};
+
+extern const struct nlink_iface_rec *
+nlink_rcu_find(const struct nlink_rcu_snap *snap, int index);
+
+/*
+ * Reader thread state.
+ *
+ * epoch holds the global epoch observed when entering the current read-side
+ * critical section, 0 when quiescent.
+ */
+struct nlink_rcu_reader {
+	uint64_t                 epoch;
+	struct nlink_rcu_reader *next;
+};
+
+/*
+ * Copy-on-write interface state.
+ *
+ * A single writer applies updates to a private draft, then publishes it as the
+ * new current snapshot. Superseded snapshots are retired with the epoch they
+ * were replaced at and freed once no registered reader may still hold them,
+ * i.e. once all readers are either quiescent or entered their critical
+ * section at or after the retirement epoch.
+ */
+struct nlink_rcu {
+	struct nlink_rcu_snap   *curr;
+	uint64_t                 epoch;
+	struct nlink_rcu_snap   *draft;
+	struct nlink_rcu_snap   *retired;
+	struct nlink_rcu_reader *readers;
+	pthread_mutex_t          lock;
+};
+
+#define nlink_rcu_assert(_rcu) \
+	nlink_assert(_rcu); \
+	nlink_assert((_rcu)->curr); \
+	nlink_assert((_rcu)->epoch)
+
+/******************************************************************************
+ * Reader side
+ ******************************************************************************/
+
+static inline const struct nlink_rcu_snap *
+nlink_rcu_read_lock(struct nlink_rcu *rcu, struct nlink_rcu_reader *reader)
+{
+	nlink_rcu_assert(rcu);
+	nlink_assert(reader);
+	nlink_assert(!reader->epoch);
+
+	/*
+	 * Sequentially consistent ordering ensures the writer either sees our
+	 * epoch or we see the snapshot it published.
+	 */
+	__atomic_store_n(&reader->epoch,
+	                 __atomic_load_n(&rcu->epoch, __ATOMIC_SEQ_CST),
+	                 __ATOMIC_SEQ_CST);
+
+	return __atomic_load_n(&rcu->curr, __ATOMIC_SEQ_CST);
+}
+
+static inline void
+nlink_rcu_read_unlock(struct nlink_rcu_reader *reader)
+{
+	nlink_assert(reader);
+	nlink_assert(reader->epoch);
+
+	__atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+extern void
+nlink_rcu_register(struct nlink_rcu *rcu, struct nlink_rcu_reader *reader);
+
+extern void
+nlink_rcu_unregister(struct nlink_rcu *rcu, struct nlink_rcu_reader *reader);
+
+/******************************************************************************
+ * Writer side
+ ******************************************************************************/
+
+extern int
+nlink_rcu_update(struct nlink_rcu *rcu, const struct nlink_iface *iface);
+
+extern int
+nlink_rcu_remove(struct nlink_rcu *rcu, int index);
+
+extern int
+nlink_rcu_process_msg(struct nlink_rcu *rcu, const struct nlmsghdr *msg);
+
+extern void
+nlink_rcu_publish(struct nlink_rcu *rcu);
+
+extern int
+nlink_rcu_init(struct nlink_rcu *rcu, unsigned int nr);
+
+extern void
+nlink_rcu_fini(struct nlink_rcu *rcu);
+
+#endif /* _NLINK_RCU_H */
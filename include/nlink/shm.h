@@ -0,0 +1,134 @@
+#ifndef _NLINK_SHM_H
+#define _NLINK_SHM_H
+
+#include <nlink/iface.h>
+#include <errno.h>
+#include <time.h>
+
+#define NLINK_SHM_MAGIC   "NLSH"
+#define NLINK_SHM_VERSION (3U)
+
+/*
+ * Shared memory segment layout.
+ *
+ * A single publisher process maintains interface records sorted by increasing
+ * interface index. Read consistency relies upon a sequence lock: seq is odd
+ * while an update is in progress and incremented once again when complete.
+ * Readers copy what they need, then retry if seq changed meanwhile. seq also
+ * serves as a futex word readers may sleep on to get notified of changes.
+ *
+ * Sleeping readers register into waiters so that the publisher only issues a
+ * FUTEX_WAKE syscall when somebody sleeps. Readers lacking write access to the
+ * segment cannot register and poll seq every NLINK_SHM_POLL_NSEC instead.
+ *
+ * Once the publisher goes away, closed is set and all waiters are woken up so
+ * that readers notice they should reopen the segment (see -ESTALE below).
+ */
+struct nlink_shm_hdr {
+	char                   magic[4];
+	uint16_t               version;
+	uint16_t               rec_size;
+	uint32_t               nr;
+	uint32_t               seq;
+	uint32_t               cnt;
+	uint32_t               waiters;
+	uint32_t               closed;
+	uint32_t               pad;
+	struct nlink_iface_rec recs[];
+};
+
+#define NLINK_SHM_POLL_NSEC (10000000L)
+
+struct nlink_shm {
+	struct nlink_shm_hdr *hdr;
+	size_t                size;
+	/* Mapping is writable, i.e. waiters may be registered into. */
+	bool                  rw;
+};
+
+#define nlink_shm_assert(_shm) \
+	nlink_assert(_shm); \
+	nlink_assert((_shm)->hdr); \
+	nlink_assert((_shm)->hdr->nr); \
+	nlink_assert((_shm)->size >= sizeof(*(_shm)->hdr))
+
+/******************************************************************************
+ * Reader side
+ ******************************************************************************/
+
+/*
+ * Start a read section, storing the current sequence number into *seq.
+ *
+ * Returns -ESTALE when publisher closed the segment, in which case caller
+ * should close it and open it again.
+ */
+static inline int
+nlink_shm_read_begin(const struct nlink_shm *shm, uint32_t *seq)
+{
+	nlink_shm_assert(shm);
+	nlink_assert(seq);
+
+	/*
+	 * Updates are short: spin till publisher completes, unless it went away
+	 * in the middle of an update.
+	 */
+	do {
+		*seq = __atomic_load_n(&shm->hdr->seq, __ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&shm->hdr->closed, __ATOMIC_RELAXED))
+			return -ESTALE;
+	} while (*seq & 1);
+
+	return 0;
+}
+
+static inline bool
+nlink_shm_read_retry(const struct nlink_shm *shm, uint32_t seq)
+{
+	nlink_shm_assert(shm);
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&shm->hdr->seq, __ATOMIC_RELAXED) != seq;
+}
+
+extern int
+nlink_shm_find(const struct nlink_shm *shm,
+               int                     index,
+               struct nlink_iface_rec *rec);
+
+extern int
+nlink_shm_copy(const struct nlink_shm *shm,
+               struct nlink_iface_rec *recs,
+               unsigned int            nr);
+
+extern int
+nlink_shm_wait(const struct nlink_shm *shm,
+               uint32_t               *seq,
+               const struct timespec  *timeout);
+
+extern int
+nlink_shm_open(struct nlink_shm *shm, const char *name);
+
+extern void
+nlink_shm_close(struct nlink_shm *shm);
+
+/******************************************************************************
+ * Publisher side
+ ******************************************************************************/
+
+extern int
+nlink_shm_publish(struct nlink_shm *shm, const struct nlink_iface *iface);
+
+extern void
+nlink_shm_unpublish(struct nlink_shm *shm, int index);
+
+extern int
+nlink_shm_process_msg(struct nlink_shm *shm, const struct nlmsghdr *msg);
+
+extern int
+nlink_shm_create(struct nlink_shm *shm, const char *name, unsigned int nr);
+
+extern void
+nlink_shm_destroy(struct nlink_shm *shm, const char *name);
+
+#endif /* _NLINK_SHM_H */
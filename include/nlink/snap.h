@@ -0,0 +1,108 @@
+#ifndef _NLINK_SNAP_H
+#define _NLINK_SNAP_H
+
+#include <nlink/nlink.h>
+#include <utils/dlist.h>
+#include <pthread.h>
+
+enum nlink_snap_kind {
+	NLINK_SNAP_LINK_KIND,
+	NLINK_SNAP_ADDR_KIND,
+	NLINK_SNAP_ROUTE_KIND,
+	NLINK_SNAP_NEIGH_KIND,
+	NLINK_SNAP_KIND_NR
+};
+
+#define NLINK_SNAP_LINK  (1U << NLINK_SNAP_LINK_KIND)
+#define NLINK_SNAP_ADDR  (1U << NLINK_SNAP_ADDR_KIND)
+#define NLINK_SNAP_ROUTE (1U << NLINK_SNAP_ROUTE_KIND)
+#define NLINK_SNAP_NEIGH (1U << NLINK_SNAP_NEIGH_KIND)
+#define NLINK_SNAP_ALL   ((1U << NLINK_SNAP_KIND_NR) - 1)
+
+#define NLINK_SNAP_KEY_SIZE (48U)
+
+/*
+ * Snapshot object, i.e. a copy of the latest RTM_NEW* message describing it.
+ * Objects are identified by a key built from the message family specific
+ * header and identifying attributes (e.g. interface index, address and
+ * prefix length for addresses, table, destination, prefix length, TOS and
+ * priority for routes...).
+ */
+struct nlink_snap_obj {
+	struct dlist_node node;
+	struct dlist_node hash;
+	uint32_t          digest;
+	unsigned int      key_len;
+	uint8_t           key[NLINK_SNAP_KEY_SIZE];
+	struct nlmsghdr   msg[];
+};
+
+struct nlink_snap_tab {
+	enum nlink_snap_kind kind;
+	unsigned int         cnt;
+	unsigned int         nr;
+	struct dlist_node    objs;
+	struct dlist_node   *buckets;
+	struct nlink_sock    sock;
+	pthread_t            thread;
+	int                  err;
+};
+
+#define nlink_snap_foreach_obj(_tab, _obj) \
+	dlist_foreach_entry(&(_tab)->objs, _obj, node)
+
+/*
+ * Cold-start snapshot.
+ *
+ * Holds one socket per requested object kind. Each socket is subscribed to
+ * relevant multicast groups at initialization time, i.e. before dumping, so
+ * that no event may be lost between dump completion and subsequent
+ * monitoring. Once loaded, the caller should keep monitoring events thanks to
+ * these sockets and feed them to nlink_snap_process_msg().
+ */
+struct nlink_snap {
+	unsigned int          kinds;
+	struct nlink_snap_tab tabs[NLINK_SNAP_KIND_NR];
+};
+
+#define nlink_snap_assert(_snap) \
+	nlink_assert(_snap); \
+	nlink_assert((_snap)->kinds); \
+	nlink_assert(!((_snap)->kinds & ~NLINK_SNAP_ALL))
+
+static inline struct nlink_snap_tab *
+nlink_snap_tab(struct nlink_snap *snap, enum nlink_snap_kind kind)
+{
+	nlink_snap_assert(snap);
+	nlink_assert(kind < NLINK_SNAP_KIND_NR);
+	nlink_assert(snap->kinds & (1U << kind));
+
+	return &snap->tabs[kind];
+}
+
+static inline struct nlink_sock *
+nlink_snap_sock(struct nlink_snap *snap, enum nlink_snap_kind kind)
+{
+	return &nlink_snap_tab(snap, kind)->sock;
+}
+
+extern const struct nlmsghdr *
+nlink_snap_find(struct nlink_snap     *snap,
+                enum nlink_snap_kind   kind,
+                const struct nlmsghdr *msg);
+
+extern int
+nlink_snap_process_msg(struct nlink_snap     *snap,
+                       enum nlink_snap_kind   kind,
+                       const struct nlmsghdr *msg);
+
+extern int
+nlink_snap_load(struct nlink_snap *snap);
+
+extern int
+nlink_snap_init(struct nlink_snap *snap, unsigned int kinds, unsigned int nr);
+
+extern void
+nlink_snap_fini(struct nlink_snap *snap);
+
+#endif /* _NLINK_SNAP_H */
@@ -0,0 +1,96 @@
+#ifndef _NLINK_STORE_H
+#define _NLINK_STORE_H
+
+#include <nlink/iface.h>
+
+#define NLINK_STORE_MAGIC   "NLST"
+#define NLINK_STORE_VERSION (1U)
+
+#define NLINK_STORE_BOOT_ID_SIZE (40U)
+
+/*
+ * On-disk interface snapshot layout.
+ *
+ * Records are sorted by increasing interface index so that lookups may be
+ * performed by bisection straight from the mapped file. Snapshot is bound to
+ * the network namespace and boot it was saved from: interface indices are
+ * meaningless outside of these.
+ */
+struct nlink_store_hdr {
+	char                   magic[4];
+	uint16_t               version;
+	uint16_t               rec_size;
+	uint32_t               nr;
+	uint32_t               pad;
+	uint64_t               netns_dev;
+	uint64_t               netns_ino;
+	char                   boot_id[NLINK_STORE_BOOT_ID_SIZE];
+	uint64_t               sum;
+	struct nlink_iface_rec recs[];
+};
+
+struct nlink_store {
+	const struct nlink_store_hdr *hdr;
+	size_t                        size;
+};
+
+#define nlink_store_assert(_store) \
+	nlink_assert(_store); \
+	nlink_assert((_store)->hdr); \
+	nlink_assert((_store)->size >= sizeof(*(_store)->hdr))
+
+static inline unsigned int
+nlink_store_nr(const struct nlink_store *store)
+{
+	nlink_store_assert(store);
+
+	return store->hdr->nr;
+}
+
+static inline const struct nlink_iface_rec *
+nlink_store_recs(const struct nlink_store *store)
+{
+	nlink_store_assert(store);
+
+	return store->hdr->recs;
+}
+
+extern const struct nlink_iface_rec *
+nlink_store_find(const struct nlink_store *store, int index);
+
+/*
+ * Reconciliation callback.
+ *
+ * Given the snapshot record and the current state of an interface, called
+ * with:
+ * - old == NULL: interface created since snapshot was saved ;
+ * - curr == NULL: interface removed since snapshot was saved ;
+ * - otherwise: interface modified since snapshot was saved.
+ *
+ * Returning non zero aborts reconciliation.
+ */
+typedef int (nlink_store_reconcile_fn)(const struct nlink_iface_rec *old,
+                                       const struct nlink_iface_rec *curr,
+                                       void                         *data);
+
+extern int
+nlink_store_reconcile(const struct nlink_store *store,
+                      struct nlink_sock        *sock,
+                      nlink_store_reconcile_fn *reconcile,
+                      void                     *data);
+
+extern int
+nlink_store_save(const char                   *path,
+                 const struct nlink_iface_rec *recs,
+                 unsigned int                  nr);
+
+/* Verify records checksum at load time. */
+#define NLINK_STORE_FSCK (1 << 0)
+
+extern int
+nlink_store_load(struct nlink_store *store, const char *path, int flags);
+
+extern void
+nlink_store_unload(struct nlink_store *store);
+
+#endif /* _NLINK_STORE_H */
@@ -0,0 +1,138 @@
+#ifndef _NLINK_TC_H
+#define _NLINK_TC_H
+
+#include <nlink/nlink.h>
+#include <linux/rtnetlink.h>
+
+/*
+ * Traffic control object (qdisc or class) statistics as carried by
+ * RTM_NEWQDISC / RTM_NEWTCLASS messages nested TCA_STATS2 attribute.
+ * kind points into the message.
+ */
+struct nlink_tc_stats {
+	int         index;
+	uint32_t    handle;
+	uint32_t    parent;
+	const char *kind;
+	uint64_t    bytes;
+	uint64_t    packets;
+	uint32_t    qlen;
+	uint32_t    backlog;
+	uint32_t    drops;
+	uint32_t    requeues;
+	uint32_t    overlimits;
+};
+
+extern int
+nlink_tc_parse_msg(const struct nlmsghdr *msg, struct nlink_tc_stats *stats);
+
+extern void
+nlink_tc_setup_dump(struct nlmsghdr   *msg,
+                    struct nlink_sock *sock,
+                    uint16_t           type,
+                    int                index);
+
+struct nlink_tctab_slot {
+	uint32_t hash;
+	/* Row number plus one, 0 meaning empty slot. */
+	uint32_t row;
+};
+
+/*
+ * Columnar traffic control statistics table.
+ *
+ * Holds statistics of either qdiscs or classes (depending on the dump type
+ * given at initialization time), one row per (index, handle, parent) key.
+ * Rows are updated in place from dump records, computing deltas against the
+ * previous sample on the fly so that a sampling period costs a single pass
+ * over dumped records.
+ *
+ * A sample starts with nlink_tctab_begin(), goes on with as many
+ * nlink_tctab_collect() calls as needed (one per interface or a single
+ * unfiltered one) and ends with nlink_tctab_sweep() which removes rows
+ * missing from the sample. Deltas of rows created during a sample are zero.
+ *
+ * Rows are kept packed: removing a row moves the last one into its place.
+ * Hence row numbers are not stable across sweeps.
+ */
+struct nlink_tctab {
+	unsigned int             cnt;
+	unsigned int             nr;
+	uint16_t                 type;
+	uint32_t                 gen;
+	/* Key columns. */
+	int32_t                 *index;
+	uint32_t                *handle;
+	uint32_t                *parent;
+	uint32_t                *seen;
+	/* Gauges. */
+	uint32_t                *qlen;
+	uint32_t                *backlog;
+	/* Cumulative counters. */
+	uint64_t                *bytes;
+	uint64_t                *packets;
+	uint32_t                *drops;
+	uint32_t                *requeues;
+	uint32_t                *overlimits;
+	/* Counter deltas since previous sample. */
+	uint64_t                *bytes_delta;
+	uint64_t                *packets_delta;
+	uint32_t                *drops_delta;
+	uint32_t                *requeues_delta;
+	uint32_t                *overlimits_delta;
+	/* Key to row map. */
+	unsigned int             map_mask;
+	struct nlink_tctab_slot *map;
+	void                    *mem;
+};
+
+#define nlink_tctab_assert(_tab) \
+	nlink_assert(_tab); \
+	nlink_assert((_tab)->nr); \
+	nlink_assert((_tab)->cnt <= (_tab)->nr); \
+	nlink_assert(((_tab)->type == RTM_GETQDISC) || \
+	             ((_tab)->type == RTM_GETTCLASS)); \
+	nlink_assert((_tab)->mem)
+
+static inline unsigned int
+nlink_tctab_count(const struct nlink_tctab *tab)
+{
+	nlink_tctab_assert(tab);
+
+	return tab->cnt;
+}
+
+extern int
+nlink_tctab_find(const struct nlink_tctab *tab,
+                 int                       index,
+                 uint32_t                  handle,
+                 uint32_t                  parent);
+
+extern int
+nlink_tctab_update(struct nlink_tctab          *tab,
+                   const struct nlink_tc_stats *stats);
+
+static inline void
+nlink_tctab_begin(struct nlink_tctab *tab)
+{
+	nlink_tctab_assert(tab);
+
+	tab->gen++;
+}
+
+extern unsigned int
+nlink_tctab_sweep(struct nlink_tctab *tab);
+
+extern int
+nlink_tctab_collect(struct nlink_tctab *tab,
+                    struct nlink_sock  *sock,
+                    struct nlmsghdr    *msg,
+                    int                 index);
+
+extern int
+nlink_tctab_init(struct nlink_tctab *tab, uint16_t type, unsigned int nr);
+
+extern void
+nlink_tctab_fini(const struct nlink_tctab *tab);
+
+#endif /* _NLINK_TC_H */
@@ -0,0 +1,95 @@
+#ifndef _NLINK_TOPO_H
+#define _NLINK_TOPO_H
+
+#include <nlink/iface.h>
+#include <utils/dlist.h>
+
+/*
+ * Interface topology node.
+ *
+ * A node is created for each interface notified thanks to RTM_NEWLINK and for
+ * each master / link interface referenced by another node before it has been
+ * notified itself. The latter are "placeholder" nodes, i.e. with present field
+ * set to false ; they are released as soon as their last referencing node
+ * goes away.
+ *
+ * Relations maintained:
+ * - ports:  list of nodes enslaved to this node (IFLA_MASTER), e.g. bridge or
+ *           bond ports ;
+ * - uppers: list of nodes stacked onto this node (IFLA_LINK), e.g. vlan or
+ *           macvlan devices ;
+ * - master: node this node is enslaved to ;
+ * - link:   node this node is stacked onto.
+ *
+ * IFLA_LINK of interfaces whose lower device lives into another network
+ * namespace (veth peers, macvlan, ipvlan...) refers to a foreign interface
+ * index: such links are flagged by IFLA_LINK_NETNSID and ignored.
+ */
+struct nlink_topo_node {
+	struct dlist_node       hash;
+	int                     index;
+	bool                    present;
+	struct nlink_topo_node *master;
+	struct dlist_node       port;
+	struct dlist_node       ports;
+	struct nlink_topo_node *link;
+	struct dlist_node       upper;
+	struct dlist_node       uppers;
+};
+
+#define nlink_topo_foreach_port(_node, _port) \
+	dlist_foreach_entry(&(_node)->ports, _port, port)
+
+#define nlink_topo_foreach_upper(_node, _upper) \
+	dlist_foreach_entry(&(_node)->uppers, _upper, upper)
+
+static inline bool
+nlink_topo_node_has_ports(const struct nlink_topo_node *node)
+{
+	nlink_assert(node);
+
+	return !dlist_empty(&node->ports);
+}
+
+static inline bool
+nlink_topo_node_has_uppers(const struct nlink_topo_node *node)
+{
+	nlink_assert(node);
+
+	return !dlist_empty(&node->uppers);
+}
+
+struct nlink_topo {
+	unsigned int       cnt;
+	unsigned int       nr;
+	struct dlist_node *buckets;
+};
+
+#define nlink_topo_assert(_topo) \
+	nlink_assert(_topo); \
+	nlink_assert((_topo)->nr); \
+	nlink_assert((_topo)->buckets)
+
+extern struct nlink_topo_node *
+nlink_topo_find(const struct nlink_topo *topo, int index);
+
+extern const struct nlink_topo_node *
+nlink_topo_root(const struct nlink_topo      *topo,
+                const struct nlink_topo_node *node);
+
+extern int
+nlink_topo_update(struct nlink_topo *topo, const struct nlink_iface *iface);
+
+extern void
+nlink_topo_remove(struct nlink_topo *topo, int index);
+
+extern int
+nlink_topo_process_msg(struct nlink_topo *topo, const struct nlmsghdr *msg);
+
+extern int
+nlink_topo_init(struct nlink_topo *topo, unsigned int nr);
+
+extern void
+nlink_topo_fini(struct nlink_topo *topo);
+
+#endif /* _NLINK_TOPO_H */
@@ -0,0 +1,131 @@
+#ifndef _NLINK_TRACE_H
+#define _NLINK_TRACE_H
+
+#include <nlink/nlink.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Binary trace record: raw netlink message header fields plus a
+ * CLOCK_MONOTONIC timestamp expressed in nanoseconds.
+ */
+struct nlink_trace_rec {
+	uint64_t tstamp;
+	uint32_t pid;
+	uint32_t seq;
+	uint32_t len;
+	uint16_t type;
+	uint16_t flags;
+};
+
+/*
+ * Per-thread flight recorder ring.
+ *
+ * Only the thread the ring is attached to writes into it ; head is published
+ * with release semantics once a record is complete so that another thread (or
+ * a signal handler) may dump the ring at any time without locking. Oldest
+ * records are silently overwritten once the ring is full.
+ */
+struct nlink_trace_ring {
+	unsigned long          head;
+	unsigned int           mask;
+	struct nlink_trace_rec recs[];
+};
+
+#define nlink_trace_assert_ring(_ring) \
+	nlink_assert(_ring); \
+	nlink_assert((_ring)->mask); \
+	nlink_assert(!(((_ring)->mask + 1) & (_ring)->mask))
+
+extern __thread struct nlink_trace_ring *nlink_trace_curr;
+
+static inline void
+nlink_trace_record(struct nlink_trace_ring *ring, const struct nlmsghdr *msg)
+{
+	nlink_trace_assert_ring(ring);
+	nlink_assert(msg);
+
+	unsigned long           head = ring->head;
+	struct nlink_trace_rec *rec = &ring->recs[head & ring->mask];
+	struct timespec         now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	rec->tstamp = ((uint64_t)now.tv_sec * 1000000000ULL) +
+	              (uint64_t)now.tv_nsec;
+	rec->pid = msg->nlmsg_pid;
+	rec->seq = msg->nlmsg_seq;
+	rec->len = msg->nlmsg_len;
+	rec->type = msg->nlmsg_type;
+	rec->flags = msg->nlmsg_flags;
+
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Record header of the given message into the ring attached to the calling
+ * thread, if any.
+ */
+static inline void
+nlink_trace_msg(const struct nlmsghdr *msg)
+{
+	struct nlink_trace_ring *ring = nlink_trace_curr;
+
+	if (ring)
+		nlink_trace_record(ring, msg);
+}
+
+/*
+ * Record headers of all messages contained into the given datagram into the
+ * ring attached to the calling thread, if any.
+ */
+static inline void
+nlink_trace_dgram(const struct nlmsghdr *msg, size_t size)
+{
+	struct nlink_trace_ring *ring = nlink_trace_curr;
+	int                      bytes = (int)size;
+
+	if (!ring)
+		return;
+
+	while (mnl_nlmsg_ok(msg, bytes)) {
+		nlink_trace_record(ring, msg);
+		msg = mnl_nlmsg_next(msg, &bytes);
+	}
+}
+
+extern void
+nlink_trace_sprint_rec(char                          string[NLINK_SPRINT_MSG_SIZE],
+                       const struct nlink_trace_rec *rec);
+
+#define NLINK_TRACE_MAGIC   "NLTR"
+#define NLINK_TRACE_VERSION (1U)
+
+/*
+ * Trace dump file header, followed by nr records ordered from oldest to most
+ * recent. Records with a null len were overwritten while dumping and carry no
+ * meaningful content.
+ */
+struct nlink_trace_file {
+	char     magic[4];
+	uint16_t version;
+	uint16_t rec_size;
+	uint32_t nr;
+	uint32_t pad;
+	int64_t  real_offset;
+	uint64_t lost;
+};
+
+extern int
+nlink_trace_dump_ring(const struct nlink_trace_ring *ring, int fd);
+
+extern struct nlink_trace_ring *
+nlink_trace_attach_ring(struct nlink_trace_ring *ring);
+
+extern struct nlink_trace_ring *
+nlink_trace_create_ring(unsigned int order);
+
+extern void
+nlink_trace_destroy_ring(struct nlink_trace_ring *ring);
+
+#endif /* _NLINK_TRACE_H */
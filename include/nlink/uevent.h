@@ -0,0 +1,97 @@
+#ifndef _NLINK_UEVENT_H
+#define _NLINK_UEVENT_H
+
+#include <nlink/nlink.h>
+#include <string.h>
+
+/*
+ * Kernel uevent datagrams are at most UEVENT_BUFFER_SIZE (2048) bytes of
+ * environment plus the ACTION@DEVPATH header string.
+ */
+#define NLINK_UEVENT_MSG_SIZE (8192U)
+
+/* Multicast group kernel sends uevents to (group 2 is used by udevd). */
+#define NLINK_UEVENT_KERNEL_GROUP (1)
+
+/* Common keys, indexed at parsing time. */
+enum nlink_uevent_key {
+	NLINK_UEVENT_ACTION_KEY,
+	NLINK_UEVENT_DEVPATH_KEY,
+	NLINK_UEVENT_SUBSYSTEM_KEY,
+	NLINK_UEVENT_INTERFACE_KEY,
+	NLINK_UEVENT_IFINDEX_KEY,
+	NLINK_UEVENT_SEQNUM_KEY,
+	NLINK_UEVENT_KEY_NR
+};
+
+/* Value slice pointing into the received datagram, not NUL terminated. */
+struct nlink_uevent_slice {
+	const char   *str;
+	unsigned int  len;
+};
+
+/*
+ * Parsed uevent.
+ *
+ * Values of common keys are available through vals[] without any copy, with
+ * a NULL str when the key is missing. Other variables may be looked up using
+ * nlink_uevent_get(). All slices remain valid as long as the datagram buffer
+ * is not reused.
+ */
+struct nlink_uevent {
+	struct nlink_uevent_slice  vals[NLINK_UEVENT_KEY_NR];
+	const char                *vars;
+	size_t                     size;
+};
+
+static inline bool
+nlink_uevent_val_is(const struct nlink_uevent *event,
+                    enum nlink_uevent_key      key,
+                    const char                *str,
+                    size_t                     len)
+{
+	nlink_assert(event);
+	nlink_assert(key < NLINK_UEVENT_KEY_NR);
+	nlink_assert(str);
+
+	const struct nlink_uevent_slice *val = &event->vals[key];
+
+	return val->str && (val->len == len) && !memcmp(val->str, str, len);
+}
+
+extern int
+nlink_uevent_parse(const char *buff, size_t size, struct nlink_uevent *event);
+
+extern const char *
+nlink_uevent_get(const struct nlink_uevent *event,
+                 const char                *key,
+                 size_t                     key_len,
+                 size_t                    *val_len);
+
+extern ssize_t
+nlink_uevent_recv(const struct nlink_sock *sock, char *buff, size_t size);
+
+extern int
+nlink_open_uevent_sock(struct nlink_sock *sock, int flags);
+
+#if defined(CONFIG_NLINK_FILTER)
+
+#include <linux/filter.h>
+
+/*
+ * Largest ACTION@DEVPATH header string length the subsystem filter looks for
+ * SUBSYSTEM past. Uevents with longer headers are passed to user space
+ * unconditionally.
+ */
+#define NLINK_UEVENT_FILTER_SCAN_MAX (512U)
+
+extern int
+nlink_uevent_filter_compile(const char        *subsys,
+                            struct sock_fprog *prog);
+
+extern int
+nlink_uevent_attach_filter(const struct nlink_sock *sock, const char *subsys);
+
+#endif /* defined(CONFIG_NLINK_FILTER) */
+
+#endif /* _NLINK_UEVENT_H */
@@ -17,19 +17,73 @@ struct nlink_work {
 	struct dlist_node      node;
 	enum nlink_work_state  state;
 	uint32_t               seqno;
+	/* Scheduling time, 0 unless adaptive flow control is enabled. */
+	uint64_t               tstamp;
 };
 
+/*
+ * Adaptive flow control state, see nlink_win_adapt().
+ *
+ * ACK latencies are compared to a base latency, i.e. the lowest latency
+ * observed over the last NLINK_WIN_BASE_EPOCH ACKs, and to
+ * NLINK_WIN_LATENCY_FLOOR_NSEC, whichever is larger.
+ */
+struct nlink_win_flow {
+	/* Lower limit, 0 meaning adaptive flow control disabled. */
+	unsigned int min;
+	/* Slow start threshold. */
+	unsigned int thresh;
+	/* ACKs accumulated toward next additive increase. */
+	unsigned int acks;
+	/* ACKs to wait for before reacting to congestion again. */
+	unsigned int hold;
+	unsigned int epoch;
+	/* Enabling time: works scheduled before are not sampled. */
+	uint64_t     start;
+	uint64_t     base;
+	uint64_t     epoch_min;
+	uint64_t     srtt;
+	/* Statistics. */
+	uint64_t     grows;
+	uint64_t     shrinks;
+};
+
+/*
+ * Growing is allowed while smoothed ACK latency is below this factor of base
+ * latency.
+ */
+#define NLINK_WIN_LOW_LATENCY_FACTOR (2U)
+
+/* An ACK latency above this factor of base latency is a spike. */
+#define NLINK_WIN_SPIKE_FACTOR       (8U)
+
+#define NLINK_WIN_LATENCY_FLOOR_NSEC (100000ULL)
+
+#define NLINK_WIN_BASE_EPOCH         (1024U)
+
+/*
+ * In-flight request window.
+ *
+ * nr is the window capacity, fixed at initialization time. lim is the number
+ * of requests allowed in flight, equal to nr unless adaptive flow control is
+ * enabled. Callers should check nlink_win_is_open() before scheduling a new
+ * request.
+ */
 struct nlink_win {
-	unsigned int       cnt;
-	unsigned int       nr;
-	struct dlist_node *pend;
-	struct dlist_node  free;
+	unsigned int           cnt;
+	unsigned int           nr;
+	unsigned int           lim;
+	struct nlink_win_flow  flow;
+	struct dlist_node     *pend;
+	struct dlist_node      free;
 };
 
 #define nlink_win_assert(_win) \
 	nlink_assert(_win); \
 	nlink_assert((_win)->nr); \
 	nlink_assert((_win)->cnt <= (_win)->nr); \
+	nlink_assert((_win)->lim); \
+	nlink_assert((_win)->lim <= (_win)->nr); \
 	nlink_assert((_win)->pend)
 
 static inline bool
@@ -40,6 +94,22 @@ nlink_win_has_work(const struct nlink_win *win)
 	return !!win->cnt;
 }
 
+static inline bool
+nlink_win_is_open(const struct nlink_win *win)
+{
+	nlink_win_assert(win);
+
+	return win->cnt < win->lim;
+}
+
+static inline unsigned int
+nlink_win_limit(const struct nlink_win *win)
+{
+	nlink_win_assert(win);
+
+	return win->lim;
+}
+
 extern struct nlink_work *
 nlink_win_acquire_work(struct nlink_win *win);
 
@@ -57,6 +127,9 @@ nlink_win_resched_work(struct nlink_win *win, struct nlink_work *work)
 	nlink_win_sched_work(win, work, work->seqno);
 }
 
+extern struct nlink_work *
+nlink_win_find_work(const struct nlink_win *win, uint32_t seqno);
+
 extern struct nlink_work *
 nlink_win_pull_work(struct nlink_win *win, uint32_t seqno);
 
@@ -69,10 +142,102 @@ nlink_win_drain_work(struct nlink_win *win, unsigned int *slot);
 extern void
 nlink_win_register_work(struct nlink_win *win, struct nlink_work *work);
 
+extern void
+nlink_win_backoff(struct nlink_win *win);
+
+extern void
+nlink_win_adapt(struct nlink_win *win, unsigned int min);
+
 extern int
 nlink_win_init(struct nlink_win *win, unsigned int nr);
 
 extern void
 nlink_win_fini(const struct nlink_win *win);
 
+extern void
+nlink_win_fini_embedded(const struct nlink_win *win);
+
+/******************************************************************************
+ * Request collapsing
+ ******************************************************************************/
+
+/*
+ * Staging queue of requests not sent yet, keyed by (interface index,
+ * attribute).
+ *
+ * Staging a request while another one with the same key is still queued
+ * folds the older one into the newer: the newer takes the older's place into
+ * the queue so that ordering with respect to other keys is preserved, and the
+ * older is chained onto the newer's folded list. Only the newer request is
+ * eventually sent ; once its outcome is known, folded requests should be
+ * completed with the same result thanks to nlink_coll_pop_folded().
+ *
+ * attr is an opaque identifier, typically an IFLA_* attribute type ; callers
+ * pick their own identifiers for fields not carried as attributes, e.g.
+ * interface admin state. Requests sharing a key must be idempotent, i.e. only
+ * the last staged value matters.
+ *
+ * Requests are meant to be embedded into caller contexts along with a
+ * struct nlink_work tracking them once sent.
+ */
+struct nlink_coll_req {
+	struct dlist_node fifo;
+	struct dlist_node chain;
+	struct dlist_node folded;
+	int               index;
+	unsigned int      attr;
+	uint32_t          value;
+};
+
+struct nlink_coll {
+	unsigned int       cnt;
+	unsigned int       nr;
+	unsigned int       folds;
+	struct dlist_node  fifo;
+	struct dlist_node *chains;
+};
+
+#define nlink_coll_assert(_coll) \
+	nlink_assert(_coll); \
+	nlink_assert((_coll)->nr); \
+	nlink_assert((_coll)->chains)
+
+static inline bool
+nlink_coll_has_req(const struct nlink_coll *coll)
+{
+	nlink_coll_assert(coll);
+
+	return !!coll->cnt;
+}
+
+static inline void
+nlink_coll_init_req(struct nlink_coll_req *req,
+                    int                    index,
+                    unsigned int           attr,
+                    uint32_t               value)
+{
+	nlink_assert(req);
+	nlink_assert(index > 0);
+
+	dlist_init(&req->folded);
+	req->index = index;
+	req->attr = attr;
+	req->value = value;
+}
+
+extern struct nlink_coll_req *
+nlink_coll_stage(struct nlink_coll *coll, struct nlink_coll_req *req);
+
+extern struct nlink_coll_req *
+nlink_coll_unstage(struct nlink_coll *coll);
+
+extern struct nlink_coll_req *
+nlink_coll_pop_folded(struct nlink_coll_req *req);
+
+extern int
+nlink_coll_init(struct nlink_coll *coll, unsigned int nr);
+
+extern void
+nlink_coll_fini(const struct nlink_coll *coll);
+
 #endif /* _NLINK_WORK_H */
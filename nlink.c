@@ -3,6 +3,29 @@
 #include <time.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/socket.h>
+
+#if defined(CONFIG_NLINK_QSTATS)
+#include <linux/sock_diag.h>
+#endif /* defined(CONFIG_NLINK_QSTATS) */
+
+#if defined(CONFIG_NLINK_NSID)
+#include <linux/net_namespace.h>
+#endif /* defined(CONFIG_NLINK_NSID) */
+
+#if defined(CONFIG_NLINK_TRACE)
+#include <nlink/trace.h>
+#else  /* !defined(CONFIG_NLINK_TRACE) */
+#define nlink_trace_msg(_msg)
+#define nlink_trace_dgram(_msg, _size)
+#endif /* defined(CONFIG_NLINK_TRACE) */
+
+#if defined(CONFIG_NLINK_PCAP)
+#include <nlink/pcap.h>
+#else  /* !defined(CONFIG_NLINK_PCAP) */
+#define nlink_pcap_msg(_sock, _msg)
+#define nlink_pcap_dgram(_sock, _msg, _size)
+#endif /* defined(CONFIG_NLINK_PCAP) */
 
 /******************************************************************************
  * Netlink message handling
@@ -90,10 +113,13 @@ nlink_parse_msg(const struct nlmsghdr *msg,
 	nlink_assert(mnl_nlmsg_ok(msg, (int)size));
 	nlink_assert(parse);
 
-	int bytes = size;
-	int ret;
+	int  bytes = size;
+	bool multi;
+	int  ret;
 
 	do {
+		multi = !!(msg->nlmsg_flags & NLM_F_MULTI);
+
 		ret = nlink_parse_msg_head(msg);
 		switch (ret) {
 		case 0:
@@ -140,8 +166,10 @@ nlink_parse_msg(const struct nlmsghdr *msg,
 	 * has not yet been processed.
 	 * This allows the caller to wait for the next datagram to keep parsing
 	 * the current multipart message sequence.
+	 * Note that msg points past the end of datagram at this point: rely on
+	 * flags of the last message processed.
 	 */
-	return (ret || !(msg->nlmsg_flags & NLM_F_MULTI)) ? ret : -EINPROGRESS;
+	return (ret || !multi) ? ret : -EINPROGRESS;
 }
 
 void
@@ -165,6 +193,120 @@ nlink_sprint_msg(char                   string[NLINK_SPRINT_MSG_SIZE],
 	         msg->nlmsg_len);
 }
 
+/******************************************************************************
+ * Netlink socket receive queue statistics
+ ******************************************************************************/
+
+#if defined(CONFIG_NLINK_QSTATS)
+
+static void
+nlink_sample_qstats(const struct nlink_sock *sock, size_t size)
+{
+	nlink_assert_sock(sock);
+
+	struct nlink_qstats *stats = sock->qstats;
+	uint32_t             info[SK_MEMINFO_VARS];
+	socklen_t            len = sizeof(info);
+	struct timespec      now;
+	uint32_t             backlog;
+	unsigned int         b;
+
+	if (!stats)
+		return;
+
+	if (getsockopt(mnl_socket_get_fd(sock->mnl),
+	               SOL_SOCKET,
+	               SO_MEMINFO,
+	               info,
+	               &len)) {
+		nlink_assert(errno != EBADF);
+		nlink_assert(errno != EFAULT);
+		nlink_assert(errno != EINVAL);
+		nlink_assert(errno != ENOTSOCK);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	backlog = info[SK_MEMINFO_RMEM_ALLOC];
+	b = backlog ? (32U - (unsigned int)__builtin_clz(backlog)) : 0;
+	if (b >= NLINK_QSTATS_HIST_NR)
+		b = NLINK_QSTATS_HIST_NR - 1;
+
+	stats->last = ((uint64_t)now.tv_sec * 1000000000ULL) +
+	              (uint64_t)now.tv_nsec;
+	if (!stats->cnt)
+		stats->start = stats->last;
+	stats->cnt++;
+	stats->bytes += size;
+	stats->backlog += backlog;
+	if (backlog > stats->max)
+		stats->max = backlog;
+	stats->rcvbuf = info[SK_MEMINFO_RCVBUF];
+	stats->drops = info[SK_MEMINFO_DROPS];
+	stats->hist[b]++;
+}
+
+/*
+ * Return mean receive queueing delay in nanoseconds, i.e. mean backlog divided
+ * by mean receive throughput.
+ */
+uint64_t
+nlink_qstats_mean_delay(const struct nlink_qstats *stats)
+{
+	nlink_assert(stats);
+
+	if (!stats->bytes || (stats->last <= stats->start))
+		return 0;
+
+	return (uint64_t)(((double)stats->backlog *
+	                   (double)(stats->last - stats->start)) /
+	                  ((double)stats->cnt * (double)stats->bytes));
+}
+
+/*
+ * Return upper bound of the backlog histogram bucket holding the given
+ * percentile (expressed in per mille).
+ */
+uint32_t
+nlink_qstats_backlog_pct(const struct nlink_qstats *stats, unsigned int permil)
+{
+	nlink_assert(stats);
+	nlink_assert(permil <= 1000);
+
+	uint64_t     thres = ((stats->cnt * permil) + 999) / 1000;
+	uint64_t     cnt = 0;
+	unsigned int b;
+
+	for (b = 0; b < NLINK_QSTATS_HIST_NR; b++) {
+		cnt += stats->hist[b];
+		if (cnt && (cnt >= thres))
+			break;
+	}
+
+	if (!b)
+		return 0;
+
+	if ((b >= NLINK_QSTATS_HIST_NR) || (((1ULL << b) - 1) > stats->max))
+		return stats->max;
+
+	return (uint32_t)((1ULL << b) - 1);
+}
+
+void
+nlink_qstats_reset(struct nlink_qstats *stats)
+{
+	nlink_assert(stats);
+
+	memset(stats, 0, sizeof(*stats));
+}
+
+#else  /* !defined(CONFIG_NLINK_QSTATS) */
+
+#define nlink_sample_qstats(_sock, _size)
+
+#endif /* defined(CONFIG_NLINK_QSTATS) */
+
 /******************************************************************************
  * Netlink socket handling
  ******************************************************************************/
@@ -213,25 +355,32 @@ nlink_send_msg(const struct nlink_sock *sock, const struct nlmsghdr *msg)
 	 */
 	nlink_assert((size_t)ret == len);
 
+	nlink_trace_msg(msg);
+	nlink_pcap_msg(sock, msg);
+
 	return 0;
 }
 
-ssize_t
-nlink_recv_msg(const struct nlink_sock *sock, struct nlmsghdr *msg)
+static ssize_t
+nlink_recv_dgram(const struct nlink_sock *sock,
+                 struct nlmsghdr         *msg,
+                 struct msghdr           *hdr,
+                 int                      flags)
 {
 	nlink_assert_sock(sock);
 	nlink_assert(msg);
+	nlink_assert(hdr);
 
-	ssize_t ret;
+	const struct sockaddr_nl *addr = hdr->msg_name;
+	ssize_t                   ret;
 
-	ret = mnl_socket_recvfrom(sock->mnl, msg, NLINK_XFER_MSG_SIZE);
+	ret = recvmsg(mnl_socket_get_fd(sock->mnl), hdr, flags);
 	if (ret < 0) {
 		nlink_assert(errno != EBADF);
 		nlink_assert(errno != EFAULT);
 		nlink_assert(errno != EINVAL);
 		nlink_assert(errno != ENOTCONN);
 		nlink_assert(errno != ENOTSOCK);
-		nlink_assert(errno != ENOSPC);
 
 		/*
 		 * Possible return code:
@@ -239,22 +388,511 @@ nlink_recv_msg(const struct nlink_sock *sock, struct nlmsghdr *msg)
 		 * - ECONNREFUSED: remote peer refused connection
 		 * - EINTR:        interrupted by a signal before data were
 		 *                 available for receival
+		 * - ENOBUFS:      receive queue overrun, messages were lost
 		 * - ENOMEM:       memory allocation failed
 		 */
 		return -errno;
 	}
 
 	nlink_assert(ret);
+	nlink_assert(hdr->msg_namelen == sizeof(*addr));
+
+	/*
+	 * Datagram larger than the receive buffer, e.g. a RTM_NEWLINK
+	 * notification of an interface carrying many VFs: its trailing part
+	 * has been discarded by kernel.
+	 */
+	if (hdr->msg_flags & MSG_TRUNC)
+		return -EMSGSIZE;
 
 	if (!mnl_nlmsg_ok(msg, ret))
 		return -EBADMSG;
 
-	if (!mnl_nlmsg_portid_ok(msg, sock->port_id))
+	/*
+	 * Multicast notifications carry the port id of the requester that
+	 * triggered them: check port id of unicast datagrams only.
+	 */
+	if (!addr->nl_groups && !mnl_nlmsg_portid_ok(msg, sock->port_id))
 		return -ESRCH;
 
+	nlink_sample_qstats(sock, (size_t)ret);
+	nlink_trace_dgram(msg, ret);
+	nlink_pcap_dgram(sock, msg, (size_t)ret);
+
 	return ret;
 }
 
+ssize_t
+nlink_recv_msg(const struct nlink_sock *sock, struct nlmsghdr *msg)
+{
+	struct sockaddr_nl addr;
+	struct iovec       iov = {
+		.iov_base = msg,
+		.iov_len  = NLINK_XFER_MSG_SIZE
+	};
+	struct msghdr      hdr = {
+		.msg_name    = &addr,
+		.msg_namelen = sizeof(addr),
+		.msg_iov     = &iov,
+		.msg_iovlen  = 1
+	};
+
+	return nlink_recv_dgram(sock, msg, &hdr, 0);
+}
+
+static int
+nlink_resize_rbuf(struct nlink_rbuf *rbuf, size_t size)
+{
+	struct nlmsghdr *msg;
+
+	/* Content is about to be overwritten: don't bother copying it. */
+	msg = malloc(size);
+	if (!msg)
+		return -errno;
+
+	free(rbuf->msg);
+	rbuf->msg = msg;
+	rbuf->size = size;
+	rbuf->small = 0;
+
+	return 0;
+}
+
+/*
+ * Receive a datagram into an adaptive receive buffer.
+ *
+ * Datagram length and header are first peeked thanks to a MSG_PEEK | MSG_TRUNC
+ * probe. Buffer is grown to the next power of 2 fitting the datagram if
+ * needed, and at least to NLINK_XFER_MSG_SIZE for multipart dump replies:
+ * kernel sizes dump datagrams according to the largest buffer given to
+ * recvmsg() so far, so that remaining dump parts get packed into as few
+ * datagrams as possible.
+ *
+ * This costs one additional syscall per datagram ; sockets dedicated to dumps
+ * should stick to nlink_recv_msg() and a NLINK_XFER_MSG_SIZE sized buffer.
+ */
+ssize_t
+nlink_recv_rbuf(const struct nlink_sock *sock, struct nlink_rbuf *rbuf)
+{
+	nlink_assert_sock(sock);
+	nlink_assert(rbuf);
+	nlink_assert(rbuf->msg);
+	nlink_assert(rbuf->size >= NLINK_RBUF_MIN_SIZE);
+
+	struct sockaddr_nl addr;
+	struct iovec       iov = {
+		.iov_base = rbuf->msg,
+		.iov_len  = sizeof(*rbuf->msg)
+	};
+	struct msghdr      hdr = {
+		.msg_name    = &addr,
+		.msg_namelen = sizeof(addr),
+		.msg_iov     = &iov,
+		.msg_iovlen  = 1
+	};
+	size_t             size = rbuf->size;
+	ssize_t            ret;
+
+	ret = recvmsg(mnl_socket_get_fd(sock->mnl),
+	              &hdr,
+	              MSG_PEEK | MSG_TRUNC);
+	if (ret < 0) {
+		nlink_assert(errno != EBADF);
+		nlink_assert(errno != EFAULT);
+		nlink_assert(errno != EINVAL);
+		nlink_assert(errno != ENOTCONN);
+		nlink_assert(errno != ENOTSOCK);
+
+		return -errno;
+	}
+
+	if (((size_t)ret >= sizeof(*rbuf->msg)) &&
+	    (rbuf->msg->nlmsg_flags & NLM_F_MULTI)) {
+		if (size < NLINK_XFER_MSG_SIZE)
+			size = NLINK_XFER_MSG_SIZE;
+		rbuf->small = 0;
+	}
+	else if ((size_t)ret <= (size / 4)) {
+		if ((size > NLINK_RBUF_MIN_SIZE) &&
+		    (++rbuf->small >= NLINK_RBUF_SHRINK_NR))
+			size /= 2;
+	}
+	else
+		rbuf->small = 0;
+
+	while (size < (size_t)ret)
+		size *= 2;
+
+	if (size != rbuf->size) {
+		int err;
+
+		err = nlink_resize_rbuf(rbuf, size);
+		if (err)
+			return err;
+	}
+
+	iov.iov_base = rbuf->msg;
+	iov.iov_len = rbuf->size;
+	hdr.msg_namelen = sizeof(addr);
+
+	return nlink_recv_dgram(sock, rbuf->msg, &hdr, 0);
+}
+
+int
+nlink_init_rbuf(struct nlink_rbuf *rbuf)
+{
+	nlink_assert(rbuf);
+
+	rbuf->msg = malloc(NLINK_RBUF_MIN_SIZE);
+	if (!rbuf->msg)
+		return -errno;
+
+	rbuf->size = NLINK_RBUF_MIN_SIZE;
+	rbuf->small = 0;
+
+	return 0;
+}
+
+void
+nlink_fini_rbuf(const struct nlink_rbuf *rbuf)
+{
+	nlink_assert(rbuf);
+	nlink_assert(rbuf->msg);
+
+	free(rbuf->msg);
+}
+
+/*
+ * Return messages of current datagram not processed yet, receiving a new
+ * datagram without blocking once the current one is exhausted. Returns
+ * -EAGAIN when no data are pending.
+ *
+ * Messages processed out of the returned range should be acknowledged using
+ * nlink_poll_commit() so that batch parsers (e.g. nlink_iface_parse_batch())
+ * may stop in the middle of a datagram and resume at next fetch.
+ */
+int
+nlink_poll_fetch(struct nlink_poll       *poll,
+                 const struct nlink_sock *sock,
+                 const struct nlmsghdr  **msg,
+                 int                     *bytes)
+{
+	nlink_assert(poll);
+	nlink_assert(poll->buff);
+	nlink_assert_sock(sock);
+	nlink_assert(msg);
+	nlink_assert(bytes);
+
+	while (!nlink_poll_pending(poll)) {
+		struct sockaddr_nl addr;
+		struct iovec       iov = {
+			.iov_base = poll->buff,
+			.iov_len  = NLINK_XFER_MSG_SIZE
+		};
+		struct msghdr      hdr = {
+			.msg_name    = &addr,
+			.msg_namelen = sizeof(addr),
+			.msg_iov     = &iov,
+			.msg_iovlen  = 1
+		};
+		ssize_t            ret;
+
+		ret = nlink_recv_dgram(sock, poll->buff, &hdr, MSG_DONTWAIT);
+		if (ret == -ESRCH)
+			/* Unicast datagram addressed to another port: skip. */
+			continue;
+		if (ret < 0)
+			return (int)ret;
+
+		poll->msg = poll->buff;
+		poll->bytes = (int)ret;
+	}
+
+	*msg = poll->msg;
+	*bytes = poll->bytes;
+
+	return 0;
+}
+
+static uint64_t
+nlink_poll_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * Receive and process pending messages within budget, NAPI style.
+ *
+ * Messages are given to parse one at a time (see nlink_parse_msg() for
+ * status semantics, empty messages being skipped) till either:
+ * - socket receive queue is drained: 0 is returned ;
+ * - *nr messages have been processed or nsec nanoseconds have elapsed (when
+ *   non zero, checked every NLINK_POLL_CLOCK_STRIDE messages): -EINPROGRESS
+ *   is returned, meaning more work may be pending and caller should poll
+ *   again once other event sources have been served ;
+ * - reception fails or parse returns non zero: the error is returned, the
+ *   failing message being consumed anyway.
+ * In all cases, *nr is updated with the number of messages processed.
+ *
+ * Socket need not be non blocking since datagrams are received using
+ * MSG_DONTWAIT.
+ */
+int
+nlink_poll_msg(struct nlink_poll       *poll,
+               const struct nlink_sock *sock,
+               unsigned int            *nr,
+               uint64_t                 nsec,
+               nlink_parse_msg_fn      *parse,
+               void                    *data)
+{
+	nlink_assert(poll);
+	nlink_assert(nr);
+	nlink_assert(*nr);
+	nlink_assert(parse);
+
+	uint64_t     expire = nsec ? (nlink_poll_now() + nsec) : 0;
+	unsigned int cnt = 0;
+	unsigned int fetched = 0;
+	int          ret = 0;
+
+	while (cnt < *nr) {
+		const struct nlmsghdr *msg;
+		const struct nlmsghdr *next;
+		int                    bytes;
+
+		/*
+		 * Pace clock reads on fetched messages rather than on delivered
+		 * ones so that a stream of skipped messages cannot overrun the
+		 * time budget.
+		 */
+		if (expire &&
+		    fetched &&
+		    !(fetched % NLINK_POLL_CLOCK_STRIDE) &&
+		    (nlink_poll_now() >= expire)) {
+			ret = -EINPROGRESS;
+			break;
+		}
+
+		ret = nlink_poll_fetch(poll, sock, &msg, &bytes);
+		if (ret) {
+			if (ret == -EAGAIN)
+				ret = 0;
+			break;
+		}
+
+		fetched++;
+
+		next = mnl_nlmsg_next(msg, &bytes);
+		nlink_poll_commit(poll, next, bytes);
+
+		ret = nlink_parse_msg_head(msg);
+		if (ret == -ENOENT) {
+			ret = 0;
+			continue;
+		}
+
+		cnt++;
+
+		ret = parse(ret, msg, data);
+		if (ret)
+			break;
+	}
+
+	if (!ret && (cnt == *nr))
+		ret = -EINPROGRESS;
+
+	*nr = cnt;
+
+	return ret;
+}
+
+int
+nlink_init_poll(struct nlink_poll *poll)
+{
+	nlink_assert(poll);
+
+	poll->buff = nlink_alloc_msg();
+	if (!poll->buff)
+		return -errno;
+
+	poll->msg = poll->buff;
+	poll->bytes = 0;
+
+	return 0;
+}
+
+void
+nlink_fini_poll(const struct nlink_poll *poll)
+{
+	nlink_assert(poll);
+	nlink_assert(poll->buff);
+
+	nlink_free_msg(poll->buff);
+}
+
+#if defined(CONFIG_NLINK_NSID)
+
+/*
+ * Receive a datagram and retrieve the ID of the network namespace it
+ * originates from.
+ *
+ * *nsid is set to NLINK_LOCAL_NSID for datagrams originating from the
+ * socket's own namespace, including all unicast replies. Socket should have
+ * been opened with NLINK_SOCK_ALL_NSID flag for foreign notifications to be
+ * received at all.
+ */
+ssize_t
+nlink_recv_nsid_msg(const struct nlink_sock *sock,
+                    struct nlmsghdr         *msg,
+                    int                     *nsid)
+{
+	nlink_assert(nsid);
+
+	struct sockaddr_nl  addr;
+	struct iovec        iov = {
+		.iov_base = msg,
+		.iov_len  = NLINK_XFER_MSG_SIZE
+	};
+	union {
+		char           buff[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	}                   ctrl;
+	struct msghdr       hdr = {
+		.msg_name       = &addr,
+		.msg_namelen    = sizeof(addr),
+		.msg_iov        = &iov,
+		.msg_iovlen     = 1,
+		.msg_control    = ctrl.buff,
+		.msg_controllen = sizeof(ctrl.buff)
+	};
+	struct cmsghdr     *cmsg;
+	ssize_t             ret;
+
+	ret = nlink_recv_dgram(sock, msg, &hdr, 0);
+	if (ret < 0)
+		return ret;
+
+	nlink_assert(!(hdr.msg_flags & MSG_CTRUNC));
+
+	*nsid = NLINK_LOCAL_NSID;
+	for (cmsg = CMSG_FIRSTHDR(&hdr);
+	     cmsg;
+	     cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+		if ((cmsg->cmsg_level == SOL_NETLINK) &&
+		    (cmsg->cmsg_type == NETLINK_LISTEN_ALL_NSID) &&
+		    (cmsg->cmsg_len == CMSG_LEN(sizeof(int)))) {
+			memcpy(nsid, CMSG_DATA(cmsg), sizeof(*nsid));
+			break;
+		}
+	}
+
+	return ret;
+}
+
+static int
+nlink_nsid_request(struct nlink_sock *sock,
+                   struct nlmsghdr   *msg,
+                   uint16_t           type,
+                   uint16_t           flags,
+                   int                netns_fd)
+{
+	uint32_t         seqno;
+	struct rtgenmsg *gen;
+	int              err;
+
+	mnl_nlmsg_put_header(msg);
+	msg->nlmsg_type = type;
+	msg->nlmsg_flags = NLM_F_REQUEST | flags;
+	msg->nlmsg_seq = seqno = nlink_alloc_seqno(sock);
+	msg->nlmsg_pid = sock->port_id;
+
+	gen = mnl_nlmsg_put_extra_header(msg, NLMSG_ALIGN(sizeof(*gen)));
+	gen->rtgen_family = AF_UNSPEC;
+
+	mnl_attr_put_u32(msg, NETNSA_FD, (uint32_t)netns_fd);
+	if (type == RTM_NEWNSID)
+		/* Let kernel pick a free namespace ID. */
+		mnl_attr_put_u32(msg,
+		                 NETNSA_NSID,
+		                 (uint32_t)NETNSA_NSID_NOT_ASSIGNED);
+
+	err = (int)nlink_send_msg(sock, msg);
+	if (err)
+		return err;
+
+	do {
+		ssize_t ret;
+
+		ret = nlink_recv_msg(sock, msg);
+		if (ret < 0)
+			return (int)ret;
+
+		err = nlink_parse_msg_head(msg);
+	} while (msg->nlmsg_seq != seqno);
+
+	return err;
+}
+
+/*
+ * Assign an ID to the network namespace referred to by the given file
+ * descriptor if not already done and return it.
+ *
+ * Notifications originating from a foreign namespace are delivered to
+ * NLINK_SOCK_ALL_NSID sockets only once an ID has been assigned to it.
+ * Dumps may target a foreign namespace by ID as well, see
+ * nlink_iface_setup_nsid_dump().
+ */
+int
+nlink_assign_nsid(int netns_fd)
+{
+	nlink_assert(netns_fd >= 0);
+
+	struct nlink_sock    sock;
+	struct nlmsghdr     *msg;
+	const struct nlattr *attr;
+	int                  err;
+
+	msg = nlink_alloc_msg();
+	if (!msg)
+		return -errno;
+
+	err = nlink_open_route_sock(&sock, SOCK_CLOEXEC);
+	if (err)
+		goto free;
+
+	err = nlink_nsid_request(&sock, msg, RTM_NEWNSID, NLM_F_ACK, netns_fd);
+	if (err && (err != -ENODATA) && (err != -EEXIST))
+		goto close;
+
+	err = nlink_nsid_request(&sock, msg, RTM_GETNSID, 0, netns_fd);
+	if (err)
+		goto close;
+
+	err = -ENOENT;
+	mnl_attr_for_each(attr, msg, NLMSG_ALIGN(sizeof(struct rtgenmsg))) {
+		if ((mnl_attr_get_type(attr) == NETNSA_NSID) &&
+		    !mnl_attr_validate(attr, MNL_TYPE_U32)) {
+			int nsid = (int)mnl_attr_get_u32(attr);
+
+			err = (nsid >= 0) ? nsid : -ENOENT;
+			break;
+		}
+	}
+
+close:
+	nlink_close_sock(&sock);
+free:
+	nlink_free_msg(msg);
+
+	return err;
+}
+
+#endif /* defined(CONFIG_NLINK_NSID) */
+
 int
 nlink_sock_fd(const struct nlink_sock *sock)
 {
@@ -307,6 +945,96 @@ nlink_leave_route_group(struct nlink_sock *sock, enum rtnetlink_groups group)
 	return 0;
 }
 
+/*
+ * Set socket receive buffer size, i.e. the amount of data the kernel may
+ * queue before dropping notifications and reporting ENOBUFS.
+ *
+ * SO_RCVBUFFORCE is tried first so that privileged callers may exceed the
+ * net.core.rmem_max limit, falling back to SO_RCVBUF (silently capped) when
+ * lacking CAP_NET_ADMIN. Note that kernel doubles the given size to account
+ * for bookkeeping overhead, see nlink_get_sock_rcvbuf().
+ */
+int
+nlink_set_sock_rcvbuf(const struct nlink_sock *sock, int size)
+{
+	nlink_assert_sock(sock);
+	nlink_assert(size > 0);
+
+	int fd = mnl_socket_get_fd(sock->mnl);
+
+	if (!setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)))
+		return 0;
+
+	nlink_assert(errno != EBADF);
+	nlink_assert(errno != EFAULT);
+	nlink_assert(errno != EINVAL);
+	nlink_assert(errno != ENOTSOCK);
+	if (errno != EPERM)
+		return -errno;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size))) {
+		nlink_assert(errno != EBADF);
+		nlink_assert(errno != EFAULT);
+		nlink_assert(errno != EINVAL);
+		nlink_assert(errno != ENOTSOCK);
+		return -errno;
+	}
+
+	return 0;
+}
+
+int
+nlink_get_sock_rcvbuf(const struct nlink_sock *sock)
+{
+	nlink_assert_sock(sock);
+
+	int       size;
+	socklen_t len = sizeof(size);
+
+	if (getsockopt(mnl_socket_get_fd(sock->mnl),
+	               SOL_SOCKET,
+	               SO_RCVBUF,
+	               &size,
+	               &len)) {
+		nlink_assert(errno != EBADF);
+		nlink_assert(errno != EFAULT);
+		nlink_assert(errno != EINVAL);
+		nlink_assert(errno != ENOTSOCK);
+		return -errno;
+	}
+
+	return size;
+}
+
+/*
+ * Stop (resp. resume) reporting receive queue overruns as ENOBUFS errors.
+ *
+ * Notifications overflowing the receive queue are then silently dropped.
+ * Only suitable for sockets which resynchronize state by other means (e.g.
+ * periodic dumps) or do not care about lost notifications.
+ */
+int
+nlink_set_sock_noenobufs(const struct nlink_sock *sock, bool on)
+{
+	nlink_assert_sock(sock);
+
+	int val = on;
+
+	if (mnl_socket_setsockopt(sock->mnl,
+	                          NETLINK_NO_ENOBUFS,
+	                          &val,
+	                          sizeof(val))) {
+		nlink_assert(errno != EBADF);
+		nlink_assert(errno != EFAULT);
+		nlink_assert(errno != EINVAL);
+		nlink_assert(errno != ENOPROTOOPT);
+		nlink_assert(errno != ENOTSOCK);
+		return -errno;
+	}
+
+	return 0;
+}
+
 int
 nlink_open_sock(struct nlink_sock *sock, int bus, int flags)
 {
@@ -315,7 +1043,11 @@ nlink_open_sock(struct nlink_sock *sock, int bus, int flags)
 	int err;
 	int cap = 1;
 
+#if defined(CONFIG_NLINK_NSID)
+	sock->mnl = mnl_socket_open2(bus, flags & ~NLINK_SOCK_ALL_NSID);
+#else  /* !defined(CONFIG_NLINK_NSID) */
 	sock->mnl = mnl_socket_open2(bus, flags);
+#endif /* defined(CONFIG_NLINK_NSID) */
 	if (!sock->mnl) {
 		nlink_assert(errno != EINVAL);
 
@@ -337,6 +1069,24 @@ nlink_open_sock(struct nlink_sock *sock, int bus, int flags)
 		goto close;
 	}
 
+#if defined(CONFIG_NLINK_NSID)
+	if (flags & NLINK_SOCK_ALL_NSID) {
+		/* Receive notifications from all peer network namespaces. */
+		if (mnl_socket_setsockopt(sock->mnl,
+		                          NETLINK_LISTEN_ALL_NSID,
+		                          &cap,
+		                          sizeof(cap))) {
+			nlink_assert(errno != EBADF);
+			nlink_assert(errno != EFAULT);
+			nlink_assert(errno != EINVAL);
+			nlink_assert(errno != ENOTSOCK);
+
+			err = -errno;
+			goto close;
+		}
+	}
+#endif /* defined(CONFIG_NLINK_NSID) */
+
 	if (mnl_socket_bind(sock->mnl, 0, MNL_SOCKET_AUTOPID)) {
 		nlink_assert(errno != EBADF);
 		nlink_assert(errno != EINVAL);
@@ -348,6 +1098,12 @@ nlink_open_sock(struct nlink_sock *sock, int bus, int flags)
 
 	sock->seqno = (uint32_t)time(NULL);
 	sock->port_id = mnl_socket_get_portid(sock->mnl);
+#if defined(CONFIG_NLINK_QSTATS)
+	sock->qstats = NULL;
+#endif /* defined(CONFIG_NLINK_QSTATS) */
+#if defined(CONFIG_NLINK_PCAP)
+	sock->bus = bus;
+#endif /* defined(CONFIG_NLINK_PCAP) */
 
 	return 0;
 
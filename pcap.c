@@ -0,0 +1,130 @@
+#include <nlink/pcap.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+struct nlink_pcap *nlink_pcap_curr;
+
+/*
+ * Append a datagram to the capture.
+ *
+ * Record header, cooked header and data are written while holding the stream
+ * lock so that records of concurrent threads never interleave. Errors are
+ * latched into pcap->err and reported by nlink_pcap_flush() /
+ * nlink_pcap_close().
+ */
+void
+nlink_pcap_record(struct nlink_pcap *pcap,
+                  int                bus,
+                  unsigned int       pkttype,
+                  const void        *data,
+                  size_t             size)
+{
+	nlink_assert(pcap);
+	nlink_assert(pcap->file);
+	nlink_assert(data);
+	nlink_assert(size);
+
+	struct timespec          now;
+	struct nlink_pcap_rec    rec;
+	struct nlink_pcap_cooked cooked = {
+		.pkttype = htons((uint16_t)pkttype),
+		.hatype  = htons(NLINK_PCAP_HATYPE),
+		.halen   = 0,
+		.addr    = { 0, },
+		.proto   = htons((uint16_t)bus)
+	};
+
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	rec.sec = (uint32_t)now.tv_sec;
+	rec.frac = (uint32_t)now.tv_nsec;
+	rec.len = (uint32_t)(sizeof(cooked) + size);
+	if (rec.len > NLINK_PCAP_SNAPLEN)
+		size = NLINK_PCAP_SNAPLEN - sizeof(cooked);
+	rec.caplen = (uint32_t)(sizeof(cooked) + size);
+
+	flockfile(pcap->file);
+
+	if ((fwrite_unlocked(&rec, sizeof(rec), 1, pcap->file) != 1) ||
+	    (fwrite_unlocked(&cooked, sizeof(cooked), 1, pcap->file) != 1) ||
+	    (fwrite_unlocked(data, size, 1, pcap->file) != 1)) {
+		if (!pcap->err)
+			pcap->err = errno ? -errno : -EIO;
+	}
+
+	funlockfile(pcap->file);
+}
+
+/*
+ * Attach recorder so that subsequent datagrams sent / received by all threads
+ * get captured. Passing NULL detaches current recorder. Returns the previously
+ * attached recorder.
+ *
+ * Note that a detached recorder should not be closed till threads possibly
+ * recording into it are done with their current send / receive call.
+ */
+struct nlink_pcap *
+nlink_pcap_attach(struct nlink_pcap *pcap)
+{
+	return __atomic_exchange_n(&nlink_pcap_curr, pcap, __ATOMIC_ACQ_REL);
+}
+
+int
+nlink_pcap_flush(struct nlink_pcap *pcap)
+{
+	nlink_assert(pcap);
+	nlink_assert(pcap->file);
+
+	if (fflush(pcap->file) && !pcap->err)
+		pcap->err = -errno;
+
+	return pcap->err;
+}
+
+int
+nlink_pcap_open(struct nlink_pcap *pcap, const char *path)
+{
+	nlink_assert(pcap);
+	nlink_assert(path);
+	nlink_assert(*path);
+
+	const struct nlink_pcap_file hdr = {
+		.magic    = NLINK_PCAP_NSEC_MAGIC,
+		.major    = NLINK_PCAP_MAJOR,
+		.minor    = NLINK_PCAP_MINOR,
+		.zone     = 0,
+		.sigfigs  = 0,
+		.snaplen  = NLINK_PCAP_SNAPLEN,
+		.linktype = NLINK_PCAP_LINKTYPE
+	};
+	int                          err;
+
+	pcap->file = fopen(path, "we");
+	if (!pcap->file)
+		return -errno;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, pcap->file) != 1) {
+		err = errno ? -errno : -EIO;
+		fclose(pcap->file);
+		return err;
+	}
+
+	pcap->err = 0;
+
+	return 0;
+}
+
+int
+nlink_pcap_close(struct nlink_pcap *pcap)
+{
+	nlink_assert(pcap);
+	nlink_assert(pcap->file);
+	nlink_assert(nlink_pcap_curr != pcap);
+
+	if (fclose(pcap->file) && !pcap->err)
+		pcap->err = -errno;
+
+	return pcap->err;
+}
@@ -0,0 +1,266 @@
+#include <nlink/proc.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define NLINK_PROC_CTL_MSG_SIZE \
+	(MNL_NLMSG_HDRLEN + \
+	 MNL_ALIGN(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op)))
+
+static void
+nlink_proc_account(struct nlink_proc       *proc,
+                   const struct cn_msg     *cn,
+                   const struct proc_event *event)
+{
+	struct nlink_proc_cpu *cpu;
+	uint32_t               gap;
+
+	if (event->cpu >= proc->cpus_nr)
+		return;
+
+	cpu = &proc->cpus[event->cpu];
+
+	if (cpu->valid) {
+		gap = cn->seq - cpu->next;
+		if (gap >= (1U << 31))
+			/* Late (reordered) event: keep current expectation. */
+			return;
+
+		proc->lost += gap;
+	}
+
+	cpu->next = cn->seq + 1;
+	cpu->valid = true;
+}
+
+static const struct cn_msg *
+nlink_proc_decode(const struct nlmsghdr    *msg,
+                  size_t                    size,
+                  const struct sockaddr_nl *addr)
+{
+	const struct cn_msg *cn;
+
+	/* Only trust kernel originated datagrams. */
+	if (addr->nl_pid)
+		return NULL;
+
+	if (!mnl_nlmsg_ok(msg, (int)size) ||
+	    (mnl_nlmsg_get_payload_len(msg) < sizeof(*cn)))
+		return NULL;
+
+	cn = mnl_nlmsg_get_payload(msg);
+	if ((cn->id.idx != CN_IDX_PROC) ||
+	    (cn->id.val != CN_VAL_PROC) ||
+	    (cn->len < offsetof(struct proc_event, event_data)) ||
+	    (cn->len > (mnl_nlmsg_get_payload_len(msg) - sizeof(*cn))))
+		return NULL;
+
+	return cn;
+}
+
+int
+nlink_proc_recv(struct nlink_proc        *proc,
+                const struct proc_event **events,
+                unsigned int              nr)
+{
+	nlink_assert(proc);
+	nlink_assert(proc->msgs);
+	nlink_assert(events);
+	nlink_assert(nr);
+
+	unsigned int m;
+	unsigned int cnt = 0;
+	int          ret;
+
+	if (nr > proc->nr)
+		nr = proc->nr;
+
+	for (m = 0; m < nr; m++)
+		proc->msgs[m].msg_hdr.msg_namelen = sizeof(proc->addrs[0]);
+
+	ret = recvmmsg(nlink_sock_fd(&proc->sock),
+	               proc->msgs,
+	               nr,
+	               MSG_WAITFORONE,
+	               NULL);
+	if (ret < 0) {
+		nlink_assert(errno != EBADF);
+		nlink_assert(errno != EFAULT);
+		nlink_assert(errno != EINVAL);
+		nlink_assert(errno != ENOTSOCK);
+
+		if (errno == ENOBUFS)
+			proc->drops++;
+
+		return -errno;
+	}
+
+	for (m = 0; m < (unsigned int)ret; m++) {
+		const struct mmsghdr    *mmsg = &proc->msgs[m];
+		const struct cn_msg     *cn;
+		const struct proc_event *event;
+
+		if (mmsg->msg_hdr.msg_flags & MSG_TRUNC)
+			continue;
+
+		cn = nlink_proc_decode(mmsg->msg_hdr.msg_iov->iov_base,
+		                       mmsg->msg_len,
+		                       mmsg->msg_hdr.msg_name);
+		if (!cn)
+			continue;
+
+		event = (const struct proc_event *)cn->data;
+
+		if (event->what == PROC_EVENT_NONE) {
+			/*
+			 * Subscription acknowledgment, multicast to all
+			 * listeners: only consider ours, i.e. acknowledging
+			 * the ack cookie nlink_proc_ctl() sent.
+			 */
+			if ((cn->ack == (proc->sock.port_id + 1)) &&
+			    event->event_data.ack.err)
+				return -(int)event->event_data.ack.err;
+
+			continue;
+		}
+
+		nlink_proc_account(proc, cn, event);
+		events[cnt++] = event;
+	}
+
+	proc->events += cnt;
+
+	return (int)cnt;
+}
+
+static int
+nlink_proc_ctl(const struct nlink_proc *proc, enum proc_cn_mcast_op op)
+{
+	union {
+		uint8_t         buff[NLINK_PROC_CTL_MSG_SIZE];
+		struct nlmsghdr align;
+	}                msg;
+	struct cn_msg   *cn;
+
+	memset(&msg, 0, sizeof(msg));
+
+	mnl_nlmsg_put_header(msg.buff);
+	/* Connector messages are single part "done" messages. */
+	msg.align.nlmsg_type = NLMSG_DONE;
+	msg.align.nlmsg_pid = proc->sock.port_id;
+
+	cn = mnl_nlmsg_put_extra_header(&msg.align, sizeof(*cn) + sizeof(op));
+	cn->id.idx = CN_IDX_PROC;
+	cn->id.val = CN_VAL_PROC;
+	/* Kernel acknowledges with ack incremented by one. */
+	cn->ack = proc->sock.port_id;
+	cn->len = sizeof(op);
+	memcpy(cn->data, &op, sizeof(op));
+
+	return (int)nlink_send_msg(&proc->sock, &msg.align);
+}
+
+/*
+ * Open connector socket and subscribe to process events. Note that kernel
+ * requires CAP_NET_ADMIN from within the initial user and PID namespaces.
+ *
+ * Subscription is acknowledged asynchronously: a refusal is reported by the
+ * first nlink_proc_recv() call processing the acknowledgment.
+ */
+int
+nlink_proc_open(struct nlink_proc *proc, unsigned int nr, int flags)
+{
+	nlink_assert(proc);
+	nlink_assert(nr);
+
+	int          group = CN_IDX_PROC;
+	long         cpus;
+	unsigned int m;
+	int          err;
+
+	cpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (cpus <= 0)
+		cpus = 1;
+
+	proc->nr = nr;
+	proc->buffs = malloc(nr * NLINK_PROC_DGRAM_SIZE);
+	proc->iovs = malloc(nr * sizeof(proc->iovs[0]));
+	proc->addrs = malloc(nr * sizeof(proc->addrs[0]));
+	proc->msgs = malloc(nr * sizeof(proc->msgs[0]));
+	proc->cpus_nr = (unsigned int)cpus;
+	proc->cpus = calloc(proc->cpus_nr, sizeof(proc->cpus[0]));
+	if (!proc->buffs ||
+	    !proc->iovs ||
+	    !proc->addrs ||
+	    !proc->msgs ||
+	    !proc->cpus) {
+		err = -ENOMEM;
+		goto free;
+	}
+
+	for (m = 0; m < nr; m++) {
+		proc->iovs[m].iov_base = &proc->buffs[m * NLINK_PROC_DGRAM_SIZE];
+		proc->iovs[m].iov_len = NLINK_PROC_DGRAM_SIZE;
+
+		memset(&proc->msgs[m], 0, sizeof(proc->msgs[m]));
+		proc->msgs[m].msg_hdr.msg_name = &proc->addrs[m];
+		proc->msgs[m].msg_hdr.msg_iov = &proc->iovs[m];
+		proc->msgs[m].msg_hdr.msg_iovlen = 1;
+	}
+
+	proc->events = 0;
+	proc->lost = 0;
+	proc->drops = 0;
+
+	err = nlink_open_sock(&proc->sock, NETLINK_CONNECTOR, flags);
+	if (err)
+		goto free;
+
+	if (mnl_socket_setsockopt(proc->sock.mnl,
+	                          NETLINK_ADD_MEMBERSHIP,
+	                          &group,
+	                          sizeof(group))) {
+		nlink_assert(errno != EBADF);
+		nlink_assert(errno != EFAULT);
+		nlink_assert(errno != EINVAL);
+		nlink_assert(errno != ENOPROTOOPT);
+		nlink_assert(errno != ENOTSOCK);
+
+		err = -errno;
+		goto close;
+	}
+
+	err = nlink_proc_ctl(proc, PROC_CN_MCAST_LISTEN);
+	if (err)
+		goto close;
+
+	return 0;
+
+close:
+	nlink_close_sock(&proc->sock);
+free:
+	free(proc->cpus);
+	free(proc->msgs);
+	free(proc->addrs);
+	free(proc->iovs);
+	free(proc->buffs);
+
+	return err;
+}
+
+void
+nlink_proc_close(struct nlink_proc *proc)
+{
+	nlink_assert(proc);
+
+	/* Kernel keeps generating events till last listener is gone. */
+	nlink_proc_ctl(proc, PROC_CN_MCAST_IGNORE);
+	nlink_close_sock(&proc->sock);
+
+	free(proc->cpus);
+	free(proc->msgs);
+	free(proc->addrs);
+	free(proc->iovs);
+	free(proc->buffs);
+}
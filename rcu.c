@@ -0,0 +1,356 @@
+#include <nlink/rcu.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * Return position of the record matching index if found, position it should
+ * be inserted at otherwise.
+ */
+static unsigned int
+nlink_rcu_bisect(const struct nlink_rcu_snap *snap, int index)
+{
+	unsigned int lo = 0;
+	unsigned int hi = snap->cnt;
+
+	while (lo < hi) {
+		unsigned int mid = lo + ((hi - lo) / 2);
+
+		if (snap->recs[mid].index < index)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+const struct nlink_iface_rec *
+nlink_rcu_find(const struct nlink_rcu_snap *snap, int index)
+{
+	nlink_assert(snap);
+	nlink_assert(index > 0);
+
+	unsigned int r = nlink_rcu_bisect(snap, index);
+
+	if ((r < snap->cnt) && (snap->recs[r].index == index))
+		return &snap->recs[r];
+
+	return NULL;
+}
+
+static struct nlink_rcu_snap *
+nlink_rcu_alloc_snap(unsigned int nr)
+{
+	struct nlink_rcu_snap *snap;
+
+	snap = malloc(sizeof(*snap) + ((size_t)nr * sizeof(snap->recs[0])));
+	if (!snap)
+		return NULL;
+
+	snap->next = NULL;
+	snap->epoch = 0;
+	snap->cnt = 0;
+	snap->nr = nr;
+
+	return snap;
+}
+
+/******************************************************************************
+ * Reader registration
+ ******************************************************************************/
+
+void
+nlink_rcu_register(struct nlink_rcu *rcu, struct nlink_rcu_reader *reader)
+{
+	nlink_rcu_assert(rcu);
+	nlink_assert(reader);
+
+	reader->epoch = 0;
+
+	pthread_mutex_lock(&rcu->lock);
+	reader->next = rcu->readers;
+	rcu->readers = reader;
+	pthread_mutex_unlock(&rcu->lock);
+}
+
+void
+nlink_rcu_unregister(struct nlink_rcu *rcu, struct nlink_rcu_reader *reader)
+{
+	nlink_rcu_assert(rcu);
+	nlink_assert(reader);
+	nlink_assert(!reader->epoch);
+
+	struct nlink_rcu_reader **curr;
+
+	pthread_mutex_lock(&rcu->lock);
+
+	for (curr = &rcu->readers; *curr; curr = &(*curr)->next) {
+		if (*curr == reader) {
+			*curr = reader->next;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&rcu->lock);
+}
+
+/******************************************************************************
+ * Writer side
+ ******************************************************************************/
+
+/*
+ * Get a private draft to apply updates to, copying current snapshot on first
+ * update since last publication.
+ */
+static struct nlink_rcu_snap *
+nlink_rcu_get_draft(struct nlink_rcu *rcu, unsigned int extra)
+{
+	struct nlink_rcu_snap *draft = rcu->draft;
+
+	if (!draft) {
+		const struct nlink_rcu_snap *curr = rcu->curr;
+
+		draft = nlink_rcu_alloc_snap(curr->cnt + extra);
+		if (!draft)
+			return NULL;
+
+		memcpy(draft->recs,
+		       curr->recs,
+		       (size_t)curr->cnt * sizeof(curr->recs[0]));
+		draft->cnt = curr->cnt;
+
+		rcu->draft = draft;
+	}
+	else if ((draft->cnt + extra) > draft->nr) {
+		unsigned int nr = (2 * draft->nr) + extra;
+
+		draft = realloc(draft,
+		                sizeof(*draft) +
+		                ((size_t)nr * sizeof(draft->recs[0])));
+		if (!draft)
+			return NULL;
+
+		draft->nr = nr;
+		rcu->draft = draft;
+	}
+
+	return draft;
+}
+
+int
+nlink_rcu_update(struct nlink_rcu *rcu, const struct nlink_iface *iface)
+{
+	nlink_rcu_assert(rcu);
+	nlink_assert(iface);
+
+	struct nlink_iface_rec  rec;
+	struct nlink_rcu_snap  *draft;
+	unsigned int            r;
+	bool                    found;
+
+	nlink_iface_pack_rec(&rec, iface);
+
+	if (!rcu->draft) {
+		/* Do not copy current snapshot when nothing changed. */
+		const struct nlink_iface_rec *old;
+
+		old = nlink_rcu_find(rcu->curr, rec.index);
+		if (old && nlink_iface_rec_equal(old, &rec))
+			return 0;
+	}
+
+	draft = nlink_rcu_get_draft(rcu, 1);
+	if (!draft)
+		return -errno;
+
+	r = nlink_rcu_bisect(draft, rec.index);
+	found = (r < draft->cnt) && (draft->recs[r].index == rec.index);
+	if (!found) {
+		memmove(&draft->recs[r + 1],
+		        &draft->recs[r],
+		        (draft->cnt - r) * sizeof(draft->recs[0]));
+		draft->cnt++;
+	}
+	draft->recs[r] = rec;
+
+	return 0;
+}
+
+int
+nlink_rcu_remove(struct nlink_rcu *rcu, int index)
+{
+	nlink_rcu_assert(rcu);
+	nlink_assert(index > 0);
+
+	struct nlink_rcu_snap *draft;
+	unsigned int           r;
+
+	if (!rcu->draft && !nlink_rcu_find(rcu->curr, index))
+		return 0;
+
+	draft = nlink_rcu_get_draft(rcu, 0);
+	if (!draft)
+		return -errno;
+
+	r = nlink_rcu_bisect(draft, index);
+	if ((r == draft->cnt) || (draft->recs[r].index != index))
+		return 0;
+
+	draft->cnt--;
+	memmove(&draft->recs[r],
+	        &draft->recs[r + 1],
+	        (draft->cnt - r) * sizeof(draft->recs[0]));
+
+	return 0;
+}
+
+int
+nlink_rcu_process_msg(struct nlink_rcu *rcu, const struct nlmsghdr *msg)
+{
+	nlink_rcu_assert(rcu);
+	nlink_assert(msg);
+
+	switch (msg->nlmsg_type) {
+	case RTM_NEWLINK:
+	{
+		struct nlink_iface iface;
+		int                err;
+
+		err = nlink_iface_parse_msg(msg, &iface);
+		if (err)
+			return err;
+
+		return nlink_rcu_update(rcu, &iface);
+	}
+
+	case RTM_DELLINK:
+	{
+		const struct ifinfomsg *info;
+
+		if (mnl_nlmsg_get_payload_len(msg) < sizeof(*info))
+			return -EBADMSG;
+
+		info = mnl_nlmsg_get_payload(msg);
+		if (info->ifi_index <= 0)
+			return -EBADMSG;
+
+		return nlink_rcu_remove(rcu, info->ifi_index);
+	}
+
+	default:
+		return -ENOMSG;
+	}
+}
+
+/*
+ * Free retired snapshots no registered reader may still refer to.
+ */
+static void
+nlink_rcu_reclaim(struct nlink_rcu *rcu)
+{
+	const struct nlink_rcu_reader  *reader;
+	uint64_t                        oldest = UINT64_MAX;
+	struct nlink_rcu_snap         **curr;
+
+	pthread_mutex_lock(&rcu->lock);
+
+	for (reader = rcu->readers; reader; reader = reader->next) {
+		uint64_t epoch = __atomic_load_n(&reader->epoch,
+		                                 __ATOMIC_SEQ_CST);
+
+		if (epoch && (epoch < oldest))
+			oldest = epoch;
+	}
+
+	pthread_mutex_unlock(&rcu->lock);
+
+	curr = &rcu->retired;
+	while (*curr) {
+		struct nlink_rcu_snap *snap = *curr;
+
+		if (snap->epoch <= oldest) {
+			*curr = snap->next;
+			free(snap);
+		}
+		else
+			curr = &snap->next;
+	}
+}
+
+/*
+ * Make updates applied since last call visible to readers.
+ *
+ * Call once per batch of updates (e.g. once per received datagram) to limit
+ * the number of snapshot copies under event storms.
+ */
+void
+nlink_rcu_publish(struct nlink_rcu *rcu)
+{
+	nlink_rcu_assert(rcu);
+
+	struct nlink_rcu_snap *old;
+
+	if (!rcu->draft)
+		return;
+
+	old = __atomic_exchange_n(&rcu->curr, rcu->draft, __ATOMIC_SEQ_CST);
+	rcu->draft = NULL;
+
+	/*
+	 * Readers entering with an epoch >= the new one are guaranteed to see
+	 * the new snapshot.
+	 */
+	old->epoch = __atomic_add_fetch(&rcu->epoch, 1, __ATOMIC_SEQ_CST);
+	old->next = rcu->retired;
+	rcu->retired = old;
+
+	nlink_rcu_reclaim(rcu);
+}
+
+int
+nlink_rcu_init(struct nlink_rcu *rcu, unsigned int nr)
+{
+	nlink_assert(rcu);
+
+	int err;
+
+	rcu->curr = nlink_rcu_alloc_snap(nr);
+	if (!rcu->curr)
+		return -errno;
+
+	err = pthread_mutex_init(&rcu->lock, NULL);
+	if (err) {
+		free(rcu->curr);
+		return -err;
+	}
+
+	rcu->epoch = 1;
+	rcu->draft = NULL;
+	rcu->retired = NULL;
+	rcu->readers = NULL;
+
+	return 0;
+}
+
+/*
+ * All readers must have unregistered before calling.
+ */
+void
+nlink_rcu_fini(struct nlink_rcu *rcu)
+{
+	nlink_rcu_assert(rcu);
+	nlink_assert(!rcu->readers);
+
+	while (rcu->retired) {
+		struct nlink_rcu_snap *snap = rcu->retired;
+
+		rcu->retired = snap->next;
+		free(snap);
+	}
+
+	free(rcu->draft);
+	free(rcu->curr);
+
+	pthread_mutex_destroy(&rcu->lock);
+}
@@ -0,0 +1,523 @@
+/*
+ * Netlink capture replayer.
+ *
+ * Feeds datagrams recorded into a pcap file (see nlink_pcap_open()) or captured
+ * from an nlmon interface back through library parsing and request window
+ * paths, either as fast as possible or at original pace.
+ *
+ * Requests carrying NLM_F_ACK or NLM_F_DUMP flags found into sent datagrams
+ * are scheduled into a request window ; matching ACKs, errors and end of dump
+ * messages found into received datagrams retire them. Link messages are
+ * parsed as interfaces.
+ *
+ * Reports datagram / message throughput and per received datagram processing
+ * latency percentiles.
+ */
+
+#include <nlink/pcap.h>
+#include <nlink/iface.h>
+#include <nlink/work.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+struct nlink_replay_stats {
+	unsigned int  nr;
+	unsigned int  cnt;
+	uint64_t     *samples;
+};
+
+struct nlink_replay {
+	/* Configuration. */
+	bool                       pace;
+	unsigned int               depth;
+	/* Input. */
+	FILE                      *file;
+	bool                       nsec;
+	bool                       swap;
+	uint32_t                   snaplen;
+	uint8_t                   *buff;
+	/* Request window. */
+	struct nlink_win           win;
+	struct nlink_work         *works;
+	/* Counters. */
+	unsigned int               sent;
+	unsigned int               rcvd;
+	unsigned int               msgs;
+	unsigned int               ifaces;
+	unsigned int               acks;
+	unsigned int               errors;
+	unsigned int               unmatched;
+	unsigned int               full;
+	unsigned int               skipped;
+	uint64_t                   bytes;
+	struct nlink_replay_stats  lats;
+};
+
+static uint64_t
+nlink_replay_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+/******************************************************************************
+ * Latency statistics
+ ******************************************************************************/
+
+static int
+nlink_replay_push_sample(struct nlink_replay_stats *stats, uint64_t sample)
+{
+	if (stats->cnt == stats->nr) {
+		unsigned int  nr = stats->nr ? (2 * stats->nr) : 4096;
+		uint64_t     *samples;
+
+		samples = realloc(stats->samples, nr * sizeof(samples[0]));
+		if (!samples)
+			return -errno;
+
+		stats->samples = samples;
+		stats->nr = nr;
+	}
+
+	stats->samples[stats->cnt++] = sample;
+
+	return 0;
+}
+
+static int
+nlink_replay_cmp_sample(const void *first, const void *second)
+{
+	uint64_t fst = *(const uint64_t *)first;
+	uint64_t snd = *(const uint64_t *)second;
+
+	return (fst > snd) - (fst < snd);
+}
+
+static double
+nlink_replay_pct(const struct nlink_replay_stats *stats, unsigned int permil)
+{
+	unsigned int s;
+
+	if (!stats->cnt)
+		return 0;
+
+	s = (unsigned int)(((uint64_t)(stats->cnt - 1) * permil) / 1000);
+
+	return (double)stats->samples[s] / 1000.0;
+}
+
+/******************************************************************************
+ * Capture processing
+ ******************************************************************************/
+
+static void
+nlink_replay_process_sent(struct nlink_replay   *replay,
+                          const struct nlmsghdr *msg,
+                          int                    bytes)
+{
+	for (; mnl_nlmsg_ok(msg, bytes); msg = mnl_nlmsg_next(msg, &bytes)) {
+		struct nlink_work *work;
+
+		replay->msgs++;
+
+		if (!(msg->nlmsg_flags & NLM_F_REQUEST) ||
+		    !(msg->nlmsg_flags & (NLM_F_ACK | NLM_F_DUMP)))
+			continue;
+
+		work = nlink_win_acquire_work(&replay->win);
+		if (!work) {
+			replay->full++;
+			continue;
+		}
+
+		nlink_win_sched_work(&replay->win, work, msg->nlmsg_seq);
+	}
+}
+
+static void
+nlink_replay_retire(struct nlink_replay *replay, uint32_t seqno)
+{
+	struct nlink_work *work;
+
+	if (!nlink_win_has_work(&replay->win)) {
+		replay->unmatched++;
+		return;
+	}
+
+	work = nlink_win_pull_work(&replay->win, seqno);
+	if (!work) {
+		replay->unmatched++;
+		return;
+	}
+
+	nlink_win_release_work(&replay->win, work);
+}
+
+static void
+nlink_replay_process_rcvd(struct nlink_replay   *replay,
+                          const struct nlmsghdr *msg,
+                          int                    bytes)
+{
+	for (; mnl_nlmsg_ok(msg, bytes); msg = mnl_nlmsg_next(msg, &bytes)) {
+		int ret;
+
+		replay->msgs++;
+
+		ret = nlink_parse_msg_head(msg);
+		switch (ret) {
+		case 0:
+			if (msg->nlmsg_type == RTM_NEWLINK) {
+				struct nlink_iface iface;
+
+				if (!nlink_iface_parse_msg(msg, &iface))
+					replay->ifaces++;
+			}
+			break;
+
+		case -ENOENT:
+		case -EINTR:
+		case -EOVERFLOW:
+			break;
+
+		case -ENODATA:
+			/* ACK or end of dump. */
+			replay->acks++;
+			nlink_replay_retire(replay, msg->nlmsg_seq);
+			break;
+
+		default:
+			replay->errors++;
+			nlink_replay_retire(replay, msg->nlmsg_seq);
+		}
+	}
+}
+
+static uint32_t
+nlink_replay_u32(const struct nlink_replay *replay, uint32_t value)
+{
+	return replay->swap ? __builtin_bswap32(value) : value;
+}
+
+static int
+nlink_replay_read(struct nlink_replay *replay, void *data, size_t size)
+{
+	if (fread(data, size, 1, replay->file) != 1)
+		return ferror(replay->file) ? -EIO : -ENODATA;
+
+	return 0;
+}
+
+static int
+nlink_replay_open(struct nlink_replay *replay, const char *path)
+{
+	struct nlink_pcap_file hdr;
+	int                    err;
+
+	replay->file = fopen(path, "re");
+	if (!replay->file)
+		return -errno;
+
+	err = nlink_replay_read(replay, &hdr, sizeof(hdr));
+	if (err)
+		return (err == -ENODATA) ? -EPROTO : err;
+
+	switch (hdr.magic) {
+	case NLINK_PCAP_NSEC_MAGIC:
+		replay->nsec = true;
+		break;
+
+	case NLINK_PCAP_USEC_MAGIC:
+		replay->nsec = false;
+		break;
+
+	default:
+		replay->swap = true;
+		switch (__builtin_bswap32(hdr.magic)) {
+		case NLINK_PCAP_NSEC_MAGIC:
+			replay->nsec = true;
+			break;
+
+		case NLINK_PCAP_USEC_MAGIC:
+			replay->nsec = false;
+			break;
+
+		default:
+			return -EPROTO;
+		}
+	}
+
+	if (nlink_replay_u32(replay, hdr.linktype) != NLINK_PCAP_LINKTYPE)
+		return -EPROTO;
+
+	/*
+	 * Size buffer according to the largest record the capture may hold,
+	 * bounded as libpcap does.
+	 */
+	replay->snaplen = nlink_replay_u32(replay, hdr.snaplen);
+	if (replay->snaplen <= sizeof(struct nlink_pcap_cooked))
+		return -EPROTO;
+	if (replay->snaplen > NLINK_PCAP_SNAPLEN)
+		replay->snaplen = NLINK_PCAP_SNAPLEN;
+
+	replay->buff = malloc(replay->snaplen -
+	                      sizeof(struct nlink_pcap_cooked));
+	if (!replay->buff)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int
+nlink_replay_run(struct nlink_replay *replay)
+{
+	uint64_t start = 0;
+	uint64_t first = 0;
+	uint64_t elapsed;
+	int      err;
+
+	while (true) {
+		struct nlink_pcap_rec    rec;
+		struct nlink_pcap_cooked cooked;
+		const struct nlmsghdr   *msg;
+		uint64_t                 tstamp;
+		uint32_t                 caplen;
+		uint32_t                 len;
+		uint64_t                 begin;
+		int                      bytes;
+
+		err = nlink_replay_read(replay, &rec, sizeof(rec));
+		if (err)
+			break;
+
+		tstamp = ((uint64_t)nlink_replay_u32(replay, rec.sec) *
+		          1000000000ULL) +
+		         ((uint64_t)nlink_replay_u32(replay, rec.frac) *
+		          (replay->nsec ? 1U : 1000U));
+		caplen = nlink_replay_u32(replay, rec.caplen);
+		len = nlink_replay_u32(replay, rec.len);
+		if ((caplen < sizeof(cooked)) ||
+		    (caplen > replay->snaplen) ||
+		    (caplen > len))
+			return -EPROTO;
+
+		err = nlink_replay_read(replay, &cooked, sizeof(cooked));
+		if (err)
+			break;
+
+		bytes = (int)(caplen - sizeof(cooked));
+		err = nlink_replay_read(replay, replay->buff, (size_t)bytes);
+		if (err)
+			break;
+
+		if ((ntohs(cooked.hatype) != NLINK_PCAP_HATYPE) ||
+		    (caplen != len)) {
+			/* Foreign or truncated datagram. */
+			replay->skipped++;
+			continue;
+		}
+
+		if (!start) {
+			start = nlink_replay_now();
+			first = tstamp;
+		}
+		else if (replay->pace && (tstamp > first)) {
+			uint64_t        due = start + (tstamp - first);
+			struct timespec ts = {
+				.tv_sec  = (time_t)(due / 1000000000ULL),
+				.tv_nsec = (long)(due % 1000000000ULL)
+			};
+
+			/* Replay at original pace. */
+			while (clock_nanosleep(CLOCK_MONOTONIC,
+			                       TIMER_ABSTIME,
+			                       &ts,
+			                       NULL) == EINTR)
+				;
+		}
+
+		msg = (const struct nlmsghdr *)replay->buff;
+		replay->bytes += (uint64_t)bytes;
+
+		begin = nlink_replay_now();
+		if (ntohs(cooked.pkttype) == NLINK_PCAP_OUTGOING_PKT) {
+			replay->sent++;
+			nlink_replay_process_sent(replay, msg, bytes);
+		}
+		else {
+			replay->rcvd++;
+			nlink_replay_process_rcvd(replay, msg, bytes);
+
+			err = nlink_replay_push_sample(&replay->lats,
+			                               nlink_replay_now() -
+			                               begin);
+			if (err)
+				return err;
+		}
+	}
+
+	if (err != -ENODATA)
+		return err;
+
+	elapsed = start ? (nlink_replay_now() - start) : 0;
+	if (!elapsed)
+		elapsed = 1;
+
+	qsort(replay->lats.samples,
+	      replay->lats.cnt,
+	      sizeof(replay->lats.samples[0]),
+	      nlink_replay_cmp_sample);
+
+	printf("datagrams: %u sent, %u received, %u skipped\n"
+	       "messages:  %u (%u interfaces, %u acks, %u errors)\n"
+	       "window:    %u unmatched replies, %u requests over depth\n"
+	       "rate:      %.0f msg/s, %.1f MiB/s over %.3f s\n"
+	       "latency (us): p50 %9.3f | p90 %9.3f | p99 %9.3f | "
+	       "p99.9 %9.3f | max %9.3f\n",
+	       replay->sent,
+	       replay->rcvd,
+	       replay->skipped,
+	       replay->msgs,
+	       replay->ifaces,
+	       replay->acks,
+	       replay->errors,
+	       replay->unmatched,
+	       replay->full,
+	       ((double)replay->msgs * 1e9) / (double)elapsed,
+	       ((double)replay->bytes * 1e9) / ((double)elapsed * 1048576.0),
+	       (double)elapsed / 1e9,
+	       nlink_replay_pct(&replay->lats, 500),
+	       nlink_replay_pct(&replay->lats, 900),
+	       nlink_replay_pct(&replay->lats, 990),
+	       nlink_replay_pct(&replay->lats, 999),
+	       nlink_replay_pct(&replay->lats, 1000));
+
+	return 0;
+}
+
+/******************************************************************************
+ * Main
+ ******************************************************************************/
+
+static void
+nlink_replay_usage(const char *me)
+{
+	fprintf(stderr,
+	        "Usage: %s [OPTIONS] <CAPTURE_FILE>\n"
+	        "Options:\n"
+	        "    -p, --pace         replay at original pace [as fast as "
+	        "possible]\n"
+	        "    -w, --window <NR>  number of in-flight requests [64]\n"
+	        "    -h, --help         this help message\n",
+	        me);
+}
+
+static int
+nlink_replay_parse_args(struct nlink_replay *replay,
+                        int                  argc,
+                        char * const         argv[])
+{
+	static const struct option opts[] = {
+		{ "pace",   no_argument,       NULL, 'p' },
+		{ "window", required_argument, NULL, 'w' },
+		{ "help",   no_argument,       NULL, 'h' },
+		{ NULL,     0,                 NULL, 0 }
+	};
+
+	replay->pace = false;
+	replay->depth = 64;
+
+	while (true) {
+		int            opt;
+		char          *end;
+		unsigned long  val;
+
+		opt = getopt_long(argc, argv, "pw:h", opts, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'p':
+			replay->pace = true;
+			break;
+
+		case 'w':
+			errno = 0;
+			val = strtoul(optarg, &end, 0);
+			if (errno || *end || !val || (val > 1000000UL))
+				return -EINVAL;
+			replay->depth = (unsigned int)val;
+			break;
+
+		case 'h':
+		default:
+			return -EINVAL;
+		}
+	}
+
+	if (optind != (argc - 1))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int
+nlink_replay_init(struct nlink_replay *replay)
+{
+	unsigned int w;
+	int          err;
+
+	replay->works = malloc(replay->depth * sizeof(replay->works[0]));
+	if (!replay->works)
+		return -ENOMEM;
+
+	err = nlink_win_init(&replay->win, replay->depth);
+	if (err)
+		return err;
+
+	for (w = 0; w < replay->depth; w++)
+		nlink_win_register_work(&replay->win, &replay->works[w]);
+
+	return 0;
+}
+
+int
+main(int argc, char * const argv[])
+{
+	struct nlink_replay replay = { 0 };
+	int                 err;
+
+	if (nlink_replay_parse_args(&replay, argc, argv)) {
+		nlink_replay_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	err = nlink_replay_init(&replay);
+	if (err)
+		goto out;
+
+	err = nlink_replay_open(&replay, argv[optind]);
+	if (err)
+		goto out;
+
+	err = nlink_replay_run(&replay);
+
+out:
+	if (err) {
+		fprintf(stderr,
+		        "%s: %s: %s\n",
+		        argv[0],
+		        argv[optind],
+		        strerror(-err));
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
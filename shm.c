@@ -0,0 +1,576 @@
+#include <nlink/shm.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static int
+nlink_shm_futex(const uint32_t        *word,
+                int                    op,
+                uint32_t               val,
+                const struct timespec *timeout)
+{
+	return (int)syscall(SYS_futex, word, op, val, timeout, NULL, 0);
+}
+
+/*
+ * Return position of the record matching index if found, position it should
+ * be inserted at otherwise.
+ */
+static unsigned int
+nlink_shm_bisect(const struct nlink_iface_rec *recs,
+                 unsigned int                  cnt,
+                 int                           index)
+{
+	unsigned int lo = 0;
+	unsigned int hi = cnt;
+
+	while (lo < hi) {
+		unsigned int mid = lo + ((hi - lo) / 2);
+
+		if (recs[mid].index < index)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/******************************************************************************
+ * Reader side
+ ******************************************************************************/
+
+static unsigned int
+nlink_shm_count(const struct nlink_shm *shm)
+{
+	unsigned int cnt = __atomic_load_n(&shm->hdr->cnt, __ATOMIC_RELAXED);
+
+	/* Never trust a value read from a concurrently modified segment. */
+	return (cnt <= shm->hdr->nr) ? cnt : shm->hdr->nr;
+}
+
+int
+nlink_shm_find(const struct nlink_shm *shm,
+               int                     index,
+               struct nlink_iface_rec *rec)
+{
+	nlink_shm_assert(shm);
+	nlink_assert(index > 0);
+	nlink_assert(rec);
+
+	uint32_t seq;
+	int      err;
+
+	do {
+		unsigned int cnt;
+		unsigned int r;
+
+		err = nlink_shm_read_begin(shm, &seq);
+		if (err)
+			return err;
+
+		cnt = nlink_shm_count(shm);
+		r = nlink_shm_bisect(shm->hdr->recs, cnt, index);
+		if ((r < cnt) && (shm->hdr->recs[r].index == index)) {
+			*rec = shm->hdr->recs[r];
+			err = 0;
+		}
+		else
+			err = -ENODEV;
+	} while (nlink_shm_read_retry(shm, seq));
+
+	return err;
+}
+
+/*
+ * Copy a consistent view of at most nr published records.
+ *
+ * Returns the number of records copied or -ESTALE when publisher closed the
+ * segment.
+ */
+int
+nlink_shm_copy(const struct nlink_shm *shm,
+               struct nlink_iface_rec *recs,
+               unsigned int            nr)
+{
+	nlink_shm_assert(shm);
+	nlink_assert(recs);
+	nlink_assert(nr);
+	nlink_assert(nr <= INT_MAX);
+
+	uint32_t     seq;
+	unsigned int cnt;
+	int          err;
+
+	do {
+		err = nlink_shm_read_begin(shm, &seq);
+		if (err)
+			return err;
+
+		cnt = nlink_shm_count(shm);
+		if (cnt > nr)
+			cnt = nr;
+		memcpy(recs, shm->hdr->recs, cnt * sizeof(recs[0]));
+	} while (nlink_shm_read_retry(shm, seq));
+
+	return (int)cnt;
+}
+
+static uint64_t
+nlink_shm_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * Wait for published state to change without registering as a waiter, i.e.
+ * sleeping NLINK_SHM_POLL_NSEC at most between consecutive checks.
+ */
+static int
+nlink_shm_poll(const struct nlink_shm *shm,
+               uint32_t               *seq,
+               const struct timespec  *timeout)
+{
+	uint64_t end = 0;
+
+	if (timeout)
+		end = nlink_shm_now() +
+		      ((uint64_t)timeout->tv_sec * 1000000000ULL) +
+		      (uint64_t)timeout->tv_nsec;
+
+	while (true) {
+		uint32_t        curr;
+		struct timespec tmo = {
+			.tv_sec  = 0,
+			.tv_nsec = NLINK_SHM_POLL_NSEC
+		};
+
+		curr = __atomic_load_n(&shm->hdr->seq, __ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&shm->hdr->closed, __ATOMIC_RELAXED))
+			return -ESTALE;
+		if (!(curr & 1) && (curr != *seq)) {
+			*seq = curr;
+			return 0;
+		}
+
+		if (timeout) {
+			uint64_t now = nlink_shm_now();
+
+			if (now >= end)
+				return -ETIMEDOUT;
+			if ((end - now) < (uint64_t)tmo.tv_nsec)
+				tmo.tv_nsec = (long)(end - now);
+		}
+
+		if (nlink_shm_futex(&shm->hdr->seq, FUTEX_WAIT, curr, &tmo)) {
+			nlink_assert(errno != EFAULT);
+			nlink_assert(errno != EINVAL);
+
+			/* EAGAIN and ETIMEDOUT: check seq again. */
+			if (errno == EINTR)
+				return -EINTR;
+		}
+	}
+}
+
+/*
+ * Wait for published state to change.
+ *
+ * *seq should hold the sequence number of the last view the caller retrieved
+ * (as stored by nlink_shm_read_begin()). Upon success, *seq is updated to the
+ * current sequence number. A NULL timeout waits forever.
+ *
+ * Returns 0 when state changed, -ETIMEDOUT when timeout expired, -EINTR when
+ * interrupted by a signal and -ESTALE when publisher closed the segment.
+ */
+int
+nlink_shm_wait(const struct nlink_shm *shm,
+               uint32_t               *seq,
+               const struct timespec  *timeout)
+{
+	nlink_shm_assert(shm);
+	nlink_assert(seq);
+
+	if (!shm->rw)
+		return nlink_shm_poll(shm, seq, timeout);
+
+	while (true) {
+		uint32_t curr;
+		int      err;
+
+		curr = __atomic_load_n(&shm->hdr->seq, __ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&shm->hdr->closed, __ATOMIC_RELAXED))
+			return -ESTALE;
+		if (!(curr & 1) && (curr != *seq)) {
+			*seq = curr;
+			return 0;
+		}
+
+		/*
+		 * Either unchanged or update in progress: sleep. Registration
+		 * must be visible before kernel checks seq, see
+		 * nlink_shm_write_end().
+		 */
+		__atomic_add_fetch(&shm->hdr->waiters, 1, __ATOMIC_SEQ_CST);
+		err = nlink_shm_futex(&shm->hdr->seq, FUTEX_WAIT, curr, timeout);
+		if (err)
+			err = errno;
+		__atomic_sub_fetch(&shm->hdr->waiters, 1, __ATOMIC_RELAXED);
+
+		if (err) {
+			nlink_assert(err != EFAULT);
+			nlink_assert(err != EINVAL);
+
+			if (err == EAGAIN)
+				/* seq changed before we could sleep. */
+				continue;
+
+			return -err;
+		}
+	}
+}
+
+static int
+nlink_shm_map(struct nlink_shm *shm, int fd, int prot)
+{
+	struct stat st;
+	void       *map;
+
+	if (fstat(fd, &st))
+		return -errno;
+
+	if ((size_t)st.st_size < sizeof(struct nlink_shm_hdr))
+		return -EBADMSG;
+
+	map = mmap(NULL, (size_t)st.st_size, prot, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return -errno;
+
+	shm->hdr = map;
+	shm->size = (size_t)st.st_size;
+	shm->rw = !!(prot & PROT_WRITE);
+
+	return 0;
+}
+
+/*
+ * Map segment published under the given name.
+ *
+ * Segment is mapped read-write when permissions allow it so that
+ * nlink_shm_wait() may register as a waiter ; readers should never modify
+ * records though. Mapping falls back to read-only otherwise.
+ */
+int
+nlink_shm_open(struct nlink_shm *shm, const char *name)
+{
+	nlink_assert(shm);
+	nlink_assert(name);
+	nlink_assert(*name == '/');
+
+	const struct nlink_shm_hdr *hdr;
+	int                         prot;
+	int                         fd;
+	int                         err;
+
+	prot = PROT_READ | PROT_WRITE;
+	fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+	if ((fd < 0) && (errno == EACCES)) {
+		prot = PROT_READ;
+		fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+	}
+	if (fd < 0)
+		return -errno;
+
+	err = nlink_shm_map(shm, fd, prot);
+
+	close(fd);
+
+	if (err)
+		return err;
+
+	hdr = shm->hdr;
+	if (memcmp(hdr->magic, NLINK_SHM_MAGIC, sizeof(hdr->magic)) ||
+	    (hdr->version != NLINK_SHM_VERSION) ||
+	    (hdr->rec_size != sizeof(hdr->recs[0])) ||
+	    !hdr->nr ||
+	    (shm->size < (sizeof(*hdr) +
+	                  ((size_t)hdr->nr * sizeof(hdr->recs[0]))))) {
+		munmap(shm->hdr, shm->size);
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+void
+nlink_shm_close(struct nlink_shm *shm)
+{
+	nlink_shm_assert(shm);
+
+	munmap(shm->hdr, shm->size);
+}
+
+/******************************************************************************
+ * Publisher side
+ ******************************************************************************/
+
+static void
+nlink_shm_write_begin(struct nlink_shm *shm)
+{
+	nlink_assert(!(shm->hdr->seq & 1));
+
+	__atomic_store_n(&shm->hdr->seq, shm->hdr->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void
+nlink_shm_write_end(struct nlink_shm *shm)
+{
+	nlink_assert(shm->hdr->seq & 1);
+
+	/*
+	 * Full barrier between seq store and waiters load, pairing with the
+	 * one between waiters registration and seq check in nlink_shm_wait():
+	 * either we see the registration or the reader sees the new seq.
+	 */
+	__atomic_store_n(&shm->hdr->seq, shm->hdr->seq + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&shm->hdr->waiters, __ATOMIC_SEQ_CST))
+		nlink_shm_futex(&shm->hdr->seq, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+/*
+ * Tell readers the segment is closed for good, even if a publisher went away
+ * in the middle of an update.
+ */
+static void
+nlink_shm_seal(struct nlink_shm_hdr *hdr)
+{
+	__atomic_store_n(&hdr->closed, 1, __ATOMIC_RELAXED);
+
+	/*
+	 * Release closed along with an even seq change so that readers about
+	 * to sleep on the former value fail to, then wake up all others.
+	 */
+	__atomic_store_n(&hdr->seq, (hdr->seq | 1) + 1, __ATOMIC_SEQ_CST);
+	nlink_shm_futex(&hdr->seq, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+/*
+ * Seal segment left over by a previous publisher which did not destroy it,
+ * i.e. crashed, so that readers still mapping it do not wait forever.
+ */
+static void
+nlink_shm_seal_stale(const char *name)
+{
+	struct nlink_shm shm;
+	int              fd;
+	int              err;
+
+	fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+	if (fd < 0)
+		return;
+
+	err = nlink_shm_map(&shm, fd, PROT_READ | PROT_WRITE);
+
+	close(fd);
+
+	if (err)
+		return;
+
+	if (!memcmp(shm.hdr->magic, NLINK_SHM_MAGIC, sizeof(shm.hdr->magic)) &&
+	    (shm.hdr->version == NLINK_SHM_VERSION))
+		nlink_shm_seal(shm.hdr);
+
+	munmap(shm.hdr, shm.size);
+}
+
+int
+nlink_shm_publish(struct nlink_shm *shm, const struct nlink_iface *iface)
+{
+	nlink_shm_assert(shm);
+	nlink_assert(iface);
+
+	struct nlink_shm_hdr   *hdr = shm->hdr;
+	struct nlink_iface_rec  rec;
+	unsigned int            r;
+	bool                    found;
+
+	nlink_iface_pack_rec(&rec, iface);
+
+	r = nlink_shm_bisect(hdr->recs, hdr->cnt, rec.index);
+	found = (r < hdr->cnt) && (hdr->recs[r].index == rec.index);
+	if (found) {
+		if (nlink_iface_rec_equal(&hdr->recs[r], &rec))
+			/* Do not wake readers up for nothing. */
+			return 0;
+	}
+	else if (hdr->cnt == hdr->nr)
+		return -ENOSPC;
+
+	nlink_shm_write_begin(shm);
+
+	if (!found) {
+		memmove(&hdr->recs[r + 1],
+		        &hdr->recs[r],
+		        (hdr->cnt - r) * sizeof(hdr->recs[0]));
+		hdr->cnt++;
+	}
+	hdr->recs[r] = rec;
+
+	nlink_shm_write_end(shm);
+
+	return 0;
+}
+
+void
+nlink_shm_unpublish(struct nlink_shm *shm, int index)
+{
+	nlink_shm_assert(shm);
+	nlink_assert(index > 0);
+
+	struct nlink_shm_hdr *hdr = shm->hdr;
+	unsigned int          r;
+
+	r = nlink_shm_bisect(hdr->recs, hdr->cnt, index);
+	if ((r == hdr->cnt) || (hdr->recs[r].index != index))
+		return;
+
+	nlink_shm_write_begin(shm);
+
+	hdr->cnt--;
+	memmove(&hdr->recs[r],
+	        &hdr->recs[r + 1],
+	        (hdr->cnt - r) * sizeof(hdr->recs[0]));
+
+	nlink_shm_write_end(shm);
+}
+
+int
+nlink_shm_process_msg(struct nlink_shm *shm, const struct nlmsghdr *msg)
+{
+	nlink_shm_assert(shm);
+	nlink_assert(msg);
+
+	switch (msg->nlmsg_type) {
+	case RTM_NEWLINK:
+	{
+		struct nlink_iface iface;
+		int                err;
+
+		err = nlink_iface_parse_msg(msg, &iface);
+		if (err)
+			return err;
+
+		return nlink_shm_publish(shm, &iface);
+	}
+
+	case RTM_DELLINK:
+	{
+		const struct ifinfomsg *info;
+
+		if (mnl_nlmsg_get_payload_len(msg) < sizeof(*info))
+			return -EBADMSG;
+
+		info = mnl_nlmsg_get_payload(msg);
+		if (info->ifi_index <= 0)
+			return -EBADMSG;
+
+		nlink_shm_unpublish(shm, info->ifi_index);
+
+		return 0;
+	}
+
+	default:
+		return -ENOMSG;
+	}
+}
+
+/*
+ * Create a segment able to publish up to nr interfaces under the given name.
+ *
+ * Segment is world readable ; only the creating process should publish into
+ * it.
+ */
+int
+nlink_shm_create(struct nlink_shm *shm, const char *name, unsigned int nr)
+{
+	nlink_assert(shm);
+	nlink_assert(name);
+	nlink_assert(*name == '/');
+	nlink_assert(nr);
+
+	struct nlink_shm_hdr *hdr;
+	size_t                size = sizeof(*hdr) +
+	                             ((size_t)nr * sizeof(hdr->recs[0]));
+	int                   fd;
+	int                   err;
+
+	/*
+	 * Never truncate a segment left over by a previous publisher since
+	 * readers still mapping it would get SIGBUS: seal it and create a new
+	 * one instead.
+	 */
+	nlink_shm_seal_stale(name);
+	shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -errno;
+
+	if (ftruncate(fd, (off_t)size)) {
+		err = -errno;
+		goto unlink;
+	}
+
+	err = nlink_shm_map(shm, fd, PROT_READ | PROT_WRITE);
+	if (err)
+		goto unlink;
+
+	close(fd);
+
+	hdr = shm->hdr;
+	hdr->version = NLINK_SHM_VERSION;
+	hdr->rec_size = sizeof(hdr->recs[0]);
+	hdr->nr = nr;
+	hdr->seq = 0;
+	hdr->cnt = 0;
+	hdr->waiters = 0;
+	hdr->closed = 0;
+	hdr->pad = 0;
+
+	/* Magic last so that readers never see a partially initialized header. */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(hdr->magic, NLINK_SHM_MAGIC, sizeof(hdr->magic));
+
+	return 0;
+
+unlink:
+	close(fd);
+	shm_unlink(name);
+
+	return err;
+}
+
+void
+nlink_shm_destroy(struct nlink_shm *shm, const char *name)
+{
+	nlink_shm_assert(shm);
+	nlink_assert(name);
+	nlink_assert(*name == '/');
+
+	/* Readers keep their mapping valid till they close it. */
+	shm_unlink(name);
+	nlink_shm_seal(shm->hdr);
+	munmap(shm->hdr, shm->size);
+}
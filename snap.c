@@ -0,0 +1,723 @@
+#include <nlink/snap.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/if_addr.h>
+#include <linux/neighbour.h>
+
+/* Maximum number of dump restarts due to interruption or event loss. */
+#define NLINK_SNAP_RETRY_NR (8U)
+
+struct nlink_snap_key {
+	unsigned int len;
+	uint8_t      data[NLINK_SNAP_KEY_SIZE];
+};
+
+typedef int (nlink_snap_key_fn)(const struct nlmsghdr *msg,
+                                struct nlink_snap_key *key);
+
+struct nlink_snap_desc {
+	uint16_t               new_type;
+	uint16_t               del_type;
+	uint16_t               dump_type;
+	size_t                 hdr_size;
+	unsigned int           group_nr;
+	enum rtnetlink_groups  groups[2];
+	nlink_snap_key_fn     *key;
+};
+
+/******************************************************************************
+ * Object keys
+ ******************************************************************************/
+
+static int
+nlink_snap_put_key(struct nlink_snap_key *key, const void *data, size_t size)
+{
+	nlink_assert(key);
+	nlink_assert(data || !size);
+
+	if ((key->len + size) > sizeof(key->data))
+		return -EMSGSIZE;
+
+	memcpy(&key->data[key->len], data, size);
+	key->len += size;
+
+	return 0;
+}
+
+static int
+nlink_snap_put_attr_key(struct nlink_snap_key *key,
+                        const struct nlmsghdr *msg,
+                        size_t                 hdr_size,
+                        uint16_t               type)
+{
+	const struct nlattr *attr;
+
+	mnl_attr_for_each(attr, msg, hdr_size) {
+		if (mnl_attr_get_type(attr) == type)
+			return nlink_snap_put_key(key,
+			                          mnl_attr_get_payload(attr),
+			                          mnl_attr_get_payload_len(attr));
+	}
+
+	/* Missing attributes are part of the identity too. */
+	return 0;
+}
+
+static int
+nlink_snap_link_key(const struct nlmsghdr *msg, struct nlink_snap_key *key)
+{
+	const struct ifinfomsg *info = mnl_nlmsg_get_payload(msg);
+
+	if (mnl_nlmsg_get_payload_len(msg) < sizeof(*info))
+		return -EBADMSG;
+
+	return nlink_snap_put_key(key, &info->ifi_index, sizeof(info->ifi_index));
+}
+
+static int
+nlink_snap_addr_key(const struct nlmsghdr *msg, struct nlink_snap_key *key)
+{
+	const struct ifaddrmsg *info = mnl_nlmsg_get_payload(msg);
+	const struct nlattr    *attr;
+	uint16_t                type = IFA_ADDRESS;
+
+	if (mnl_nlmsg_get_payload_len(msg) < sizeof(*info))
+		return -EBADMSG;
+
+	nlink_snap_put_key(key, &info->ifa_family, sizeof(info->ifa_family));
+	nlink_snap_put_key(key,
+	                   &info->ifa_prefixlen,
+	                   sizeof(info->ifa_prefixlen));
+	nlink_snap_put_key(key, &info->ifa_index, sizeof(info->ifa_index));
+
+	/* IFA_LOCAL identifies point-to-point addresses. */
+	mnl_attr_for_each(attr, msg, sizeof(*info)) {
+		if (mnl_attr_get_type(attr) == IFA_LOCAL) {
+			type = IFA_LOCAL;
+			break;
+		}
+	}
+
+	return nlink_snap_put_attr_key(key, msg, sizeof(*info), type);
+}
+
+static int
+nlink_snap_route_key(const struct nlmsghdr *msg, struct nlink_snap_key *key)
+{
+	const struct rtmsg  *info = mnl_nlmsg_get_payload(msg);
+	const struct nlattr *attr;
+	uint32_t             table;
+	uint32_t             prio = 0;
+
+	if (mnl_nlmsg_get_payload_len(msg) < sizeof(*info))
+		return -EBADMSG;
+
+	table = info->rtm_table;
+	mnl_attr_for_each(attr, msg, sizeof(*info)) {
+		switch (mnl_attr_get_type(attr)) {
+		case RTA_TABLE:
+			if (!mnl_attr_validate(attr, MNL_TYPE_U32))
+				table = mnl_attr_get_u32(attr);
+			break;
+
+		case RTA_PRIORITY:
+			if (!mnl_attr_validate(attr, MNL_TYPE_U32))
+				prio = mnl_attr_get_u32(attr);
+			break;
+		}
+	}
+
+	nlink_snap_put_key(key, &info->rtm_family, sizeof(info->rtm_family));
+	nlink_snap_put_key(key, &info->rtm_dst_len, sizeof(info->rtm_dst_len));
+	nlink_snap_put_key(key, &info->rtm_tos, sizeof(info->rtm_tos));
+	nlink_snap_put_key(key, &table, sizeof(table));
+	nlink_snap_put_key(key, &prio, sizeof(prio));
+
+	return nlink_snap_put_attr_key(key, msg, sizeof(*info), RTA_DST);
+}
+
+static int
+nlink_snap_neigh_key(const struct nlmsghdr *msg, struct nlink_snap_key *key)
+{
+	const struct ndmsg *info = mnl_nlmsg_get_payload(msg);
+	int                 err;
+
+	if (mnl_nlmsg_get_payload_len(msg) < sizeof(*info))
+		return -EBADMSG;
+
+	nlink_snap_put_key(key, &info->ndm_family, sizeof(info->ndm_family));
+	nlink_snap_put_key(key, &info->ndm_ifindex, sizeof(info->ndm_ifindex));
+
+	if (info->ndm_family != AF_BRIDGE)
+		return nlink_snap_put_attr_key(key,
+		                               msg,
+		                               sizeof(*info),
+		                               NDA_DST);
+
+	/* Bridge forwarding database entries are keyed by MAC and VLAN. */
+	err = nlink_snap_put_attr_key(key, msg, sizeof(*info), NDA_LLADDR);
+	if (err)
+		return err;
+
+	return nlink_snap_put_attr_key(key, msg, sizeof(*info), NDA_VLAN);
+}
+
+static const struct nlink_snap_desc nlink_snap_descs[NLINK_SNAP_KIND_NR] = {
+	[NLINK_SNAP_LINK_KIND] = {
+		.new_type  = RTM_NEWLINK,
+		.del_type  = RTM_DELLINK,
+		.dump_type = RTM_GETLINK,
+		.hdr_size  = sizeof(struct ifinfomsg),
+		.group_nr  = 1,
+		.groups    = { RTNLGRP_LINK },
+		.key       = nlink_snap_link_key
+	},
+	[NLINK_SNAP_ADDR_KIND] = {
+		.new_type  = RTM_NEWADDR,
+		.del_type  = RTM_DELADDR,
+		.dump_type = RTM_GETADDR,
+		.hdr_size  = sizeof(struct ifaddrmsg),
+		.group_nr  = 2,
+		.groups    = { RTNLGRP_IPV4_IFADDR, RTNLGRP_IPV6_IFADDR },
+		.key       = nlink_snap_addr_key
+	},
+	[NLINK_SNAP_ROUTE_KIND] = {
+		.new_type  = RTM_NEWROUTE,
+		.del_type  = RTM_DELROUTE,
+		.dump_type = RTM_GETROUTE,
+		.hdr_size  = sizeof(struct rtmsg),
+		.group_nr  = 2,
+		.groups    = { RTNLGRP_IPV4_ROUTE, RTNLGRP_IPV6_ROUTE },
+		.key       = nlink_snap_route_key
+	},
+	[NLINK_SNAP_NEIGH_KIND] = {
+		.new_type  = RTM_NEWNEIGH,
+		.del_type  = RTM_DELNEIGH,
+		.dump_type = RTM_GETNEIGH,
+		.hdr_size  = sizeof(struct ndmsg),
+		.group_nr  = 1,
+		.groups    = { RTNLGRP_NEIGH },
+		.key       = nlink_snap_neigh_key
+	}
+};
+
+static int
+nlink_snap_make_key(enum nlink_snap_kind   kind,
+                    const struct nlmsghdr *msg,
+                    struct nlink_snap_key *key,
+                    uint32_t              *digest)
+{
+	nlink_assert(kind < NLINK_SNAP_KIND_NR);
+	nlink_assert(msg);
+	nlink_assert(key);
+	nlink_assert(digest);
+
+	unsigned int b;
+	uint32_t     hash = 2166136261U;
+	int          err;
+
+	key->len = 0;
+	err = nlink_snap_descs[kind].key(msg, key);
+	if (err)
+		return err;
+
+	/* FNV-1a. */
+	for (b = 0; b < key->len; b++) {
+		hash ^= key->data[b];
+		hash *= 16777619U;
+	}
+
+	*digest = hash;
+
+	return 0;
+}
+
+/******************************************************************************
+ * Object table
+ ******************************************************************************/
+
+static struct nlink_snap_obj *
+nlink_snap_alloc_obj(const struct nlmsghdr *msg)
+{
+	struct nlink_snap_obj *obj;
+
+	obj = malloc(sizeof(*obj) + msg->nlmsg_len);
+	if (!obj)
+		return NULL;
+
+	memcpy(obj->msg, msg, msg->nlmsg_len);
+
+	return obj;
+}
+
+static struct nlink_snap_obj *
+nlink_snap_lookup(const struct nlink_snap_tab *tab,
+                  const struct nlink_snap_key *key,
+                  uint32_t                     digest)
+{
+	const struct dlist_node *bucket = &tab->buckets[digest % tab->nr];
+	struct nlink_snap_obj   *obj;
+
+	dlist_foreach_entry(bucket, obj, hash) {
+		if ((obj->digest == digest) &&
+		    (obj->key_len == key->len) &&
+		    !memcmp(obj->key, key->data, key->len))
+			return obj;
+	}
+
+	return NULL;
+}
+
+static void
+nlink_snap_unlink_obj(struct nlink_snap_tab *tab, struct nlink_snap_obj *obj)
+{
+	nlink_assert(tab->cnt);
+
+	dlist_remove(&obj->node);
+	dlist_remove(&obj->hash);
+	tab->cnt--;
+}
+
+static int
+nlink_snap_upsert(struct nlink_snap_tab *tab, const struct nlmsghdr *msg)
+{
+	struct nlink_snap_key  key;
+	uint32_t               digest;
+	struct nlink_snap_obj *old;
+	struct nlink_snap_obj *obj;
+	int                    err;
+
+	err = nlink_snap_make_key(tab->kind, msg, &key, &digest);
+	if (err)
+		return err;
+
+	obj = nlink_snap_alloc_obj(msg);
+	if (!obj)
+		return -errno;
+
+	obj->digest = digest;
+	obj->key_len = key.len;
+	memcpy(obj->key, key.data, key.len);
+
+	old = nlink_snap_lookup(tab, &key, digest);
+	if (old) {
+		nlink_snap_unlink_obj(tab, old);
+		free(old);
+	}
+
+	dlist_nqueue_back(&tab->objs, &obj->node);
+	dlist_nqueue_back(&tab->buckets[digest % tab->nr], &obj->hash);
+	tab->cnt++;
+
+	return 0;
+}
+
+static int
+nlink_snap_remove(struct nlink_snap_tab *tab, const struct nlmsghdr *msg)
+{
+	struct nlink_snap_key  key;
+	uint32_t               digest;
+	struct nlink_snap_obj *obj;
+	int                    err;
+
+	err = nlink_snap_make_key(tab->kind, msg, &key, &digest);
+	if (err)
+		return err;
+
+	obj = nlink_snap_lookup(tab, &key, digest);
+	if (obj) {
+		nlink_snap_unlink_obj(tab, obj);
+		free(obj);
+	}
+
+	return 0;
+}
+
+static int
+nlink_snap_apply(struct nlink_snap_tab *tab, const struct nlmsghdr *msg)
+{
+	const struct nlink_snap_desc *desc = &nlink_snap_descs[tab->kind];
+
+	if (msg->nlmsg_type == desc->new_type)
+		return nlink_snap_upsert(tab, msg);
+
+	if (msg->nlmsg_type == desc->del_type)
+		return nlink_snap_remove(tab, msg);
+
+	return -ENOMSG;
+}
+
+static void
+nlink_snap_clear(struct dlist_node *objs)
+{
+	while (!dlist_empty(objs))
+		free(dlist_entry(dlist_dqueue_front(objs),
+		                 struct nlink_snap_obj,
+		                 node));
+}
+
+static void
+nlink_snap_clear_tab(struct nlink_snap_tab *tab)
+{
+	unsigned int b;
+
+	nlink_snap_clear(&tab->objs);
+
+	for (b = 0; b < tab->nr; b++)
+		dlist_init(&tab->buckets[b]);
+
+	tab->cnt = 0;
+}
+
+/******************************************************************************
+ * Dump workers
+ ******************************************************************************/
+
+static int
+nlink_snap_queue_event(struct nlink_snap_tab *tab,
+                       struct dlist_node     *events,
+                       const struct nlmsghdr *msg)
+{
+	const struct nlink_snap_desc *desc = &nlink_snap_descs[tab->kind];
+	struct nlink_snap_obj        *evt;
+
+	if ((msg->nlmsg_type != desc->new_type) &&
+	    (msg->nlmsg_type != desc->del_type))
+		return 0;
+
+	evt = nlink_snap_alloc_obj(msg);
+	if (!evt)
+		return -errno;
+
+	dlist_nqueue_back(events, &evt->node);
+
+	return 0;
+}
+
+/*
+ * Run a dump and fill table with its results, queueing events received in
+ * between.
+ *
+ * Returns -EINTR when dump results may not be trusted, i.e. when kernel
+ * reported an inconsistent dump or events were lost because of receive queue
+ * overrun. In both cases, dump is drained up to its end so that a new one may
+ * be requested.
+ */
+static int
+nlink_snap_dump(struct nlink_snap_tab *tab,
+                struct nlmsghdr       *buff,
+                struct dlist_node     *events)
+{
+	const struct nlink_snap_desc *desc = &nlink_snap_descs[tab->kind];
+	uint32_t                      seqno;
+	bool                          intr = false;
+	bool                          done = false;
+	int                           err;
+
+	mnl_nlmsg_put_header(buff);
+	buff->nlmsg_type = desc->dump_type;
+	buff->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	buff->nlmsg_seq = seqno = nlink_alloc_seqno(&tab->sock);
+	buff->nlmsg_pid = tab->sock.port_id;
+	mnl_nlmsg_put_extra_header(buff, desc->hdr_size);
+
+	err = (int)nlink_send_msg(&tab->sock, buff);
+	if (err)
+		return err;
+
+	do {
+		const struct nlmsghdr *msg;
+		ssize_t                ret;
+		int                    bytes;
+
+		ret = nlink_recv_msg(&tab->sock, buff);
+		if (ret < 0) {
+			if (ret == -EINTR)
+				continue;
+
+			if (ret == -ENOBUFS) {
+				/* Events lost: drain dump then restart. */
+				intr = true;
+				continue;
+			}
+
+			return (int)ret;
+		}
+
+		for (msg = buff, bytes = (int)ret;
+		     mnl_nlmsg_ok(msg, bytes);
+		     msg = mnl_nlmsg_next(msg, &bytes)) {
+			if ((msg->nlmsg_seq != seqno) ||
+			    (msg->nlmsg_pid != tab->sock.port_id)) {
+				/*
+				 * Multicast event: defer processing since
+				 * it may relate to an object the dump has not
+				 * reported yet.
+				 */
+				err = nlink_snap_queue_event(tab, events, msg);
+				if (err)
+					return err;
+				continue;
+			}
+
+			if (msg->nlmsg_flags & NLM_F_DUMP_INTR)
+				intr = true;
+
+			switch (msg->nlmsg_type) {
+			case NLMSG_DONE:
+				/* NLMSG_DONE may carry a dump error code. */
+				if ((mnl_nlmsg_get_payload_len(msg) >=
+				     sizeof(int)) &&
+				    (*(int *)mnl_nlmsg_get_payload(msg) < 0))
+					return *(int *)mnl_nlmsg_get_payload(msg);
+				done = true;
+				break;
+
+			case NLMSG_ERROR:
+				err = nlink_parse_error_msg(msg);
+				return (err == -ENODATA) ? -EPROTO : err;
+
+			case NLMSG_OVERRUN:
+				intr = true;
+				break;
+
+			case NLMSG_NOOP:
+				break;
+
+			default:
+				if (!intr) {
+					err = nlink_snap_upsert(tab, msg);
+					if (err)
+						return err;
+				}
+			}
+		}
+	} while (!done);
+
+	return intr ? -EINTR : 0;
+}
+
+static void *
+nlink_snap_work(void *arg)
+{
+	struct nlink_snap_tab *tab = arg;
+	struct nlmsghdr       *buff;
+	struct dlist_node      events;
+	unsigned int           retry;
+	int                    err = -EINTR;
+
+	buff = nlink_alloc_msg();
+	if (!buff) {
+		tab->err = -errno;
+		return NULL;
+	}
+
+	dlist_init(&events);
+
+	for (retry = 0; (retry < NLINK_SNAP_RETRY_NR) && (err == -EINTR);
+	     retry++) {
+		nlink_snap_clear_tab(tab);
+		nlink_snap_clear(&events);
+
+		err = nlink_snap_dump(tab, buff, &events);
+	}
+
+	if (err == -EINTR)
+		err = -EAGAIN;
+
+	/*
+	 * Now apply events received while dumping in order of arrival. As
+	 * events carry full object state, the table ends up reflecting the
+	 * latest state whether a given event occurred before or after the
+	 * dump visited the related object.
+	 */
+	while (!dlist_empty(&events)) {
+		struct nlink_snap_obj *evt;
+
+		evt = dlist_entry(dlist_dqueue_front(&events),
+		                  struct nlink_snap_obj,
+		                  node);
+		if (!err)
+			err = nlink_snap_apply(tab, evt->msg);
+
+		free(evt);
+	}
+
+	nlink_free_msg(buff);
+
+	tab->err = err;
+
+	return NULL;
+}
+
+/******************************************************************************
+ * Snapshot handling
+ ******************************************************************************/
+
+const struct nlmsghdr *
+nlink_snap_find(struct nlink_snap     *snap,
+                enum nlink_snap_kind   kind,
+                const struct nlmsghdr *msg)
+{
+	nlink_assert(msg);
+
+	const struct nlink_snap_tab *tab = nlink_snap_tab(snap, kind);
+	struct nlink_snap_key        key;
+	uint32_t                     digest;
+	const struct nlink_snap_obj *obj;
+
+	if (nlink_snap_make_key(kind, msg, &key, &digest))
+		return NULL;
+
+	obj = nlink_snap_lookup(tab, &key, digest);
+
+	return obj ? obj->msg : NULL;
+}
+
+int
+nlink_snap_process_msg(struct nlink_snap     *snap,
+                       enum nlink_snap_kind   kind,
+                       const struct nlmsghdr *msg)
+{
+	nlink_assert(msg);
+
+	return nlink_snap_apply(nlink_snap_tab(snap, kind), msg);
+}
+
+int
+nlink_snap_load(struct nlink_snap *snap)
+{
+	nlink_snap_assert(snap);
+
+	unsigned int started = 0;
+	unsigned int k;
+	int          err = 0;
+
+	/* Run one dump per object kind concurrently. */
+	for (k = 0; k < NLINK_SNAP_KIND_NR; k++) {
+		struct nlink_snap_tab *tab = &snap->tabs[k];
+
+		if (!(snap->kinds & (1U << k)))
+			continue;
+
+		tab->err = pthread_create(&tab->thread,
+		                          NULL,
+		                          nlink_snap_work,
+		                          tab);
+		if (tab->err) {
+			tab->err = -tab->err;
+			break;
+		}
+
+		started |= 1U << k;
+	}
+
+	for (k = 0; k < NLINK_SNAP_KIND_NR; k++) {
+		struct nlink_snap_tab *tab = &snap->tabs[k];
+
+		if (!(snap->kinds & (1U << k)))
+			continue;
+
+		if (started & (1U << k))
+			pthread_join(tab->thread, NULL);
+
+		if (!err)
+			err = tab->err;
+	}
+
+	return err;
+}
+
+static void
+nlink_snap_fini_tab(struct nlink_snap_tab *tab)
+{
+	nlink_snap_clear_tab(tab);
+	nlink_close_sock(&tab->sock);
+	free(tab->buckets);
+}
+
+static int
+nlink_snap_init_tab(struct nlink_snap_tab *tab,
+                    enum nlink_snap_kind   kind,
+                    unsigned int           nr)
+{
+	const struct nlink_snap_desc *desc = &nlink_snap_descs[kind];
+	unsigned int                  g;
+	int                           err;
+
+	tab->buckets = malloc(nr * sizeof(tab->buckets[0]));
+	if (!tab->buckets)
+		return -errno;
+
+	err = nlink_open_route_sock(&tab->sock, SOCK_CLOEXEC);
+	if (err)
+		goto free;
+
+	/* Subscribe before dumping so that no event may be missed. */
+	for (g = 0; g < desc->group_nr; g++) {
+		err = nlink_join_route_group(&tab->sock, desc->groups[g]);
+		if (err)
+			goto close;
+	}
+
+	tab->kind = kind;
+	tab->nr = nr;
+	dlist_init(&tab->objs);
+	nlink_snap_clear_tab(tab);
+	tab->err = 0;
+
+	return 0;
+
+close:
+	nlink_close_sock(&tab->sock);
+free:
+	free(tab->buckets);
+
+	return err;
+}
+
+int
+nlink_snap_init(struct nlink_snap *snap, unsigned int kinds, unsigned int nr)
+{
+	nlink_assert(snap);
+	nlink_assert(kinds);
+	nlink_assert(!(kinds & ~NLINK_SNAP_ALL));
+	nlink_assert(nr);
+
+	unsigned int k;
+	int          err;
+
+	for (k = 0; k < NLINK_SNAP_KIND_NR; k++) {
+		if (!(kinds & (1U << k)))
+			continue;
+
+		err = nlink_snap_init_tab(&snap->tabs[k], k, nr);
+		if (err)
+			goto fini;
+	}
+
+	snap->kinds = kinds;
+
+	return 0;
+
+fini:
+	while (k--) {
+		if (kinds & (1U << k))
+			nlink_snap_fini_tab(&snap->tabs[k]);
+	}
+
+	return err;
+}
+
+void
+nlink_snap_fini(struct nlink_snap *snap)
+{
+	nlink_snap_assert(snap);
+
+	unsigned int k;
+
+	for (k = 0; k < NLINK_SNAP_KIND_NR; k++) {
+		if (snap->kinds & (1U << k))
+			nlink_snap_fini_tab(&snap->tabs[k]);
+	}
+}
@@ -0,0 +1,509 @@
+#include <nlink/store.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define NLINK_STORE_BATCH_NR (32U)
+
+#define NLINK_STORE_BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+#define NLINK_STORE_NETNS_PATH   "/proc/self/ns/net"
+
+/******************************************************************************
+ * Snapshot identity
+ ******************************************************************************/
+
+static int
+nlink_store_ident(struct nlink_store_hdr *hdr)
+{
+	nlink_assert(hdr);
+
+	struct stat st;
+	int         fd;
+	ssize_t     ret;
+
+	if (stat(NLINK_STORE_NETNS_PATH, &st))
+		return -errno;
+
+	hdr->netns_dev = st.st_dev;
+	hdr->netns_ino = st.st_ino;
+
+	fd = open(NLINK_STORE_BOOT_ID_PATH, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	memset(hdr->boot_id, 0, sizeof(hdr->boot_id));
+	do {
+		ret = read(fd, hdr->boot_id, sizeof(hdr->boot_id) - 1);
+	} while ((ret < 0) && (errno == EINTR));
+
+	close(fd);
+
+	return (ret < 0) ? -errno : 0;
+}
+
+/* FNV-1a 64 bits. */
+static uint64_t
+nlink_store_sum(const struct nlink_iface_rec *recs, unsigned int nr)
+{
+	const uint8_t *data = (const uint8_t *)recs;
+	size_t         size = (size_t)nr * sizeof(recs[0]);
+	uint64_t       sum = 14695981039346656037ULL;
+	size_t         b;
+
+	for (b = 0; b < size; b++) {
+		sum ^= data[b];
+		sum *= 1099511628211ULL;
+	}
+
+	return sum;
+}
+
+/******************************************************************************
+ * Lookup and reconciliation
+ ******************************************************************************/
+
+static int
+nlink_store_cmp_rec(const void *first, const void *second)
+{
+	int32_t fst = ((const struct nlink_iface_rec *)first)->index;
+	int32_t snd = ((const struct nlink_iface_rec *)second)->index;
+
+	return (fst > snd) - (fst < snd);
+}
+
+const struct nlink_iface_rec *
+nlink_store_find(const struct nlink_store *store, int index)
+{
+	nlink_store_assert(store);
+	nlink_assert(index > 0);
+
+	const struct nlink_iface_rec key = { .index = index };
+
+	return bsearch(&key,
+	               store->hdr->recs,
+	               store->hdr->nr,
+	               sizeof(key),
+	               nlink_store_cmp_rec);
+}
+
+static int
+nlink_store_reconcile_batch(const struct nlink_store *store,
+                            const struct nlink_iface *ifaces,
+                            unsigned int              nr,
+                            unsigned long            *seen,
+                            nlink_store_reconcile_fn *reconcile,
+                            void                     *data)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		const struct nlink_iface_rec *old;
+		struct nlink_iface_rec        curr;
+		int                           err;
+
+		nlink_iface_pack_rec(&curr, &ifaces[i]);
+
+		old = nlink_store_find(store, curr.index);
+		if (old) {
+			size_t r = (size_t)(old - store->hdr->recs);
+
+			seen[r / LONG_BIT] |= 1UL << (r % LONG_BIT);
+			if (nlink_iface_rec_equal(old, &curr))
+				continue;
+		}
+
+		err = reconcile(old, &curr, data);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/*
+ * Compare snapshot against current kernel state and report differences only.
+ *
+ * Current state is retrieved using a link dump request skipping interface
+ * statistics so that kernel has much less data to produce.
+ *
+ * Returns -EINTR when kernel reported the dump as inconsistent. Differences
+ * reported so far remain valid, but caller should reconcile again to catch
+ * up with changes that happened while dumping.
+ */
+int
+nlink_store_reconcile(const struct nlink_store *store,
+                      struct nlink_sock        *sock,
+                      nlink_store_reconcile_fn *reconcile,
+                      void                     *data)
+{
+	nlink_store_assert(store);
+	nlink_assert(sock);
+	nlink_assert(reconcile);
+
+	unsigned int        nr = store->hdr->nr;
+	unsigned long      *seen;
+	struct nlmsghdr    *buff;
+	struct nlink_iface  ifaces[NLINK_STORE_BATCH_NR];
+	bool                intr = false;
+	bool                done = false;
+	unsigned int        r;
+	int                 err;
+
+	seen = calloc((nr + LONG_BIT - 1) / LONG_BIT, sizeof(*seen));
+	if (!seen && nr)
+		return -errno;
+
+	buff = nlink_alloc_msg();
+	if (!buff) {
+		err = -errno;
+		goto free;
+	}
+
+	nlink_iface_setup_dump(buff, sock);
+	mnl_attr_put_u32(buff, IFLA_EXT_MASK, RTEXT_FILTER_SKIP_STATS);
+
+	err = (int)nlink_send_msg(sock, buff);
+	if (err)
+		goto free_msg;
+
+	while (!done) {
+		const struct nlmsghdr *msg = buff;
+		ssize_t                ret;
+		int                    bytes;
+
+		ret = nlink_recv_msg(sock, buff);
+		if (ret < 0) {
+			if (ret == -EINTR)
+				continue;
+
+			err = (int)ret;
+			goto free_msg;
+		}
+
+		bytes = (int)ret;
+		do {
+			unsigned int cnt = NLINK_STORE_BATCH_NR;
+
+			err = nlink_iface_parse_batch(&msg, &bytes, ifaces, &cnt);
+			if (!intr) {
+				int res;
+
+				res = nlink_store_reconcile_batch(store,
+				                                  ifaces,
+				                                  cnt,
+				                                  seen,
+				                                  reconcile,
+				                                  data);
+				if (res) {
+					err = res;
+					goto free_msg;
+				}
+			}
+
+			switch (err) {
+			case 0:
+			case -EINPROGRESS:
+				break;
+
+			case -ENODATA:
+				done = true;
+				break;
+
+			case -EINTR:
+				/*
+				 * Go on draining dump till its end. Inconsistent
+				 * results are ignored from now on.
+				 */
+				intr = true;
+				if (msg->nlmsg_type == NLMSG_DONE) {
+					done = true;
+					break;
+				}
+				/* Fallthrough. */
+			case -ENOMSG:
+				/* Skip unrelated (notification) message. */
+				msg = mnl_nlmsg_next(msg, &bytes);
+				err = 0;
+				break;
+
+			default:
+				goto free_msg;
+			}
+		} while (!done && mnl_nlmsg_ok(msg, bytes));
+	}
+
+	if (intr) {
+		err = -EINTR;
+		goto free_msg;
+	}
+
+	/* Report interfaces removed since snapshot was saved. */
+	err = 0;
+	for (r = 0; r < nr; r++) {
+		if (!(seen[r / LONG_BIT] & (1UL << (r % LONG_BIT)))) {
+			err = reconcile(&store->hdr->recs[r], NULL, data);
+			if (err)
+				break;
+		}
+	}
+
+free_msg:
+	nlink_free_msg(buff);
+free:
+	free(seen);
+
+	return err;
+}
+
+/******************************************************************************
+ * Snapshot files
+ ******************************************************************************/
+
+static int
+nlink_store_write(int fd, const void *data, size_t size)
+{
+	const char *buff = data;
+
+	while (size) {
+		ssize_t ret;
+
+		ret = write(fd, buff, size);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			nlink_assert(errno != EBADF);
+			nlink_assert(errno != EFAULT);
+			nlink_assert(errno != EINVAL);
+
+			return -errno;
+		}
+
+		buff += ret;
+		size -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+static int
+nlink_store_sync_dir(const char *path)
+{
+	char       *dir;
+	const char *slash;
+	int         fd;
+	int         err = 0;
+
+	slash = strrchr(path, '/');
+	if (!slash)
+		dir = strdup(".");
+	else if (slash == path)
+		dir = strdup("/");
+	else
+		dir = strndup(path, (size_t)(slash - path));
+	if (!dir)
+		return -errno;
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		err = -errno;
+		goto free;
+	}
+
+	if (fsync(fd))
+		err = -errno;
+
+	close(fd);
+
+free:
+	free(dir);
+
+	return err;
+}
+
+/*
+ * Save snapshot of the given interface records.
+ *
+ * Snapshot is written into a temporary file which is renamed over the final
+ * path once synced to disk so that a crash may never leave a partially written
+ * snapshot behind.
+ */
+int
+nlink_store_save(const char                   *path,
+                 const struct nlink_iface_rec *recs,
+                 unsigned int                  nr)
+{
+	nlink_assert(path);
+	nlink_assert(*path);
+	nlink_assert(recs || !nr);
+
+	size_t                  size = sizeof(struct nlink_store_hdr) +
+	                               ((size_t)nr * sizeof(recs[0]));
+	struct nlink_store_hdr *hdr;
+	char                    tmp[PATH_MAX];
+	int                     fd;
+	int                     err;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+		return -ENAMETOOLONG;
+
+	hdr = malloc(size);
+	if (!hdr)
+		return -errno;
+
+	memcpy(hdr->magic, NLINK_STORE_MAGIC, sizeof(hdr->magic));
+	hdr->version = NLINK_STORE_VERSION;
+	hdr->rec_size = sizeof(recs[0]);
+	hdr->nr = nr;
+	hdr->pad = 0;
+
+	err = nlink_store_ident(hdr);
+	if (err)
+		goto free;
+
+	if (nr) {
+		memcpy(hdr->recs, recs, (size_t)nr * sizeof(recs[0]));
+		qsort(hdr->recs, nr, sizeof(recs[0]), nlink_store_cmp_rec);
+	}
+	hdr->sum = nlink_store_sum(hdr->recs, nr);
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		err = -errno;
+		goto free;
+	}
+
+	err = nlink_store_write(fd, hdr, size);
+	if (!err && fsync(fd))
+		err = -errno;
+
+	close(fd);
+
+	if (err)
+		goto unlink;
+
+	if (rename(tmp, path)) {
+		err = -errno;
+		goto unlink;
+	}
+
+	err = nlink_store_sync_dir(path);
+
+	free(hdr);
+
+	return err;
+
+unlink:
+	unlink(tmp);
+free:
+	free(hdr);
+
+	return err;
+}
+
+static int
+nlink_store_validate(const struct nlink_store_hdr *hdr, size_t size, int flags)
+{
+	struct nlink_store_hdr ident;
+	int                    err;
+
+	if (memcmp(hdr->magic, NLINK_STORE_MAGIC, sizeof(hdr->magic)) ||
+	    (hdr->version != NLINK_STORE_VERSION) ||
+	    (hdr->rec_size != sizeof(hdr->recs[0])) ||
+	    (size != (sizeof(*hdr) + ((size_t)hdr->nr * sizeof(hdr->recs[0])))))
+		return -EBADMSG;
+
+	err = nlink_store_ident(&ident);
+	if (err)
+		return err;
+
+	if ((ident.netns_dev != hdr->netns_dev) ||
+	    (ident.netns_ino != hdr->netns_ino) ||
+	    memcmp(ident.boot_id, hdr->boot_id, sizeof(ident.boot_id)))
+		/* Saved from another namespace or before last reboot. */
+		return -ESTALE;
+
+	if ((flags & NLINK_STORE_FSCK) &&
+	    (nlink_store_sum(hdr->recs, hdr->nr) != hdr->sum))
+		return -EBADMSG;
+
+	return 0;
+}
+
+/*
+ * Map snapshot into memory.
+ *
+ * Records are used in place without any parsing. Since nlink_store_save()
+ * atomically renames fully synced snapshots only, header and size checks are
+ * enough to catch incompatible or truncated files ; pass NLINK_STORE_FSCK to
+ * additionally verify records checksum at the cost of reading whole file.
+ *
+ * Returns -EBADMSG for corrupted or incompatible snapshots and -ESTALE for
+ * snapshots saved from another network namespace or boot. In both cases,
+ * caller should perform a full cold start instead.
+ */
+int
+nlink_store_load(struct nlink_store *store, const char *path, int flags)
+{
+	nlink_assert(store);
+	nlink_assert(path);
+	nlink_assert(*path);
+	nlink_assert(!(flags & ~NLINK_STORE_FSCK));
+
+	int          fd;
+	struct stat  st;
+	void        *map;
+	int          err;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st)) {
+		err = -errno;
+		goto close;
+	}
+
+	if ((size_t)st.st_size < sizeof(struct nlink_store_hdr)) {
+		err = -EBADMSG;
+		goto close;
+	}
+
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		err = -errno;
+		goto close;
+	}
+
+	close(fd);
+
+	err = nlink_store_validate(map, (size_t)st.st_size, flags);
+	if (err) {
+		munmap(map, (size_t)st.st_size);
+		return err;
+	}
+
+	store->hdr = map;
+	store->size = (size_t)st.st_size;
+
+	return 0;
+
+close:
+	close(fd);
+
+	return err;
+}
+
+void
+nlink_store_unload(struct nlink_store *store)
+{
+	nlink_store_assert(store);
+
+	munmap((void *)store->hdr, store->size);
+}
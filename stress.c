@@ -0,0 +1,978 @@
+/*
+ * Real-kernel stress benchmark.
+ *
+ * Runs into a private user and network namespace so that it requires neither
+ * privileges nor cleanup of the host. Note that dummy and veth kernel modules
+ * must already be loaded since unprivileged namespaces cannot trigger module
+ * auto loading.
+ *
+ * For each phase, reports request throughput, ACK latency percentiles,
+ * RTNLGRP_LINK multicast event delivery rate and lag (time elapsed between
+ * request transmission and reception of the matching event), and ENOBUFS
+ * incidence on the event monitoring socket. A link dump is then timed using
+ * both fixed and adaptive receive buffers. The admin state flapping phase is
+ * finally repeated for a range of monitoring socket receive buffer sizes.
+ */
+
+#include <nlink/iface.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <linux/if.h>
+#include <linux/if_arp.h>
+#include <linux/if_link.h>
+#include <linux/veth.h>
+
+#define NLINK_STRESS_INDEX_BASE (1000U)
+#define NLINK_STRESS_MTU_LOW    (1400U)
+#define NLINK_STRESS_MTU_HIGH   (1500U)
+
+struct nlink_stress_slot {
+	uint32_t seqno;
+	uint64_t tstamp;
+};
+
+struct nlink_stress_stats {
+	unsigned int  nr;
+	unsigned int  cnt;
+	uint64_t     *samples;
+};
+
+struct nlink_stress {
+	/* Configuration. */
+	unsigned int              dummy_nr;
+	unsigned int              veth_nr;
+	unsigned int              depth;
+	unsigned int              rounds;
+	/* Request side. */
+	struct nlink_sock         sock;
+	struct nlmsghdr          *msg;
+	struct nlink_stress_slot *slots;
+	unsigned int              errors;
+	struct nlink_stress_stats acks;
+	/* Interface index indexed last request transmission timestamps. */
+	uint64_t                 *sent;
+	/* Event monitoring side. */
+	struct nlink_sock         mon;
+	pthread_t                 thread;
+	bool                      stop;
+	unsigned int              events;
+	unsigned int              dgrams;
+	unsigned int              enobufs;
+	size_t                    rbuf_size;
+	struct nlink_stress_stats lags;
+};
+
+typedef int (nlink_stress_build_fn)(struct nlink_stress *stress,
+                                    unsigned int         op);
+
+static uint64_t
+nlink_stress_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+/******************************************************************************
+ * Latency statistics
+ ******************************************************************************/
+
+static void
+nlink_stress_push_sample(struct nlink_stress_stats *stats, uint64_t sample)
+{
+	/* Silently drop samples exceeding capacity. */
+	if (stats->cnt < stats->nr)
+		stats->samples[stats->cnt++] = sample;
+}
+
+static int
+nlink_stress_cmp_sample(const void *first, const void *second)
+{
+	uint64_t fst = *(const uint64_t *)first;
+	uint64_t snd = *(const uint64_t *)second;
+
+	return (fst > snd) - (fst < snd);
+}
+
+static double
+nlink_stress_pct(const struct nlink_stress_stats *stats, unsigned int permil)
+{
+	unsigned int s;
+
+	if (!stats->cnt)
+		return 0;
+
+	s = (unsigned int)(((uint64_t)(stats->cnt - 1) * permil) / 1000);
+
+	return (double)stats->samples[s] / 1000.0;
+}
+
+static void
+nlink_stress_print_stats(const char *name, struct nlink_stress_stats *stats)
+{
+	qsort(stats->samples,
+	      stats->cnt,
+	      sizeof(stats->samples[0]),
+	      nlink_stress_cmp_sample);
+
+	printf("  %-5s latency (us): p50 %9.1f | p90 %9.1f | p99 %9.1f | "
+	       "p99.9 %9.1f | max %9.1f\n",
+	       name,
+	       nlink_stress_pct(stats, 500),
+	       nlink_stress_pct(stats, 900),
+	       nlink_stress_pct(stats, 990),
+	       nlink_stress_pct(stats, 999),
+	       nlink_stress_pct(stats, 1000));
+}
+
+static int
+nlink_stress_init_stats(struct nlink_stress_stats *stats, unsigned int nr)
+{
+	stats->samples = malloc(nr * sizeof(stats->samples[0]));
+	if (!stats->samples)
+		return -errno;
+
+	stats->nr = nr;
+	stats->cnt = 0;
+
+	return 0;
+}
+
+/******************************************************************************
+ * Interface numbering
+ ******************************************************************************/
+
+static unsigned int
+nlink_stress_iface_nr(const struct nlink_stress *stress)
+{
+	return stress->dummy_nr + (2 * stress->veth_nr);
+}
+
+/*
+ * Dummy interfaces come first, then veth pairs, each pair using 2 consecutive
+ * indices.
+ */
+static int
+nlink_stress_iface_index(unsigned int iface)
+{
+	return (int)(NLINK_STRESS_INDEX_BASE + iface);
+}
+
+static unsigned int
+nlink_stress_iface_create_nr(const struct nlink_stress *stress)
+{
+	return stress->dummy_nr + stress->veth_nr;
+}
+
+static void
+nlink_stress_stamp(struct nlink_stress *stress, int index, uint64_t now)
+{
+	__atomic_store_n(&stress->sent[index - NLINK_STRESS_INDEX_BASE],
+	                 now,
+	                 __ATOMIC_RELAXED);
+}
+
+/******************************************************************************
+ * Request builders
+ ******************************************************************************/
+
+static void
+nlink_stress_setup_link(struct nlink_stress *stress,
+                        uint16_t             type,
+                        uint16_t             flags,
+                        int                  index)
+{
+	struct nlmsghdr  *msg = stress->msg;
+	struct ifinfomsg *info;
+
+	mnl_nlmsg_put_header(msg);
+	msg->nlmsg_type = type;
+	msg->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+	msg->nlmsg_seq = nlink_alloc_seqno(&stress->sock);
+	msg->nlmsg_pid = stress->sock.port_id;
+
+	info = mnl_nlmsg_put_extra_header(msg, sizeof(*info));
+	info->ifi_family = AF_UNSPEC;
+	info->ifi_index = index;
+}
+
+static int
+nlink_stress_build_create(struct nlink_stress *stress, unsigned int op)
+{
+	struct nlmsghdr *msg = stress->msg;
+	char             name[IFNAMSIZ];
+	int              index;
+	struct nlattr   *linfo;
+
+	if (op < stress->dummy_nr) {
+		index = nlink_stress_iface_index(op);
+		nlink_stress_setup_link(stress,
+		                        RTM_NEWLINK,
+		                        NLM_F_CREATE | NLM_F_EXCL,
+		                        index);
+
+		sprintf(name, "nls%u", op);
+		mnl_attr_put_strz(msg, IFLA_IFNAME, name);
+
+		linfo = mnl_attr_nest_start(msg, IFLA_LINKINFO);
+		mnl_attr_put_strz(msg, IFLA_INFO_KIND, "dummy");
+		mnl_attr_nest_end(msg, linfo);
+	}
+	else {
+		unsigned int      pair = op - stress->dummy_nr;
+		struct nlattr    *data;
+		struct nlattr    *peer;
+		struct ifinfomsg *info;
+
+		index = nlink_stress_iface_index(stress->dummy_nr + (2 * pair));
+		nlink_stress_setup_link(stress,
+		                        RTM_NEWLINK,
+		                        NLM_F_CREATE | NLM_F_EXCL,
+		                        index);
+
+		sprintf(name, "nlv%ua", pair);
+		mnl_attr_put_strz(msg, IFLA_IFNAME, name);
+
+		linfo = mnl_attr_nest_start(msg, IFLA_LINKINFO);
+		mnl_attr_put_strz(msg, IFLA_INFO_KIND, "veth");
+		data = mnl_attr_nest_start(msg, IFLA_INFO_DATA);
+		peer = mnl_attr_nest_start(msg, VETH_INFO_PEER);
+
+		info = mnl_nlmsg_put_extra_header(msg, sizeof(*info));
+		info->ifi_family = AF_UNSPEC;
+		info->ifi_index = index + 1;
+
+		sprintf(name, "nlv%ub", pair);
+		mnl_attr_put_strz(msg, IFLA_IFNAME, name);
+
+		mnl_attr_nest_end(msg, peer);
+		mnl_attr_nest_end(msg, data);
+		mnl_attr_nest_end(msg, linfo);
+	}
+
+	return index;
+}
+
+static int
+nlink_stress_build_delete(struct nlink_stress *stress, unsigned int op)
+{
+	int index;
+
+	/* Deleting one veth end deletes its peer too. */
+	if (op < stress->dummy_nr)
+		index = nlink_stress_iface_index(op);
+	else
+		index = nlink_stress_iface_index(stress->dummy_nr +
+		                                 (2 * (op - stress->dummy_nr)));
+
+	nlink_stress_setup_link(stress, RTM_DELLINK, 0, index);
+
+	return index;
+}
+
+static int
+nlink_stress_build_admin(struct nlink_stress *stress, unsigned int op)
+{
+	unsigned int nr = nlink_stress_iface_nr(stress);
+	int          index = nlink_stress_iface_index(op % nr);
+	int          err;
+
+	nlink_iface_setup_new(stress->msg, &stress->sock, ARPHRD_ETHER, index);
+	err = nlink_iface_setup_msg_admin_state(stress->msg,
+	                                        ((op / nr) & 1) ?
+	                                        IF_OPER_DOWN : IF_OPER_UP);
+
+	return err ? err : index;
+}
+
+static int
+nlink_stress_build_mtu(struct nlink_stress *stress, unsigned int op)
+{
+	unsigned int nr = nlink_stress_iface_nr(stress);
+	int          index = nlink_stress_iface_index(op % nr);
+	int          err;
+
+	nlink_iface_setup_new(stress->msg, &stress->sock, ARPHRD_ETHER, index);
+	err = nlink_iface_setup_msg_mtu(stress->msg,
+	                                ((op / nr) & 1) ?
+	                                NLINK_STRESS_MTU_HIGH :
+	                                NLINK_STRESS_MTU_LOW);
+
+	return err ? err : index;
+}
+
+/******************************************************************************
+ * Event monitoring
+ ******************************************************************************/
+
+static void
+nlink_stress_handle_event(struct nlink_stress   *stress,
+                          const struct nlmsghdr *msg,
+                          uint64_t               now)
+{
+	const struct ifinfomsg *info;
+	unsigned int            iface;
+	uint64_t                sent;
+
+	if ((msg->nlmsg_type != RTM_NEWLINK) &&
+	    (msg->nlmsg_type != RTM_DELLINK))
+		return;
+
+	if (mnl_nlmsg_get_payload_len(msg) < sizeof(*info))
+		return;
+
+	stress->events++;
+
+	info = mnl_nlmsg_get_payload(msg);
+	iface = (unsigned int)info->ifi_index - NLINK_STRESS_INDEX_BASE;
+	if (iface >= nlink_stress_iface_nr(stress))
+		return;
+
+	sent = __atomic_load_n(&stress->sent[iface], __ATOMIC_RELAXED);
+	if (sent && (now >= sent))
+		nlink_stress_push_sample(&stress->lags, now - sent);
+}
+
+static void *
+nlink_stress_monitor(void *arg)
+{
+	struct nlink_stress *stress = arg;
+	struct nlink_rbuf    rbuf;
+	struct pollfd        pfd = {
+		.fd     = nlink_sock_fd(&stress->mon),
+		.events = POLLIN
+	};
+
+	if (nlink_init_rbuf(&rbuf))
+		return NULL;
+
+	while (!__atomic_load_n(&stress->stop, __ATOMIC_ACQUIRE)) {
+		ssize_t  ret;
+		int      bytes;
+		uint64_t now;
+
+		if (poll(&pfd, 1, 50) <= 0)
+			continue;
+
+		ret = nlink_recv_rbuf(&stress->mon, &rbuf);
+		now = nlink_stress_now();
+		if (ret < 0) {
+			if (ret == -ENOBUFS)
+				stress->enobufs++;
+			continue;
+		}
+
+		stress->dgrams++;
+		bytes = (int)ret;
+		for (const struct nlmsghdr *m = rbuf.msg;
+		     mnl_nlmsg_ok(m, bytes);
+		     m = mnl_nlmsg_next(m, &bytes))
+			nlink_stress_handle_event(stress, m, now);
+	}
+
+	stress->rbuf_size = rbuf.size;
+	nlink_fini_rbuf(&rbuf);
+
+	return NULL;
+}
+
+static int
+nlink_stress_start_monitor(struct nlink_stress *stress, int rcvbuf)
+{
+	int err;
+
+	err = nlink_open_route_sock(&stress->mon, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (err)
+		return err;
+
+	if (rcvbuf) {
+		err = nlink_set_sock_rcvbuf(&stress->mon, rcvbuf);
+		if (err)
+			goto close;
+	}
+
+	err = nlink_join_route_group(&stress->mon, RTNLGRP_LINK);
+	if (err)
+		goto close;
+
+	stress->stop = false;
+	stress->events = 0;
+	stress->dgrams = 0;
+	stress->enobufs = 0;
+	stress->lags.cnt = 0;
+	memset(stress->sent,
+	       0,
+	       nlink_stress_iface_nr(stress) * sizeof(stress->sent[0]));
+
+	err = pthread_create(&stress->thread,
+	                     NULL,
+	                     nlink_stress_monitor,
+	                     stress);
+	if (err) {
+		err = -err;
+		goto close;
+	}
+
+	return 0;
+
+close:
+	nlink_close_sock(&stress->mon);
+
+	return err;
+}
+
+static void
+nlink_stress_stop_monitor(struct nlink_stress *stress)
+{
+	/* Give in-flight events a chance to be delivered. */
+	usleep(100000);
+
+	__atomic_store_n(&stress->stop, true, __ATOMIC_RELEASE);
+	pthread_join(stress->thread, NULL);
+
+	nlink_close_sock(&stress->mon);
+}
+
+/******************************************************************************
+ * Request pipelining
+ ******************************************************************************/
+
+static int
+nlink_stress_parse_ack(int status, const struct nlmsghdr *msg, void *data)
+{
+	struct nlink_stress      *stress = data;
+	struct nlink_stress_slot *slot;
+
+	if (!status)
+		/* Unexpected data message: skip it. */
+		return 0;
+
+	if (msg->nlmsg_type != NLMSG_ERROR)
+		return status;
+
+	slot = &stress->slots[msg->nlmsg_seq % stress->depth];
+	if (!slot->tstamp || (slot->seqno != msg->nlmsg_seq))
+		return -EPROTO;
+
+	nlink_stress_push_sample(&stress->acks,
+	                         nlink_stress_now() - slot->tstamp);
+	slot->tstamp = 0;
+
+	if (status != -ENODATA)
+		stress->errors++;
+
+	return -ENODATA;
+}
+
+static int
+nlink_stress_recv_ack(struct nlink_stress *stress, struct nlmsghdr *msg)
+{
+	ssize_t ret;
+
+	do {
+		ret = nlink_recv_msg(&stress->sock, msg);
+	} while (ret == -EINTR);
+
+	if (ret < 0)
+		return (int)ret;
+
+	ret = nlink_parse_msg(msg, (size_t)ret, nlink_stress_parse_ack, stress);
+
+	return (ret == -ENODATA) ? 0 : (int)ret;
+}
+
+static int
+nlink_stress_run(struct nlink_stress  *stress,
+                 const char           *name,
+                 nlink_stress_build_fn *build,
+                 unsigned int          nr)
+{
+	struct nlmsghdr *ack;
+	unsigned int     sent = 0;
+	unsigned int     inflight = 0;
+	uint64_t         start;
+	uint64_t         elapsed;
+	int              err = 0;
+
+	ack = nlink_alloc_msg();
+	if (!ack)
+		return -errno;
+
+	stress->errors = 0;
+	stress->acks.cnt = 0;
+	memset(stress->slots, 0, stress->depth * sizeof(stress->slots[0]));
+
+	start = nlink_stress_now();
+
+	while ((sent < nr) || inflight) {
+		while ((sent < nr) && (inflight < stress->depth)) {
+			struct nlink_stress_slot *slot;
+			int                       index;
+			uint64_t                  now;
+
+			index = build(stress, sent);
+			if (index < 0) {
+				err = index;
+				goto free;
+			}
+
+			/*
+			 * Sequence numbers consumed by requests the kernel
+			 * pushed back may make a still in-flight request
+			 * collide with this one: collect ACKs first.
+			 */
+			slot = &stress->slots[stress->msg->nlmsg_seq %
+			                      stress->depth];
+			if (slot->tstamp)
+				break;
+
+			/*
+			 * Kernel processes requests synchronously: stamp
+			 * before sending so that the monitor may not see
+			 * resulting events before the stamp.
+			 */
+			now = nlink_stress_now();
+			nlink_stress_stamp(stress, index, now);
+			err = (int)nlink_send_msg(&stress->sock, stress->msg);
+			if (err) {
+				if ((err == -EAGAIN) || (err == -ENOBUFS)) {
+					/* Kernel push back: collect ACKs. */
+					err = 0;
+					break;
+				}
+				goto free;
+			}
+
+			slot->seqno = stress->msg->nlmsg_seq;
+			slot->tstamp = now;
+
+			sent++;
+			inflight++;
+		}
+
+		if (!inflight)
+			continue;
+
+		err = nlink_stress_recv_ack(stress, ack);
+		if (err)
+			goto free;
+
+		inflight--;
+	}
+
+	elapsed = nlink_stress_now() - start;
+
+	printf("%-8s %8u requests in %9.3f ms: %10.0f req/s, %u error(s)\n",
+	       name,
+	       nr,
+	       (double)elapsed / 1000000.0,
+	       (double)nr * 1000000000.0 / (double)elapsed,
+	       stress->errors);
+	nlink_stress_print_stats("ack", &stress->acks);
+
+free:
+	nlink_free_msg(ack);
+
+	return err;
+}
+
+static int
+nlink_stress_run_phase(struct nlink_stress   *stress,
+                       const char            *name,
+                       nlink_stress_build_fn *build,
+                       unsigned int           nr,
+                       int                    rcvbuf)
+{
+	uint64_t start;
+	uint64_t elapsed;
+	int      err;
+
+	err = nlink_stress_start_monitor(stress, rcvbuf);
+	if (err)
+		return err;
+
+	start = nlink_stress_now();
+	err = nlink_stress_run(stress, name, build, nr);
+	nlink_stress_stop_monitor(stress);
+	elapsed = nlink_stress_now() - start;
+
+	if (err)
+		return err;
+
+	printf("  event %8u received: %10.0f evt/s, %u datagrams, %u ENOBUFS, "
+	       "%zu bytes buffer\n",
+	       stress->events,
+	       (double)stress->events * 1000000000.0 / (double)elapsed,
+	       stress->dgrams,
+	       stress->enobufs,
+	       stress->rbuf_size);
+	nlink_stress_print_stats("lag", &stress->lags);
+
+	return 0;
+}
+
+/******************************************************************************
+ * Link dumping
+ ******************************************************************************/
+
+static int
+nlink_stress_dump(struct nlink_stress *stress, const char *name, bool adapt)
+{
+	struct nlink_rbuf rbuf;
+	unsigned int      ifaces = 0;
+	unsigned int      dgrams = 0;
+	uint64_t          bytes = 0;
+	uint64_t          start;
+	uint64_t          elapsed;
+	int               err;
+
+	if (adapt) {
+		err = nlink_init_rbuf(&rbuf);
+		if (err)
+			return err;
+	}
+	else {
+		rbuf.msg = stress->msg;
+		rbuf.size = NLINK_XFER_MSG_SIZE;
+	}
+
+	start = nlink_stress_now();
+
+	nlink_iface_setup_dump(stress->msg, &stress->sock);
+	err = (int)nlink_send_msg(&stress->sock, stress->msg);
+
+	while (!err) {
+		ssize_t                ret;
+		int                    left;
+		const struct nlmsghdr *msg;
+
+		if (adapt)
+			ret = nlink_recv_rbuf(&stress->sock, &rbuf);
+		else
+			ret = nlink_recv_msg(&stress->sock, rbuf.msg);
+		if (ret < 0) {
+			err = (int)ret;
+			break;
+		}
+
+		dgrams++;
+		bytes += (uint64_t)ret;
+
+		left = (int)ret;
+		for (msg = rbuf.msg;
+		     mnl_nlmsg_ok(msg, left);
+		     msg = mnl_nlmsg_next(msg, &left)) {
+			if (msg->nlmsg_type == RTM_NEWLINK) {
+				ifaces++;
+				continue;
+			}
+
+			err = nlink_parse_msg_head(msg);
+			if (!err)
+				continue;
+
+			if (err == -ENODATA)
+				goto done;
+
+			break;
+		}
+	}
+
+	goto free;
+
+done:
+	err = 0;
+	elapsed = nlink_stress_now() - start;
+
+	printf("%-8s %8u links in %9.3f ms: %u datagrams, %" PRIu64
+	       " bytes, %zu bytes buffer\n",
+	       name,
+	       ifaces,
+	       (double)elapsed / 1000000.0,
+	       dgrams,
+	       bytes,
+	       rbuf.size);
+
+free:
+	if (adapt)
+		nlink_fini_rbuf(&rbuf);
+
+	return err;
+}
+
+/******************************************************************************
+ * Namespace setup
+ ******************************************************************************/
+
+static int
+nlink_stress_write_file(const char *path, const char *content)
+{
+	int     fd;
+	ssize_t ret;
+	size_t  len = strlen(content);
+
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	ret = write(fd, content, len);
+	ret = (ret < 0) ? -errno : (((size_t)ret == len) ? 0 : -EIO);
+
+	close(fd);
+
+	return (int)ret;
+}
+
+static int
+nlink_stress_enter_netns(void)
+{
+	uid_t uid = getuid();
+	gid_t gid = getgid();
+	char  map[32];
+	int   err;
+
+	if (unshare(CLONE_NEWUSER | CLONE_NEWNET))
+		return -errno;
+
+	/* Map current user to root within the new user namespace. */
+	err = nlink_stress_write_file("/proc/self/setgroups", "deny");
+	if (err && (err != -ENOENT))
+		return err;
+
+	sprintf(map, "0 %u 1", uid);
+	err = nlink_stress_write_file("/proc/self/uid_map", map);
+	if (err)
+		return err;
+
+	sprintf(map, "0 %u 1", gid);
+
+	return nlink_stress_write_file("/proc/self/gid_map", map);
+}
+
+/******************************************************************************
+ * Main
+ ******************************************************************************/
+
+static const int nlink_stress_rcvbufs[] = {
+	4096, 16384, 65536, 262144, 1048576
+};
+
+static void
+nlink_stress_usage(const char *me)
+{
+	fprintf(stderr,
+	        "Usage: %s [OPTIONS]\n"
+	        "Options:\n"
+	        "    -d, --dummy <NR>   number of dummy interfaces [1000]\n"
+	        "    -v, --veth <NR>    number of veth pairs [1000]\n"
+	        "    -w, --window <NR>  number of in-flight requests [64]\n"
+	        "    -r, --rounds <NR>  number of flapping rounds [4]\n"
+	        "    -h, --help         this help message\n",
+	        me);
+}
+
+static int
+nlink_stress_parse_uint(const char *arg, unsigned int *value)
+{
+	char          *end;
+	unsigned long  val;
+
+	errno = 0;
+	val = strtoul(arg, &end, 0);
+	if (errno || *end || (val > 1000000UL))
+		return -EINVAL;
+
+	*value = (unsigned int)val;
+
+	return 0;
+}
+
+static int
+nlink_stress_parse_args(struct nlink_stress *stress,
+                        int                  argc,
+                        char * const         argv[])
+{
+	static const struct option opts[] = {
+		{ "dummy",  required_argument, NULL, 'd' },
+		{ "veth",   required_argument, NULL, 'v' },
+		{ "window", required_argument, NULL, 'w' },
+		{ "rounds", required_argument, NULL, 'r' },
+		{ "help",   no_argument,       NULL, 'h' },
+		{ NULL,     0,                 NULL, 0 }
+	};
+
+	stress->dummy_nr = 1000;
+	stress->veth_nr = 1000;
+	stress->depth = 64;
+	stress->rounds = 4;
+
+	while (true) {
+		int opt;
+		int err = 0;
+
+		opt = getopt_long(argc, argv, "d:v:w:r:h", opts, NULL);
+		if (opt < 0)
+			break;
+
+		switch (opt) {
+		case 'd':
+			err = nlink_stress_parse_uint(optarg,
+			                              &stress->dummy_nr);
+			break;
+
+		case 'v':
+			err = nlink_stress_parse_uint(optarg, &stress->veth_nr);
+			break;
+
+		case 'w':
+			err = nlink_stress_parse_uint(optarg, &stress->depth);
+			break;
+
+		case 'r':
+			err = nlink_stress_parse_uint(optarg, &stress->rounds);
+			break;
+
+		case 'h':
+		default:
+			return -EINVAL;
+		}
+
+		if (err)
+			return err;
+	}
+
+	if ((optind != argc) ||
+	    !nlink_stress_iface_nr(stress) ||
+	    !stress->depth ||
+	    !stress->rounds)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int
+nlink_stress_init(struct nlink_stress *stress)
+{
+	unsigned int nr = nlink_stress_iface_nr(stress);
+	unsigned int ops = nr * stress->rounds;
+	int          err;
+
+	stress->msg = nlink_alloc_msg();
+	stress->slots = malloc(stress->depth * sizeof(stress->slots[0]));
+	stress->sent = malloc(nr * sizeof(stress->sent[0]));
+	if (!stress->msg || !stress->slots || !stress->sent)
+		return -ENOMEM;
+
+	/* Each request may trigger multiple events: leave some room. */
+	err = nlink_stress_init_stats(&stress->acks, ops);
+	if (err)
+		return err;
+
+	err = nlink_stress_init_stats(&stress->lags, 4 * ops);
+	if (err)
+		return err;
+
+	return nlink_open_route_sock(&stress->sock, SOCK_CLOEXEC);
+}
+
+int
+main(int argc, char * const argv[])
+{
+	struct nlink_stress stress = { 0 };
+	unsigned int        nr;
+	unsigned int        b;
+	int                 err;
+
+	if (nlink_stress_parse_args(&stress, argc, argv)) {
+		nlink_stress_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	err = nlink_stress_enter_netns();
+	if (err) {
+		fprintf(stderr,
+		        "%s: failed to enter private namespaces: %s\n",
+		        argv[0],
+		        strerror(-err));
+		return EXIT_FAILURE;
+	}
+
+	err = nlink_stress_init(&stress);
+	if (err)
+		goto out;
+
+	nr = nlink_stress_iface_nr(&stress);
+
+	err = nlink_stress_run_phase(&stress,
+	                             "create",
+	                             nlink_stress_build_create,
+	                             nlink_stress_iface_create_nr(&stress),
+	                             0);
+	if (err)
+		goto out;
+
+	err = nlink_stress_run_phase(&stress,
+	                             "admin",
+	                             nlink_stress_build_admin,
+	                             nr * stress.rounds,
+	                             0);
+	if (err)
+		goto out;
+
+	err = nlink_stress_run_phase(&stress,
+	                             "mtu",
+	                             nlink_stress_build_mtu,
+	                             nr * stress.rounds,
+	                             0);
+	if (err)
+		goto out;
+
+	err = nlink_stress_dump(&stress, "dump", false);
+	if (err)
+		goto out;
+
+	err = nlink_stress_dump(&stress, "adump", true);
+	if (err)
+		goto out;
+
+	for (b = 0;
+	     b < (sizeof(nlink_stress_rcvbufs) /
+	          sizeof(nlink_stress_rcvbufs[0]));
+	     b++) {
+		char name[16];
+
+		sprintf(name, "rcv%dk", nlink_stress_rcvbufs[b] / 1024);
+		err = nlink_stress_run_phase(&stress,
+		                             name,
+		                             nlink_stress_build_admin,
+		                             nr * stress.rounds,
+		                             nlink_stress_rcvbufs[b]);
+		if (err)
+			goto out;
+	}
+
+	err = nlink_stress_run_phase(&stress,
+	                             "delete",
+	                             nlink_stress_build_delete,
+	                             nlink_stress_iface_create_nr(&stress),
+	                             0);
+
+out:
+	if (err) {
+		fprintf(stderr, "%s: %s\n", argv[0], strerror(-err));
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,581 @@
+#include <nlink/tc.h>
+#include "parse.h"
+#include <string.h>
+#include <errno.h>
+#include <net/if.h>
+#include <linux/gen_stats.h>
+#include <sys/socket.h>
+
+#define NLINK_TCTAB_COLUMN_ALIGN (64U)
+
+/******************************************************************************
+ * Traffic control message handling
+ ******************************************************************************/
+
+static int
+nlink_tc_parse_stats2(const struct nlattr *attr, struct nlink_tc_stats *stats)
+{
+	const struct nlattr *sub;
+	bool                 pkt64 = false;
+
+	mnl_attr_for_each_nested(sub, attr) {
+		size_t len = mnl_attr_get_payload_len(sub);
+
+		switch (mnl_attr_get_type(sub)) {
+		case TCA_STATS_BASIC:
+			{
+				struct gnet_stats_basic basic;
+
+				/* Payload carries structure trailing padding. */
+				if (len < (sizeof(basic.bytes) +
+				           sizeof(basic.packets)))
+					return -EBADMSG;
+
+				memcpy(&basic,
+				       mnl_attr_get_payload(sub),
+				       sizeof(basic.bytes) +
+				       sizeof(basic.packets));
+				stats->bytes = basic.bytes;
+				if (!pkt64)
+					stats->packets = basic.packets;
+			}
+			break;
+
+		case TCA_STATS_PKT64:
+			/* 64 bits packet counter, prefer it when available. */
+			if (len != sizeof(uint64_t))
+				return -EBADMSG;
+
+			memcpy(&stats->packets,
+			       mnl_attr_get_payload(sub),
+			       sizeof(uint64_t));
+			pkt64 = true;
+			break;
+
+		case TCA_STATS_QUEUE:
+			{
+				struct gnet_stats_queue queue;
+
+				if (len < sizeof(queue))
+					return -EBADMSG;
+
+				memcpy(&queue,
+				       mnl_attr_get_payload(sub),
+				       sizeof(queue));
+				stats->qlen = queue.qlen;
+				stats->backlog = queue.backlog;
+				stats->drops = queue.drops;
+				stats->requeues = queue.requeues;
+				stats->overlimits = queue.overlimits;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
+
+int
+nlink_tc_parse_msg(const struct nlmsghdr *msg, struct nlink_tc_stats *stats)
+{
+	nlink_assert(msg);
+	nlink_assert((msg->nlmsg_type == RTM_NEWQDISC) ||
+	             (msg->nlmsg_type == RTM_NEWTCLASS));
+	nlink_assert(stats);
+
+	const struct tcmsg  *tcm;
+	const struct nlattr *attr;
+
+	if (mnl_nlmsg_get_payload_len(msg) < sizeof(*tcm))
+		return -EBADMSG;
+
+	tcm = mnl_nlmsg_get_payload(msg);
+	if (tcm->tcm_ifindex <= 0)
+		return -ENODEV;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->index = tcm->tcm_ifindex;
+	stats->handle = tcm->tcm_handle;
+	stats->parent = tcm->tcm_parent;
+
+	mnl_attr_for_each(attr, msg, sizeof(*tcm)) {
+		ssize_t len;
+		int     err;
+
+		switch (mnl_attr_get_type(attr)) {
+		case TCA_KIND:
+			len = nlink_parse_string_attr(attr,
+			                              &stats->kind,
+			                              IFNAMSIZ);
+			if (len < 0)
+				return (int)len;
+			break;
+
+		case TCA_STATS2:
+			if (mnl_attr_validate(attr, MNL_TYPE_NESTED))
+				return -errno;
+
+			err = nlink_tc_parse_stats2(attr, stats);
+			if (err)
+				return err;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (!stats->kind)
+		return -EBADMSG;
+
+	return 0;
+}
+
+/*
+ * Setup a qdisc (type == RTM_GETQDISC) or class (type == RTM_GETTCLASS) dump
+ * request.
+ *
+ * Class dumps are restricted by kernel to the interface identified by index,
+ * which is mandatory. Qdisc dumps ignore index and report qdiscs of all
+ * interfaces: filtering is left to the caller (see nlink_tctab_collect()).
+ */
+void
+nlink_tc_setup_dump(struct nlmsghdr   *msg,
+                    struct nlink_sock *sock,
+                    uint16_t           type,
+                    int                index)
+{
+	nlink_assert(msg);
+	nlink_assert_sock(sock);
+	nlink_assert((type == RTM_GETQDISC) || (type == RTM_GETTCLASS));
+	nlink_assert(index >= 0);
+	nlink_assert((type == RTM_GETQDISC) || index);
+
+	struct tcmsg *tcm;
+
+	mnl_nlmsg_put_header(msg);
+	msg->nlmsg_type = type;
+	msg->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	msg->nlmsg_seq = nlink_alloc_seqno(sock);
+	msg->nlmsg_pid = sock->port_id;
+
+	tcm = mnl_nlmsg_put_extra_header(msg, sizeof(*tcm));
+	tcm->tcm_family = AF_UNSPEC;
+	tcm->tcm_ifindex = index;
+	tcm->tcm_handle = 0;
+	tcm->tcm_parent = 0;
+	tcm->tcm_info = 0;
+}
+
+/******************************************************************************
+ * Key to row map
+ ******************************************************************************/
+
+static uint32_t
+nlink_tctab_hash(int index, uint32_t handle, uint32_t parent)
+{
+	uint32_t hash;
+
+	/* Multiplicative mixing of the 3 key words. */
+	hash = ((uint32_t)index * 2654435769U) ^ handle;
+	hash = (hash * 2654435769U) ^ parent;
+	hash *= 2654435769U;
+
+	return hash ^ (hash >> 16);
+}
+
+static bool
+nlink_tctab_match(const struct nlink_tctab *tab,
+                  unsigned int              slot,
+                  uint32_t                  hash,
+                  int                       index,
+                  uint32_t                  handle,
+                  uint32_t                  parent)
+{
+	unsigned int r = tab->map[slot].row - 1;
+
+	return (tab->map[slot].hash == hash) &&
+	       (tab->index[r] == index) &&
+	       (tab->handle[r] == handle) &&
+	       (tab->parent[r] == parent);
+}
+
+static unsigned int
+nlink_tctab_probe(const struct nlink_tctab *tab,
+                  uint32_t                  hash,
+                  int                       index,
+                  uint32_t                  handle,
+                  uint32_t                  parent)
+{
+	nlink_tctab_assert(tab);
+
+	unsigned int s;
+
+	for (s = hash & tab->map_mask;
+	     tab->map[s].row &&
+	     !nlink_tctab_match(tab, s, hash, index, handle, parent);
+	     s = (s + 1) & tab->map_mask)
+		;
+
+	return s;
+}
+
+static unsigned int
+nlink_tctab_probe_row(const struct nlink_tctab *tab, unsigned int row)
+{
+	return nlink_tctab_probe(tab,
+	                         nlink_tctab_hash(tab->index[row],
+	                                          tab->handle[row],
+	                                          tab->parent[row]),
+	                         tab->index[row],
+	                         tab->handle[row],
+	                         tab->parent[row]);
+}
+
+static void
+nlink_tctab_unmap(struct nlink_tctab *tab, unsigned int slot)
+{
+	nlink_tctab_assert(tab);
+	nlink_assert(tab->map[slot].row);
+
+	unsigned int n;
+
+	/* Backward shift deletion, see nlink_iftab_unmap(). */
+	for (n = (slot + 1) & tab->map_mask;
+	     tab->map[n].row;
+	     n = (n + 1) & tab->map_mask) {
+		unsigned int home = tab->map[n].hash & tab->map_mask;
+
+		if (((n - home) & tab->map_mask) >=
+		    ((n - slot) & tab->map_mask)) {
+			tab->map[slot] = tab->map[n];
+			slot = n;
+		}
+	}
+
+	tab->map[slot].row = 0;
+}
+
+/******************************************************************************
+ * Table handling
+ ******************************************************************************/
+
+int
+nlink_tctab_find(const struct nlink_tctab *tab,
+                 int                       index,
+                 uint32_t                  handle,
+                 uint32_t                  parent)
+{
+	nlink_tctab_assert(tab);
+	nlink_assert(index > 0);
+
+	unsigned int s;
+
+	s = nlink_tctab_probe(tab,
+	                      nlink_tctab_hash(index, handle, parent),
+	                      index,
+	                      handle,
+	                      parent);
+	if (!tab->map[s].row)
+		return -ENOENT;
+
+	return (int)(tab->map[s].row - 1);
+}
+
+int
+nlink_tctab_update(struct nlink_tctab          *tab,
+                   const struct nlink_tc_stats *stats)
+{
+	nlink_tctab_assert(tab);
+	nlink_assert(stats);
+	nlink_assert(stats->index > 0);
+
+	uint32_t     hash = nlink_tctab_hash(stats->index,
+	                                     stats->handle,
+	                                     stats->parent);
+	unsigned int s = nlink_tctab_probe(tab,
+	                                   hash,
+	                                   stats->index,
+	                                   stats->handle,
+	                                   stats->parent);
+	unsigned int r;
+
+	if (!tab->map[s].row) {
+		if (tab->cnt == tab->nr)
+			return -ENOSPC;
+
+		r = tab->cnt++;
+		tab->map[s].hash = hash;
+		tab->map[s].row = r + 1;
+
+		tab->index[r] = stats->index;
+		tab->handle[r] = stats->handle;
+		tab->parent[r] = stats->parent;
+
+		/* No previous sample: report null deltas. */
+		tab->bytes[r] = stats->bytes;
+		tab->packets[r] = stats->packets;
+		tab->drops[r] = stats->drops;
+		tab->requeues[r] = stats->requeues;
+		tab->overlimits[r] = stats->overlimits;
+	}
+	else
+		r = tab->map[s].row - 1;
+
+	/*
+	 * Counters going backward mean the object has been replaced under the
+	 * same key: restart from zero. 32 bits counters deltas rely upon
+	 * unsigned arithmetic to cope with wrap-arounds.
+	 */
+	tab->bytes_delta[r] = (stats->bytes >= tab->bytes[r]) ?
+	                      stats->bytes - tab->bytes[r] : stats->bytes;
+	tab->packets_delta[r] = (stats->packets >= tab->packets[r]) ?
+	                        stats->packets - tab->packets[r] :
+	                        stats->packets;
+	tab->drops_delta[r] = stats->drops - tab->drops[r];
+	tab->requeues_delta[r] = stats->requeues - tab->requeues[r];
+	tab->overlimits_delta[r] = stats->overlimits - tab->overlimits[r];
+
+	tab->seen[r] = tab->gen;
+	tab->qlen[r] = stats->qlen;
+	tab->backlog[r] = stats->backlog;
+	tab->bytes[r] = stats->bytes;
+	tab->packets[r] = stats->packets;
+	tab->drops[r] = stats->drops;
+	tab->requeues[r] = stats->requeues;
+	tab->overlimits[r] = stats->overlimits;
+
+	return 0;
+}
+
+static void
+nlink_tctab_move(struct nlink_tctab *tab, unsigned int to, unsigned int from)
+{
+	tab->index[to] = tab->index[from];
+	tab->handle[to] = tab->handle[from];
+	tab->parent[to] = tab->parent[from];
+	tab->seen[to] = tab->seen[from];
+	tab->qlen[to] = tab->qlen[from];
+	tab->backlog[to] = tab->backlog[from];
+	tab->bytes[to] = tab->bytes[from];
+	tab->packets[to] = tab->packets[from];
+	tab->drops[to] = tab->drops[from];
+	tab->requeues[to] = tab->requeues[from];
+	tab->overlimits[to] = tab->overlimits[from];
+	tab->bytes_delta[to] = tab->bytes_delta[from];
+	tab->packets_delta[to] = tab->packets_delta[from];
+	tab->drops_delta[to] = tab->drops_delta[from];
+	tab->requeues_delta[to] = tab->requeues_delta[from];
+	tab->overlimits_delta[to] = tab->overlimits_delta[from];
+}
+
+/*
+ * Remove rows not updated since last nlink_tctab_begin() call, i.e. objects
+ * deleted since previous sample. Returns the number of rows removed.
+ */
+unsigned int
+nlink_tctab_sweep(struct nlink_tctab *tab)
+{
+	nlink_tctab_assert(tab);
+
+	unsigned int r = 0;
+	unsigned int cnt = 0;
+
+	while (r < tab->cnt) {
+		unsigned int last;
+
+		if (tab->seen[r] == tab->gen) {
+			r++;
+			continue;
+		}
+
+		nlink_tctab_unmap(tab, nlink_tctab_probe_row(tab, r));
+		cnt++;
+
+		/* Move last row into the hole and check it in turn. */
+		last = --tab->cnt;
+		if (r == last)
+			break;
+
+		nlink_tctab_move(tab, r, last);
+		tab->map[nlink_tctab_probe_row(tab, r)].row = r + 1;
+	}
+
+	return cnt;
+}
+
+struct nlink_tctab_collect_ctx {
+	struct nlink_tctab *tab;
+	int                 index;
+};
+
+static int
+nlink_tctab_collect_one(int status, const struct nlmsghdr *msg, void *data)
+{
+	const struct nlink_tctab_collect_ctx *ctx = data;
+	uint16_t                              type;
+	struct nlink_tc_stats                 stats;
+	int                                   err;
+
+	if (status)
+		return status;
+
+	type = (ctx->tab->type == RTM_GETQDISC) ? RTM_NEWQDISC : RTM_NEWTCLASS;
+	if (msg->nlmsg_type != type)
+		return -ENOMSG;
+
+	if (ctx->index &&
+	    (mnl_nlmsg_get_payload_len(msg) >= sizeof(struct tcmsg))) {
+		const struct tcmsg *tcm = mnl_nlmsg_get_payload(msg);
+
+		/* Skip records of other interfaces before parsing attributes. */
+		if (tcm->tcm_ifindex != ctx->index)
+			return 0;
+	}
+
+	err = nlink_tc_parse_msg(msg, &stats);
+	if (err)
+		return err;
+
+	return nlink_tctab_update(ctx->tab, &stats);
+}
+
+/*
+ * Dump statistics of objects attached to interface identified by index (or
+ * of all interfaces when index is zero, qdiscs only) and apply them to the
+ * current sample. msg should point to a NLINK_XFER_MSG_SIZE bytes long
+ * buffer.
+ */
+int
+nlink_tctab_collect(struct nlink_tctab *tab,
+                    struct nlink_sock  *sock,
+                    struct nlmsghdr    *msg,
+                    int                 index)
+{
+	nlink_tctab_assert(tab);
+	nlink_assert_sock(sock);
+	nlink_assert(msg);
+
+	struct nlink_tctab_collect_ctx ctx = {
+		.tab   = tab,
+		.index = index
+	};
+	int                            err;
+
+	nlink_tc_setup_dump(msg, sock, tab->type, index);
+
+	err = (int)nlink_send_msg(sock, msg);
+	if (err)
+		return err;
+
+	do {
+		ssize_t ret;
+
+		ret = nlink_recv_msg(sock, msg);
+		if (ret < 0)
+			return (int)ret;
+
+		err = nlink_parse_msg(msg,
+		                      (size_t)ret,
+		                      nlink_tctab_collect_one,
+		                      &ctx);
+	} while (err == -EINPROGRESS);
+
+	return (err == -ENODATA) ? 0 : err;
+}
+
+static size_t
+nlink_tctab_carve(size_t *off, size_t size)
+{
+	size_t col = *off;
+
+	*off = (col + size + NLINK_TCTAB_COLUMN_ALIGN - 1) &
+	       ~((size_t)NLINK_TCTAB_COLUMN_ALIGN - 1);
+
+	return col;
+}
+
+int
+nlink_tctab_init(struct nlink_tctab *tab, uint16_t type, unsigned int nr)
+{
+	nlink_assert(tab);
+	nlink_assert((type == RTM_GETQDISC) || (type == RTM_GETTCLASS));
+	nlink_assert(nr);
+
+	unsigned int map_nr = 1;
+	size_t       off = 0;
+	size_t       index, handle, parent, seen, qlen, backlog;
+	size_t       bytes, packets, drops, requeues, overlimits;
+	size_t       bytes_dlt, packets_dlt, drops_dlt, requeues_dlt;
+	size_t       overlimits_dlt, map;
+	char        *mem;
+
+	while (map_nr < (2 * nr))
+		map_nr <<= 1;
+
+	index = nlink_tctab_carve(&off, nr * sizeof(tab->index[0]));
+	handle = nlink_tctab_carve(&off, nr * sizeof(tab->handle[0]));
+	parent = nlink_tctab_carve(&off, nr * sizeof(tab->parent[0]));
+	seen = nlink_tctab_carve(&off, nr * sizeof(tab->seen[0]));
+	qlen = nlink_tctab_carve(&off, nr * sizeof(tab->qlen[0]));
+	backlog = nlink_tctab_carve(&off, nr * sizeof(tab->backlog[0]));
+	bytes = nlink_tctab_carve(&off, nr * sizeof(tab->bytes[0]));
+	packets = nlink_tctab_carve(&off, nr * sizeof(tab->packets[0]));
+	drops = nlink_tctab_carve(&off, nr * sizeof(tab->drops[0]));
+	requeues = nlink_tctab_carve(&off, nr * sizeof(tab->requeues[0]));
+	overlimits = nlink_tctab_carve(&off, nr * sizeof(tab->overlimits[0]));
+	bytes_dlt = nlink_tctab_carve(&off, nr * sizeof(tab->bytes_delta[0]));
+	packets_dlt = nlink_tctab_carve(&off,
+	                                nr * sizeof(tab->packets_delta[0]));
+	drops_dlt = nlink_tctab_carve(&off, nr * sizeof(tab->drops_delta[0]));
+	requeues_dlt = nlink_tctab_carve(&off,
+	                                 nr * sizeof(tab->requeues_delta[0]));
+	overlimits_dlt = nlink_tctab_carve(&off,
+	                                   nr *
+	                                   sizeof(tab->overlimits_delta[0]));
+	map = nlink_tctab_carve(&off, map_nr * sizeof(tab->map[0]));
+
+	mem = aligned_alloc(NLINK_TCTAB_COLUMN_ALIGN, off);
+	if (!mem)
+		return -errno;
+
+	tab->index = (int32_t *)&mem[index];
+	tab->handle = (uint32_t *)&mem[handle];
+	tab->parent = (uint32_t *)&mem[parent];
+	tab->seen = (uint32_t *)&mem[seen];
+	tab->qlen = (uint32_t *)&mem[qlen];
+	tab->backlog = (uint32_t *)&mem[backlog];
+	tab->bytes = (uint64_t *)&mem[bytes];
+	tab->packets = (uint64_t *)&mem[packets];
+	tab->drops = (uint32_t *)&mem[drops];
+	tab->requeues = (uint32_t *)&mem[requeues];
+	tab->overlimits = (uint32_t *)&mem[overlimits];
+	tab->bytes_delta = (uint64_t *)&mem[bytes_dlt];
+	tab->packets_delta = (uint64_t *)&mem[packets_dlt];
+	tab->drops_delta = (uint32_t *)&mem[drops_dlt];
+	tab->requeues_delta = (uint32_t *)&mem[requeues_dlt];
+	tab->overlimits_delta = (uint32_t *)&mem[overlimits_dlt];
+
+	tab->map_mask = map_nr - 1;
+	tab->map = (struct nlink_tctab_slot *)&mem[map];
+	memset(tab->map, 0, map_nr * sizeof(tab->map[0]));
+
+	tab->cnt = 0;
+	tab->nr = nr;
+	tab->type = type;
+	tab->gen = 0;
+	tab->mem = mem;
+
+	return 0;
+}
+
+void
+nlink_tctab_fini(const struct nlink_tctab *tab)
+{
+	nlink_tctab_assert(tab);
+
+	free(tab->mem);
+}
@@ -0,0 +1,375 @@
+#include <nlink/topo.h>
+#include <errno.h>
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+
+static struct dlist_node *
+nlink_topo_bucket(const struct nlink_topo *topo, int index)
+{
+	nlink_topo_assert(topo);
+	nlink_assert(index > 0);
+
+	return &topo->buckets[(unsigned int)index % topo->nr];
+}
+
+static struct nlink_topo_node *
+nlink_topo_lookup(const struct nlink_topo *topo, int index)
+{
+	nlink_topo_assert(topo);
+	nlink_assert(index > 0);
+
+	const struct dlist_node *bucket = nlink_topo_bucket(topo, index);
+	struct nlink_topo_node  *node;
+
+	dlist_foreach_entry(bucket, node, hash) {
+		if (node->index == index)
+			return node;
+	}
+
+	return NULL;
+}
+
+static struct nlink_topo_node *
+nlink_topo_get(struct nlink_topo *topo, int index)
+{
+	nlink_topo_assert(topo);
+	nlink_assert(index > 0);
+
+	struct nlink_topo_node *node;
+
+	node = nlink_topo_lookup(topo, index);
+	if (node)
+		return node;
+
+	node = malloc(sizeof(*node));
+	if (!node)
+		return NULL;
+
+	node->index = index;
+	node->present = false;
+	node->master = NULL;
+	dlist_init(&node->port);
+	dlist_init(&node->ports);
+	node->link = NULL;
+	dlist_init(&node->upper);
+	dlist_init(&node->uppers);
+
+	dlist_nqueue_back(nlink_topo_bucket(topo, index), &node->hash);
+	topo->cnt++;
+
+	return node;
+}
+
+/*
+ * Release node if it is a placeholder no more referenced by any other node.
+ */
+static void
+nlink_topo_put(struct nlink_topo *topo, struct nlink_topo_node *node)
+{
+	nlink_topo_assert(topo);
+	nlink_assert(topo->cnt);
+	nlink_assert(node);
+
+	if (node->present ||
+	    !dlist_empty(&node->ports) ||
+	    !dlist_empty(&node->uppers))
+		return;
+
+	nlink_assert(!node->master);
+	nlink_assert(!node->link);
+
+	dlist_remove(&node->hash);
+	topo->cnt--;
+
+	free(node);
+}
+
+static void
+nlink_topo_detach_master(struct nlink_topo *topo, struct nlink_topo_node *node)
+{
+	nlink_assert(node);
+
+	struct nlink_topo_node *master = node->master;
+
+	if (!master)
+		return;
+
+	dlist_remove(&node->port);
+	dlist_init(&node->port);
+	node->master = NULL;
+
+	nlink_topo_put(topo, master);
+}
+
+static void
+nlink_topo_detach_link(struct nlink_topo *topo, struct nlink_topo_node *node)
+{
+	nlink_assert(node);
+
+	struct nlink_topo_node *link = node->link;
+
+	if (!link)
+		return;
+
+	dlist_remove(&node->upper);
+	dlist_init(&node->upper);
+	node->link = NULL;
+
+	nlink_topo_put(topo, link);
+}
+
+struct nlink_topo_node *
+nlink_topo_find(const struct nlink_topo *topo, int index)
+{
+	nlink_topo_assert(topo);
+	nlink_assert(index > 0);
+
+	struct nlink_topo_node *node;
+
+	node = nlink_topo_lookup(topo, index);
+	if (!node || !node->present)
+		return NULL;
+
+	return node;
+}
+
+/*
+ * Return the bottom-most present node of the stack node belongs to, i.e. the
+ * physical device carrying node's traffic.
+ *
+ * Walk down links (vlan -> lower device) and, once reaching a node with no
+ * link, down ports (bond / bridge -> enslaved devices). Aggregates are
+ * resolved to their first present port in enslavement order ; callers
+ * interested in the whole set of physical devices should walk ports of the
+ * returned node's master using nlink_topo_foreach_port().
+ *
+ * veth peers of the same network namespace refer to each other: the walk
+ * stops at the first peer reached.
+ */
+const struct nlink_topo_node *
+nlink_topo_root(const struct nlink_topo      *topo,
+                const struct nlink_topo_node *node)
+{
+	nlink_topo_assert(topo);
+	nlink_assert(node);
+
+	unsigned int hops = topo->cnt;
+
+	/* Guard against any other link cycle. */
+	while (hops--) {
+		struct nlink_topo_node *next = NULL;
+
+		if (node->link && node->link->present) {
+			if (node->link->link == node)
+				break;
+
+			next = node->link;
+		}
+		else {
+			struct nlink_topo_node *port;
+
+			nlink_topo_foreach_port(node, port) {
+				if (port->present) {
+					next = port;
+					break;
+				}
+			}
+		}
+
+		if (!next)
+			break;
+
+		node = next;
+	}
+
+	return node;
+}
+
+int
+nlink_topo_update(struct nlink_topo *topo, const struct nlink_iface *iface)
+{
+	nlink_topo_assert(topo);
+	nlink_assert(iface);
+	nlink_assert(iface->index > 0);
+
+	struct nlink_topo_node *node;
+	struct nlink_topo_node *master = NULL;
+	struct nlink_topo_node *link = NULL;
+	struct nlink_topo_node *old_master;
+	struct nlink_topo_node *old_link;
+
+	node = nlink_topo_get(topo, iface->index);
+	if (!node)
+		return -errno;
+
+	/*
+	 * Allocate referenced nodes first so that topology is left untouched
+	 * in case of allocation failure.
+	 */
+	if (iface->master && ((int)iface->master != iface->index)) {
+		master = nlink_topo_get(topo, (int)iface->master);
+		if (!master)
+			goto put;
+	}
+
+	/*
+	 * Ignore links to interfaces living into another network namespace,
+	 * their index being meaningless here.
+	 */
+	if (iface->link &&
+	    !iface->link_netns &&
+	    ((int)iface->link != iface->index)) {
+		link = nlink_topo_get(topo, (int)iface->link);
+		if (!link)
+			goto put;
+	}
+
+	node->present = true;
+
+	/*
+	 * Attach new relations before releasing former ones: a placeholder
+	 * former master may well be the new link (and conversely), and
+	 * releasing it first would free it.
+	 */
+	old_master = node->master;
+	if (old_master != master) {
+		if (old_master)
+			dlist_remove(&node->port);
+		dlist_init(&node->port);
+		node->master = master;
+		if (master)
+			dlist_nqueue_back(&master->ports, &node->port);
+	}
+
+	old_link = node->link;
+	if (old_link != link) {
+		if (old_link)
+			dlist_remove(&node->upper);
+		dlist_init(&node->upper);
+		node->link = link;
+		if (link)
+			dlist_nqueue_back(&link->uppers, &node->upper);
+	}
+
+	if (old_master && (old_master != master))
+		nlink_topo_put(topo, old_master);
+
+	/* Former master and link may be the same node: release it once. */
+	if (old_link &&
+	    (old_link != link) &&
+	    ((old_link != old_master) || (old_master == master)))
+		nlink_topo_put(topo, old_link);
+
+	return 0;
+
+put:
+	if (master)
+		nlink_topo_put(topo, master);
+	nlink_topo_put(topo, node);
+
+	return -ENOMEM;
+}
+
+void
+nlink_topo_remove(struct nlink_topo *topo, int index)
+{
+	nlink_topo_assert(topo);
+	nlink_assert(index > 0);
+
+	struct nlink_topo_node *node;
+
+	node = nlink_topo_lookup(topo, index);
+	if (!node || !node->present)
+		return;
+
+	nlink_topo_detach_master(topo, node);
+	nlink_topo_detach_link(topo, node);
+
+	/*
+	 * Keep node around as a placeholder if ports / uppers still refer to
+	 * it: kernel will notify us about their new state soon.
+	 */
+	node->present = false;
+	nlink_topo_put(topo, node);
+}
+
+int
+nlink_topo_process_msg(struct nlink_topo *topo, const struct nlmsghdr *msg)
+{
+	nlink_topo_assert(topo);
+	nlink_assert(msg);
+
+	switch (msg->nlmsg_type) {
+	case RTM_NEWLINK:
+	{
+		struct nlink_iface iface;
+		int                err;
+
+		err = nlink_iface_parse_msg(msg, &iface);
+		if (err)
+			return err;
+
+		return nlink_topo_update(topo, &iface);
+	}
+
+	case RTM_DELLINK:
+	{
+		const struct ifinfomsg *info;
+
+		if (mnl_nlmsg_get_payload_len(msg) < sizeof(*info))
+			return -EBADMSG;
+
+		info = mnl_nlmsg_get_payload(msg);
+		if (info->ifi_family == AF_BRIDGE)
+			/* Bridge port leaving its bridge, not a device removal. */
+			return -ENOMSG;
+		if (info->ifi_index <= 0)
+			return -EBADMSG;
+
+		nlink_topo_remove(topo, info->ifi_index);
+
+		return 0;
+	}
+
+	default:
+		return -ENOMSG;
+	}
+}
+
+int
+nlink_topo_init(struct nlink_topo *topo, unsigned int nr)
+{
+	nlink_assert(topo);
+	nlink_assert(nr);
+
+	unsigned int b;
+
+	topo->buckets = malloc(nr * sizeof(topo->buckets[0]));
+	if (!topo->buckets)
+		return -errno;
+
+	for (b = 0; b < nr; b++)
+		dlist_init(&topo->buckets[b]);
+
+	topo->cnt = 0;
+	topo->nr = nr;
+
+	return 0;
+}
+
+void
+nlink_topo_fini(struct nlink_topo *topo)
+{
+	nlink_topo_assert(topo);
+
+	unsigned int b;
+
+	for (b = 0; b < topo->nr; b++) {
+		while (!dlist_empty(&topo->buckets[b]))
+			free(dlist_entry(dlist_dqueue_front(&topo->buckets[b]),
+			                 struct nlink_topo_node,
+			                 hash));
+	}
+
+	free(topo->buckets);
+}
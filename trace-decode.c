@@ -0,0 +1,122 @@
+#include <nlink/trace.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+static int
+nlink_trace_read(int fd, void *data, size_t size)
+{
+	char *buff = data;
+
+	while (size) {
+		ssize_t ret;
+
+		ret = read(fd, buff, size);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		if (!ret)
+			return -ENODATA;
+
+		buff += ret;
+		size -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+static int
+nlink_trace_decode(int fd)
+{
+	struct nlink_trace_file hdr;
+	struct nlink_trace_rec  rec;
+	char                    str[NLINK_SPRINT_MSG_SIZE];
+	unsigned int            r;
+	unsigned int            torn = 0;
+	int                     err;
+
+	err = nlink_trace_read(fd, &hdr, sizeof(hdr));
+	if (err)
+		return err;
+
+	if (memcmp(hdr.magic, NLINK_TRACE_MAGIC, sizeof(hdr.magic)) ||
+	    (hdr.version != NLINK_TRACE_VERSION) ||
+	    (hdr.rec_size != sizeof(rec)))
+		return -EPROTO;
+
+	if (hdr.lost)
+		fprintf(stderr,
+		        "%llu older record(s) overwritten\n",
+		        (unsigned long long)hdr.lost);
+
+	for (r = 0; r < hdr.nr; r++) {
+		int64_t real;
+
+		err = nlink_trace_read(fd, &rec, sizeof(rec));
+		if (err)
+			return err;
+
+		if (!rec.len) {
+			/* Slot overwritten while dumping. */
+			torn++;
+			continue;
+		}
+
+		real = (int64_t)rec.tstamp + hdr.real_offset;
+		nlink_trace_sprint_rec(str, &rec);
+
+		printf("%lld.%09lld %s\n",
+		       (long long)(real / 1000000000LL),
+		       (long long)(real % 1000000000LL),
+		       str);
+	}
+
+	if (torn)
+		fprintf(stderr,
+		        "%u record(s) overwritten while dumping\n",
+		        torn);
+
+	return 0;
+}
+
+int
+main(int argc, char * const argv[])
+{
+	int fd;
+	int err;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <TRACE_FILE>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr,
+		        "%s: %s: %s\n",
+		        argv[0],
+		        argv[1],
+		        strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	err = nlink_trace_decode(fd);
+
+	close(fd);
+
+	if (err) {
+		fprintf(stderr,
+		        "%s: %s: %s\n",
+		        argv[0],
+		        argv[1],
+		        strerror(-err));
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+#include <nlink/trace.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+__thread struct nlink_trace_ring *nlink_trace_curr;
+
+void
+nlink_trace_sprint_rec(char                          string[NLINK_SPRINT_MSG_SIZE],
+                       const struct nlink_trace_rec *rec)
+{
+	nlink_assert(string);
+	nlink_assert(rec);
+
+	/*
+	 * Rebuild a message header so that output format strictly matches
+	 * nlink_sprint_msg()'s.
+	 */
+	const struct nlmsghdr msg = {
+		.nlmsg_len   = rec->len,
+		.nlmsg_type  = rec->type,
+		.nlmsg_flags = rec->flags,
+		.nlmsg_seq   = rec->seq,
+		.nlmsg_pid   = rec->pid
+	};
+
+	nlink_sprint_msg(string, &msg);
+}
+
+static int
+nlink_trace_write(int fd, const void *data, size_t size)
+{
+	const char *buff = data;
+
+	while (size) {
+		ssize_t ret;
+
+		ret = write(fd, buff, size);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			nlink_assert(errno != EBADF);
+			nlink_assert(errno != EFAULT);
+			nlink_assert(errno != EINVAL);
+
+			return -errno;
+		}
+
+		buff += ret;
+		size -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+static int64_t
+nlink_trace_real_offset(void)
+{
+	struct timespec real;
+	struct timespec mono;
+
+	clock_gettime(CLOCK_REALTIME, &real);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+
+	return ((int64_t)(real.tv_sec - mono.tv_sec) * 1000000000LL) +
+	       (int64_t)(real.tv_nsec - mono.tv_nsec);
+}
+
+#define NLINK_TRACE_DUMP_CHUNK (64U)
+
+/*
+ * Dump ring content to the given file descriptor.
+ *
+ * Only relies upon write(2) and clock_gettime(2) which are async-signal-safe,
+ * allowing to dump rings from within fatal signal handlers.
+ *
+ * The ring may be dumped while its owner thread keeps recording. Records are
+ * therefore copied by chunks onto the stack, then head is re-read seqlock-style
+ * to detect slots the owner thread overwrote in the meantime ; these are
+ * emitted zeroed (i.e., with a null len) so that readers may discard them.
+ */
+int
+nlink_trace_dump_ring(const struct nlink_trace_ring *ring, int fd)
+{
+	nlink_trace_assert_ring(ring);
+	nlink_assert(fd >= 0);
+
+	unsigned long           head;
+	unsigned long           size = (unsigned long)ring->mask + 1;
+	unsigned long           start;
+	unsigned long           idx;
+	struct nlink_trace_file hdr;
+	struct nlink_trace_rec  buff[NLINK_TRACE_DUMP_CHUNK];
+	int                     err;
+
+	/*
+	 * Skip the oldest slot when the ring is full: owner thread may be
+	 * filling it with record head right now.
+	 */
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	start = (head >= size) ? (head - size + 1) : 0;
+
+	memcpy(hdr.magic, NLINK_TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = NLINK_TRACE_VERSION;
+	hdr.rec_size = sizeof(ring->recs[0]);
+	hdr.nr = (uint32_t)(head - start);
+	hdr.pad = 0;
+	hdr.real_offset = nlink_trace_real_offset();
+	hdr.lost = start;
+
+	err = nlink_trace_write(fd, &hdr, sizeof(hdr));
+	if (err)
+		return err;
+
+	for (idx = start; idx < head; idx += NLINK_TRACE_DUMP_CHUNK) {
+		unsigned int  nr = NLINK_TRACE_DUMP_CHUNK;
+		unsigned long curr;
+		unsigned int  r;
+
+		if ((head - idx) < nr)
+			nr = (unsigned int)(head - idx);
+
+		for (r = 0; r < nr; r++)
+			buff[r] = ring->recs[(idx + r) & ring->mask];
+
+		/*
+		 * Order record loads above before head reload below: owner thread
+		 * may already be filling the slot of record curr - size, and has
+		 * overwritten all records preceding it.
+		 */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		curr = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+		for (r = 0; (r < nr) && ((idx + r + size) <= curr); r++)
+			memset(&buff[r], 0, sizeof(buff[r]));
+
+		err = nlink_trace_write(fd, buff, nr * sizeof(buff[0]));
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/*
+ * Attach ring to the calling thread so that subsequent nlink_send_msg() /
+ * nlink_recv_msg() calls record into it. Passing NULL detaches current ring.
+ * Returns the previously attached ring.
+ */
+struct nlink_trace_ring *
+nlink_trace_attach_ring(struct nlink_trace_ring *ring)
+{
+	struct nlink_trace_ring *prev = nlink_trace_curr;
+
+	nlink_trace_curr = ring;
+
+	return prev;
+}
+
+/*
+ * Allocate a ring able to hold 2^order records.
+ */
+struct nlink_trace_ring *
+nlink_trace_create_ring(unsigned int order)
+{
+	nlink_assert(order);
+	nlink_assert(order < 32);
+
+	unsigned int             nr = 1U << order;
+	struct nlink_trace_ring *ring;
+
+	ring = malloc(sizeof(*ring) + (nr * sizeof(ring->recs[0])));
+	if (!ring)
+		return NULL;
+
+	ring->head = 0;
+	ring->mask = nr - 1;
+
+	return ring;
+}
+
+void
+nlink_trace_destroy_ring(struct nlink_trace_ring *ring)
+{
+	nlink_trace_assert_ring(ring);
+	nlink_assert(nlink_trace_curr != ring);
+
+	free(ring);
+}
@@ -0,0 +1,359 @@
+#include <nlink/uevent.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+/******************************************************************************
+ * Uevent parsing
+ ******************************************************************************/
+
+struct nlink_uevent_name {
+	const char   *str;
+	unsigned int  len;
+};
+
+static const struct nlink_uevent_name nlink_uevent_names[] = {
+	[NLINK_UEVENT_ACTION_KEY]    = { "ACTION",    6 },
+	[NLINK_UEVENT_DEVPATH_KEY]   = { "DEVPATH",   7 },
+	[NLINK_UEVENT_SUBSYSTEM_KEY] = { "SUBSYSTEM", 9 },
+	[NLINK_UEVENT_INTERFACE_KEY] = { "INTERFACE", 9 },
+	[NLINK_UEVENT_IFINDEX_KEY]   = { "IFINDEX",   7 },
+	[NLINK_UEVENT_SEQNUM_KEY]    = { "SEQNUM",    6 }
+};
+
+/*
+ * Perfect hash of common keys: (key length + first character) modulo 16 is
+ * unique across common keys. Entries hold key index plus one, zero meaning no
+ * common key may hash there.
+ */
+#define NLINK_UEVENT_HASH_NR (16U)
+
+#define nlink_uevent_hash(_key, _len) \
+	(((_len) + (unsigned char)(_key)[0]) % NLINK_UEVENT_HASH_NR)
+
+static const uint8_t nlink_uevent_hash_tab[NLINK_UEVENT_HASH_NR] = {
+	[('A' + 6) % NLINK_UEVENT_HASH_NR] = NLINK_UEVENT_ACTION_KEY + 1,
+	[('D' + 7) % NLINK_UEVENT_HASH_NR] = NLINK_UEVENT_DEVPATH_KEY + 1,
+	[('S' + 9) % NLINK_UEVENT_HASH_NR] = NLINK_UEVENT_SUBSYSTEM_KEY + 1,
+	[('I' + 9) % NLINK_UEVENT_HASH_NR] = NLINK_UEVENT_INTERFACE_KEY + 1,
+	[('I' + 7) % NLINK_UEVENT_HASH_NR] = NLINK_UEVENT_IFINDEX_KEY + 1,
+	[('S' + 6) % NLINK_UEVENT_HASH_NR] = NLINK_UEVENT_SEQNUM_KEY + 1
+};
+
+static void
+nlink_uevent_index_var(struct nlink_uevent *event,
+                       const char          *var,
+                       size_t               len)
+{
+	const char   *sep;
+	unsigned int  key_len;
+	unsigned int  k;
+
+	sep = memchr(var, '=', len);
+	if (!sep || (sep == var))
+		return;
+
+	key_len = (unsigned int)(sep - var);
+	k = nlink_uevent_hash_tab[nlink_uevent_hash(var, key_len)];
+	if (!k--)
+		return;
+
+	if ((nlink_uevent_names[k].len != key_len) ||
+	    memcmp(nlink_uevent_names[k].str, var, key_len))
+		return;
+
+	event->vals[k].str = sep + 1;
+	event->vals[k].len = (unsigned int)(len - key_len - 1);
+}
+
+/*
+ * Parse a kernel uevent datagram, i.e. an ACTION@DEVPATH header string
+ * followed by NUL separated KEY=VALUE variables.
+ */
+int
+nlink_uevent_parse(const char *buff, size_t size, struct nlink_uevent *event)
+{
+	nlink_assert(buff);
+	nlink_assert(event);
+
+	const char *end = buff + size;
+	const char *var;
+
+	memset(event->vals, 0, sizeof(event->vals));
+
+	var = memchr(buff, '\0', size);
+	if (!var || !memchr(buff, '@', (size_t)(var - buff)))
+		return -EBADMSG;
+
+	event->vars = ++var;
+	event->size = (size_t)(end - var);
+
+	while (var < end) {
+		const char *nul;
+
+		nul = memchr(var, '\0', (size_t)(end - var));
+		if (!nul)
+			nul = end;
+
+		nlink_uevent_index_var(event, var, (size_t)(nul - var));
+
+		var = nul + 1;
+	}
+
+	if (!event->vals[NLINK_UEVENT_ACTION_KEY].str ||
+	    !event->vals[NLINK_UEVENT_DEVPATH_KEY].str)
+		return -EBADMSG;
+
+	return 0;
+}
+
+/* Lookup variable not indexed at parsing time. */
+const char *
+nlink_uevent_get(const struct nlink_uevent *event,
+                 const char                *key,
+                 size_t                     key_len,
+                 size_t                    *val_len)
+{
+	nlink_assert(event);
+	nlink_assert(event->vars);
+	nlink_assert(key);
+	nlink_assert(key_len);
+	nlink_assert(val_len);
+
+	const char *var = event->vars;
+	const char *end = var + event->size;
+
+	while (var < end) {
+		const char *nul;
+
+		nul = memchr(var, '\0', (size_t)(end - var));
+		if (!nul)
+			nul = end;
+
+		if (((size_t)(nul - var) > key_len) &&
+		    (var[key_len] == '=') &&
+		    !memcmp(var, key, key_len)) {
+			*val_len = (size_t)(nul - var) - key_len - 1;
+			return &var[key_len + 1];
+		}
+
+		var = nul + 1;
+	}
+
+	return NULL;
+}
+
+/******************************************************************************
+ * Uevent socket
+ ******************************************************************************/
+
+/*
+ * Receive a uevent datagram. Datagrams not originating from kernel are
+ * rejected with -ESRCH.
+ */
+ssize_t
+nlink_uevent_recv(const struct nlink_sock *sock, char *buff, size_t size)
+{
+	nlink_assert_sock(sock);
+	nlink_assert(buff);
+	nlink_assert(size);
+
+	struct sockaddr_nl addr;
+	struct iovec       iov = {
+		.iov_base = buff,
+		.iov_len  = size
+	};
+	struct msghdr      hdr = {
+		.msg_name    = &addr,
+		.msg_namelen = sizeof(addr),
+		.msg_iov     = &iov,
+		.msg_iovlen  = 1
+	};
+	ssize_t            ret;
+
+	ret = recvmsg(nlink_sock_fd(sock), &hdr, 0);
+	if (ret < 0) {
+		nlink_assert(errno != EBADF);
+		nlink_assert(errno != EFAULT);
+		nlink_assert(errno != EINVAL);
+		nlink_assert(errno != ENOTCONN);
+		nlink_assert(errno != ENOTSOCK);
+
+		return -errno;
+	}
+
+	if (hdr.msg_flags & MSG_TRUNC)
+		return -EMSGSIZE;
+
+	nlink_assert(hdr.msg_namelen == sizeof(addr));
+	if (addr.nl_pid)
+		return -ESRCH;
+
+	return ret;
+}
+
+int
+nlink_open_uevent_sock(struct nlink_sock *sock, int flags)
+{
+	nlink_assert(sock);
+
+	int group = NLINK_UEVENT_KERNEL_GROUP;
+	int err;
+
+	err = nlink_open_sock(sock, NETLINK_KOBJECT_UEVENT, flags);
+	if (err)
+		return err;
+
+	if (mnl_socket_setsockopt(sock->mnl,
+	                          NETLINK_ADD_MEMBERSHIP,
+	                          &group,
+	                          sizeof(group))) {
+		nlink_assert(errno != EBADF);
+		nlink_assert(errno != EFAULT);
+		nlink_assert(errno != EINVAL);
+		nlink_assert(errno != ENOPROTOOPT);
+		nlink_assert(errno != ENOTSOCK);
+
+		err = -errno;
+		nlink_close_sock(sock);
+	}
+
+	return err;
+}
+
+/******************************************************************************
+ * Subsystem filter
+ ******************************************************************************/
+
+#if defined(CONFIG_NLINK_FILTER)
+
+#include <nlink/filter.h>
+
+#define NLINK_UEVENT_FILTER_ACCEPT (0xffffffffU)
+#define NLINK_UEVENT_FILTER_DROP   (0U)
+
+/* Longest subsystem name, keeping compare section jumps within 8 bits. */
+#define NLINK_UEVENT_FILTER_SUBSYS_MAX (64U)
+
+/*
+ * Kernel builds uevent environments starting with ACTION, DEVPATH then
+ * SUBSYSTEM variables, right after the ACTION@DEVPATH header string. Given
+ * header string length L (including NUL), SUBSYSTEM variable hence starts at
+ * offset L + (strlen("ACTION=") + strlen(action) + 1) +
+ * (strlen("DEVPATH=") + strlen(devpath) + 1), i.e. 2 * L + 15.
+ *
+ * Classic BPF has no loop: header NUL is searched for thanks to an unrolled
+ * scan loading the computed SUBSYSTEM offset into X, then
+ * "SUBSYSTEM=<subsys>\0" is compared chunk by chunk using indirect loads.
+ * Loads convert to host byte order: constants are built in network byte
+ * order accordingly.
+ */
+int
+nlink_uevent_filter_compile(const char *subsys, struct sock_fprog *prog)
+{
+	nlink_assert(subsys);
+	nlink_assert(*subsys);
+	nlink_assert(prog);
+
+	char                pat[sizeof("SUBSYSTEM=") +
+	                        NLINK_UEVENT_FILTER_SUBSYS_MAX];
+	size_t              len = strlen(subsys);
+	unsigned int        match = (4 * NLINK_UEVENT_FILTER_SCAN_MAX) + 1;
+	unsigned int        chunks;
+	unsigned int        rej;
+	struct sock_filter *insns;
+	unsigned int        i = 0;
+	unsigned int        p;
+	size_t              off;
+	size_t              nr;
+
+	if (len > NLINK_UEVENT_FILTER_SUBSYS_MAX)
+		return -ENAMETOOLONG;
+
+	/* Pattern includes the terminating NUL to reject prefix matches. */
+	memcpy(pat, "SUBSYSTEM=", sizeof("SUBSYSTEM=") - 1);
+	memcpy(&pat[sizeof("SUBSYSTEM=") - 1], subsys, len + 1);
+	len += sizeof("SUBSYSTEM=");
+
+	/* Compare word by word, then half-word and / or byte for the tail. */
+	chunks = (unsigned int)(len / 4) + (unsigned int)((len % 4) + 1) / 2;
+	rej = match + (2 * chunks) + 1;
+
+	insns = malloc((rej + 1) * sizeof(insns[0]));
+	if (!insns)
+		return -errno;
+
+	for (p = 0; p < NLINK_UEVENT_FILTER_SCAN_MAX; p++) {
+		insns[i++] = (struct sock_filter)
+		             BPF_STMT(BPF_LD | BPF_B | BPF_ABS, p);
+		insns[i++] = (struct sock_filter)
+		             BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 2);
+		insns[i++] = (struct sock_filter)
+		             BPF_STMT(BPF_LDX | BPF_IMM, (2 * (p + 1)) + 15);
+		insns[i] = (struct sock_filter)
+		           BPF_STMT(BPF_JMP | BPF_JA, match - (i + 1));
+		i++;
+	}
+
+	/* Header string too long to be scanned: let user space decide. */
+	insns[i++] = (struct sock_filter)
+	             BPF_STMT(BPF_RET | BPF_K, NLINK_UEVENT_FILTER_ACCEPT);
+	nlink_assert(i == match);
+
+	for (off = 0; off < len; off += nr) {
+		const uint8_t *bytes = (const uint8_t *)&pat[off];
+		uint32_t       val = 0;
+		uint16_t       size;
+		size_t         b;
+
+		nr = ((len - off) >= 4) ? 4 : ((len - off) >= 2) ? 2 : 1;
+		for (b = 0; b < nr; b++)
+			val = (val << 8) | bytes[b];
+
+		size = (nr == 4) ? BPF_W : (nr == 2) ? BPF_H : BPF_B;
+		insns[i++] = (struct sock_filter)
+		             BPF_STMT(BPF_LD | size | BPF_IND, (uint32_t)off);
+		insns[i] = (struct sock_filter)
+		           BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+		                    val,
+		                    0,
+		                    (uint8_t)(rej - (i + 1)));
+		i++;
+	}
+
+	insns[i++] = (struct sock_filter)
+	             BPF_STMT(BPF_RET | BPF_K, NLINK_UEVENT_FILTER_ACCEPT);
+	nlink_assert(i == rej);
+	insns[i++] = (struct sock_filter)
+	             BPF_STMT(BPF_RET | BPF_K, NLINK_UEVENT_FILTER_DROP);
+
+	prog->len = (unsigned short)i;
+	prog->filter = insns;
+
+	return 0;
+}
+
+/*
+ * Attach a filter passing uevents of the given subsystem only. Detach it
+ * using nlink_detach_filter().
+ */
+int
+nlink_uevent_attach_filter(const struct nlink_sock *sock, const char *subsys)
+{
+	nlink_assert_sock(sock);
+
+	struct sock_fprog prog;
+	int               err;
+
+	err = nlink_uevent_filter_compile(subsys, &prog);
+	if (err)
+		return err;
+
+	err = nlink_attach_prog(sock, &prog);
+
+	free(prog.filter);
+
+	return err;
+}
+
+#endif /* defined(CONFIG_NLINK_FILTER) */
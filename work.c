@@ -1,5 +1,6 @@
 #include <nlink/work.h>
 #include <errno.h>
+#include <time.h>
 
 static void
 nlink_win_xtract_work(struct nlink_work *work)
@@ -12,6 +13,141 @@ nlink_win_xtract_work(struct nlink_work *work)
 #endif /* defined(CONFIG_NLINK_ASSERT) */
 }
 
+/******************************************************************************
+ * Adaptive flow control
+ ******************************************************************************/
+
+static uint64_t
+nlink_win_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+static void
+nlink_win_shrink(struct nlink_win *win)
+{
+	struct nlink_win_flow *flow = &win->flow;
+
+	if (flow->hold)
+		/* Already reacted to current congestion episode. */
+		return;
+
+	win->lim /= 2;
+	if (win->lim < flow->min)
+		win->lim = flow->min;
+
+	flow->thresh = win->lim;
+	flow->acks = 0;
+	/* Requests in flight at decision time belong to the same episode. */
+	flow->hold = win->cnt;
+	flow->shrinks++;
+}
+
+static void
+nlink_win_ack(struct nlink_win *win, uint64_t lat)
+{
+	struct nlink_win_flow *flow = &win->flow;
+	uint64_t               ref;
+
+	flow->srtt = flow->srtt ? ((7 * flow->srtt) + lat) / 8 : lat;
+
+	/* Track base latency over a sliding epoch to follow host load. */
+	if (lat < flow->epoch_min)
+		flow->epoch_min = lat;
+	if (lat < flow->base)
+		flow->base = lat;
+	if (++flow->epoch == NLINK_WIN_BASE_EPOCH) {
+		flow->base = flow->epoch_min;
+		flow->epoch_min = UINT64_MAX;
+		flow->epoch = 0;
+	}
+
+	if (flow->hold) {
+		flow->hold--;
+		return;
+	}
+
+	ref = (flow->base > NLINK_WIN_LATENCY_FLOOR_NSEC) ?
+	      flow->base : NLINK_WIN_LATENCY_FLOOR_NSEC;
+
+	if (lat > (NLINK_WIN_SPIKE_FACTOR * ref)) {
+		nlink_win_shrink(win);
+		return;
+	}
+
+	if ((flow->srtt > (NLINK_WIN_LOW_LATENCY_FACTOR * ref)) ||
+	    (win->lim == win->nr))
+		return;
+
+	if (win->lim < flow->thresh) {
+		/* Slow start: double window every round trip. */
+		win->lim++;
+		flow->grows++;
+	}
+	else if (++flow->acks >= win->lim) {
+		/* Congestion avoidance: grow by one every round trip. */
+		flow->acks = 0;
+		win->lim++;
+		flow->grows++;
+	}
+}
+
+/*
+ * Notify window that kernel pushed back, i.e. nlink_send_msg() returned
+ * -EAGAIN or -ENOBUFS, or a receive queue overrun happened. Shrinks window
+ * limit multiplicatively, at most once per congestion episode.
+ */
+void
+nlink_win_backoff(struct nlink_win *win)
+{
+	nlink_win_assert(win);
+
+	if (win->flow.min)
+		nlink_win_shrink(win);
+}
+
+/*
+ * Enable adaptive flow control. May be called at any time, including with
+ * requests in flight: latencies of requests scheduled before the call are
+ * not sampled.
+ *
+ * Window limit restarts from min and grows with ACKs (exponentially, then
+ * linearly past the first congestion episode) up to window capacity as long
+ * as ACK latency stays low. Latency spikes and nlink_win_backoff() calls
+ * halve the limit, never going below min.
+ */
+void
+nlink_win_adapt(struct nlink_win *win, unsigned int min)
+{
+	nlink_win_assert(win);
+	nlink_assert(min);
+	nlink_assert(min <= win->nr);
+
+	struct nlink_win_flow *flow = &win->flow;
+
+	win->lim = min;
+
+	flow->min = min;
+	flow->start = nlink_win_now();
+	flow->thresh = win->nr;
+	flow->acks = 0;
+	flow->hold = 0;
+	flow->epoch = 0;
+	flow->base = UINT64_MAX;
+	flow->epoch_min = UINT64_MAX;
+	flow->srtt = 0;
+	flow->grows = 0;
+	flow->shrinks = 0;
+}
+
+/******************************************************************************
+ * Request window
+ ******************************************************************************/
+
 struct nlink_work *
 nlink_win_acquire_work(struct nlink_win *win)
 {
@@ -57,11 +193,33 @@ nlink_win_sched_work(struct nlink_win  *win,
 
 	work->state = NLINK_PENDING_WORK_STATE;
 	work->seqno = seqno;
+	work->tstamp = win->flow.min ? nlink_win_now() : 0;
 
 	win->cnt++;
 	dlist_nqueue_back(&win->pend[seqno % win->nr], &work->node);
 }
 
+/*
+ * Lookup pending work matching seqno without retiring it, e.g. to route parts
+ * of a multipart reply.
+ */
+struct nlink_work *
+nlink_win_find_work(const struct nlink_win *win, uint32_t seqno)
+{
+	nlink_win_assert(win);
+
+	struct nlink_work *work;
+
+	dlist_foreach_entry(&win->pend[seqno % win->nr], work, node) {
+		nlink_assert(work->state == NLINK_PENDING_WORK_STATE);
+
+		if (work->seqno == seqno)
+			return work;
+	}
+
+	return NULL;
+}
+
 struct nlink_work *
 nlink_win_pull_work(struct nlink_win *win, uint32_t seqno)
 {
@@ -83,6 +241,14 @@ found:
 	nlink_win_xtract_work(work);
 	win->cnt--;
 
+	if (win->flow.min) {
+		if (work->tstamp >= win->flow.start)
+			nlink_win_ack(win, nlink_win_now() - work->tstamp);
+		else if (win->flow.hold)
+			/* Scheduled before nlink_win_adapt(): no sample. */
+			win->flow.hold--;
+	}
+
 	return work;
 }
 
@@ -167,29 +333,183 @@ nlink_win_init(struct nlink_win *win, unsigned int nr)
 
 	win->cnt = 0;
 	win->nr = nr;
+	win->lim = nr;
+	win->flow.min = 0;
 
 	return 0;
 }
 
-void
-nlink_win_fini(const struct nlink_win *win)
+static void
+nlink_win_free_pend(const struct nlink_win *win)
 {
-	nlink_win_assert(win);
 	nlink_assert(!win->cnt);
 #if defined(CONFIG_NLINK_ASSERT)
 	{
-		unsigned int       w;
-		struct nlink_work *work;
+		unsigned int w;
 
 		for (w = 0; w < win->nr; w++)
 			nlink_assert(dlist_empty(&win->pend[w]));
+	}
+#endif /* defined(CONFIG_NLINK_ASSERT) */
+
+	free(win->pend);
+}
+
+void
+nlink_win_fini(const struct nlink_win *win)
+{
+	nlink_win_assert(win);
+#if defined(CONFIG_NLINK_ASSERT)
+	{
+		unsigned int       w = 0;
+		struct nlink_work *work;
 
-		w = 0;
 		dlist_foreach_entry(&win->free, work, node)
 			w++;
 		nlink_assert(w == win->nr);
 	}
 #endif /* defined(CONFIG_NLINK_ASSERT) */
 
-	free(win->pend);
+	nlink_win_free_pend(win);
+}
+
+/*
+ * Release a window whose works were never registered, i.e. embedded into
+ * caller contexts and scheduled without going through the free list.
+ */
+void
+nlink_win_fini_embedded(const struct nlink_win *win)
+{
+	nlink_win_assert(win);
+	nlink_assert(dlist_empty(&win->free));
+
+	nlink_win_free_pend(win);
+}
+
+/******************************************************************************
+ * Request collapsing
+ ******************************************************************************/
+
+static struct dlist_node *
+nlink_coll_chain(const struct nlink_coll *coll, int index, unsigned int attr)
+{
+	uint32_t hash = ((uint32_t)index * 2654435761U) ^ attr;
+
+	return &coll->chains[hash % coll->nr];
+}
+
+/*
+ * Queue request for transmission, folding the queued request sharing the same
+ * key if any. Returns the folded request, NULL otherwise.
+ */
+struct nlink_coll_req *
+nlink_coll_stage(struct nlink_coll *coll, struct nlink_coll_req *req)
+{
+	nlink_coll_assert(coll);
+	nlink_assert(req);
+	nlink_assert(req->index > 0);
+
+	struct dlist_node     *head = nlink_coll_chain(coll,
+	                                               req->index,
+	                                               req->attr);
+	struct nlink_coll_req *old;
+
+	dlist_foreach_entry(head, old, chain) {
+		if ((old->index == req->index) && (old->attr == req->attr))
+			goto fold;
+	}
+
+	dlist_nqueue_back(&coll->fifo, &req->fifo);
+	dlist_nqueue_back(head, &req->chain);
+	coll->cnt++;
+
+	return NULL;
+
+fold:
+	/* Take the place of the superseded request into queue and chain. */
+	dlist_nqueue_front(&old->fifo, &req->fifo);
+	dlist_remove(&old->fifo);
+	dlist_nqueue_front(&old->chain, &req->chain);
+	dlist_remove(&old->chain);
+
+	/* Inherit requests previously folded into the superseded one... */
+	while (!dlist_empty(&old->folded))
+		dlist_nqueue_back(&req->folded,
+		                  dlist_dqueue_front(&old->folded));
+
+	/* ...then chain the superseded one itself. */
+	dlist_nqueue_back(&req->folded, &old->fifo);
+	coll->folds++;
+
+	return old;
+}
+
+/* Dequeue the oldest staged request for transmission. */
+struct nlink_coll_req *
+nlink_coll_unstage(struct nlink_coll *coll)
+{
+	nlink_coll_assert(coll);
+
+	struct nlink_coll_req *req;
+
+	if (!coll->cnt)
+		return NULL;
+
+	req = dlist_entry(dlist_dqueue_front(&coll->fifo),
+	                  struct nlink_coll_req,
+	                  fifo);
+	dlist_remove(&req->chain);
+	coll->cnt--;
+
+	return req;
+}
+
+/*
+ * Pop next request folded into the given one, oldest first. Returns NULL once
+ * all of them have been popped.
+ */
+struct nlink_coll_req *
+nlink_coll_pop_folded(struct nlink_coll_req *req)
+{
+	nlink_assert(req);
+
+	if (dlist_empty(&req->folded))
+		return NULL;
+
+	return dlist_entry(dlist_dqueue_front(&req->folded),
+	                   struct nlink_coll_req,
+	                   fifo);
+}
+
+int
+nlink_coll_init(struct nlink_coll *coll, unsigned int nr)
+{
+	nlink_assert(coll);
+	nlink_assert(nr);
+
+	unsigned int c;
+
+	coll->chains = malloc(nr * sizeof(coll->chains[0]));
+	if (!coll->chains)
+		return -errno;
+
+	dlist_init(&coll->fifo);
+	for (c = 0; c < nr; c++)
+		dlist_init(&coll->chains[c]);
+
+	coll->cnt = 0;
+	coll->nr = nr;
+	coll->folds = 0;
+
+	return 0;
+}
+
+void
+nlink_coll_fini(const struct nlink_coll *coll)
+{
+	nlink_coll_assert(coll);
+	nlink_assert(!coll->cnt);
+	nlink_assert(dlist_empty(&coll->fifo));
+
+	free(coll->chains);
 }